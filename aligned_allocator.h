@@ -0,0 +1,73 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef ALIGNED_ALLOCATOR_H
+#define ALIGNED_ALLOCATOR_H
+
+#include	<cstddef>
+#include	<cstdint>
+#include	<cstdlib>
+#include	<new>
+
+#define		CACHE_LINE_SIZE		64
+
+/** \brief A standard allocator that hands out storage aligned to the given boundary
+ *
+ * Used for dense value arrays so that the first slot starts on a cache line and vector
+ * loads never straddle one.
+ */
+template <typename T, std::size_t Alignment = CACHE_LINE_SIZE>
+class AlignedAllocator
+{
+	static_assert(Alignment >= sizeof(void*) && (Alignment & (Alignment - 1)) == 0, "alignment must be a power of two");
+
+	public:
+		typedef T value_type;
+		typedef T* pointer;
+		typedef const T* const_pointer;
+		typedef T& reference;
+		typedef const T& const_reference;
+		typedef std::size_t size_type;
+		typedef std::ptrdiff_t difference_type;
+
+		template <typename U>
+		struct rebind
+		{
+			typedef AlignedAllocator<U, Alignment> other;
+		};
+
+		AlignedAllocator() { }
+
+		template <typename U>
+		AlignedAllocator(const AlignedAllocator<U, Alignment>&) { }
+
+		T* allocate(std::size_t n)
+		{
+			//Over-allocate, align inside the block and stash the original pointer just before the aligned one
+			void* raw = std::malloc(n * sizeof(T) + Alignment + sizeof(void*));
+
+			if (raw == nullptr)
+				throw std::bad_alloc();
+
+			std::uintptr_t aligned = (reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*) + Alignment - 1) & ~(Alignment - 1);
+			reinterpret_cast<void**>(aligned)[-1] = raw;
+
+			return reinterpret_cast<T*>(aligned);
+		}
+
+		void deallocate(T* p, std::size_t)
+		{
+			if (p != nullptr)
+				std::free(reinterpret_cast<void**>(p)[-1]);
+		}
+
+		template <typename U>
+		bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+
+		template <typename U>
+		bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+#endif
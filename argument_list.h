@@ -15,11 +15,11 @@
 class ArgumentList
 {
 	private:
-		/**< An iterator that points to the beginning of the argument list on the evaluation stack */
-		std::vector<Value>::iterator argListBegin;
+		/**< A pointer to the beginning of the argument list on the evaluation stack */
+		Value* argListBegin;
 
-		/**< An iterator that points to the end of the argument list on the evaluation stack */
-		std::vector<Value>::iterator argListEnd;
+		/**< A pointer to the end of the argument list on the evaluation stack */
+		Value* argListEnd;
 
         /**< A variable context to be used for variable look-ups within function definitions */
 		VariableContext& _vc;
@@ -27,12 +27,12 @@ class ArgumentList
 	public:
         /** \brief Constructor
          *
-         * \param first		An iterator that points to the beginning of the argument list on the evaluation stack
-         * \param last		An iterator that points to the end of the argument list on the evaluation stack
+         * \param first		A pointer to the beginning of the argument list on the evaluation stack
+         * \param last		A pointer to the end of the argument list on the evaluation stack
          * \param vc		A variable context to be used for variable look-ups within function definitions
          *
          */
-		ArgumentList(std::vector<Value>::iterator first, std::vector<Value>::iterator last, VariableContext& vc) :
+		ArgumentList(Value* first, Value* last, VariableContext& vc) :
 			argListBegin(first),
 			argListEnd(last),
 			_vc(vc)
@@ -49,7 +49,7 @@ class ArgumentList
 			assert(index < length());
 			unsigned int varID = (argListBegin + index)->variableId;
 
-			return _vc.lookupVariable(varID)->getReference();
+			return _vc.value(varID);
 		}
 
         /** \brief Looks up a variable and returns its value
@@ -64,6 +64,18 @@ class ArgumentList
 			return (argListBegin + index)->numeric;
 		}
 
+        /** \brief Evaluates an argument passed to a HAND_EXPRESSION parameter
+         *
+         * \param index		The position of the argument
+         * \return 			The value of the sub-expression with the current variable values
+         *
+         */
+		double evaluate(const unsigned int index)
+		{
+			assert(index < length());
+			return (argListBegin + index)->expression->evaluate(_vc);
+		}
+
         /** \brief Returns the number of arguments in the argument list
          *
          * \return The number of arguments contained in the argument list
@@ -0,0 +1,335 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<cmath>
+#include	<limits>
+#include	<stdexcept>
+#include	<unordered_map>
+
+#include	"array_expression.h"
+#include	"expression_parser.h"
+#include	"vector_kernels.h"
+
+namespace
+{
+	/** \brief Sums the results of a stage block by block */
+	class BlockSum : public ReductionSink
+	{
+		private:
+			double _sum;
+
+		public:
+			BlockSum() :
+				_sum(0.0)
+			{ }
+
+			void consume(const double* values, std::size_t count, std::size_t) { _sum += Exparse::kernels::sum(values, count); }
+			void merge(const ReductionSink& partial) { _sum += static_cast<const BlockSum&>(partial)._sum; }
+			std::unique_ptr<ReductionSink> partial() const { return std::unique_ptr<ReductionSink>(new BlockSum()); }
+
+			double sum() const { return _sum; }
+	};
+
+	std::string variableName(const VariableContext& vc, unsigned int id)
+	{
+		return vc.lookupVariable(id)->name();
+	}
+
+	/** \brief Throws if a sub-expression passed unevaluated, or one nested in it, reads an array */
+	void checkBody(const ExpressionGraph& body, const VariableContext& vc)
+	{
+		for (unsigned int i = 0; i < body.size(); i++)
+		{
+			const ExpressionGraph::Node& n = body.node(i);
+
+			if ((n.type == ExpressionGraph::NODE_LOAD || n.type == ExpressionGraph::NODE_REFERENCE) && vc.isArray(n.id))
+				throw std::invalid_argument("'" + variableName(vc, n.id) + "' is an array and cannot be read by a sub-expression passed unevaluated");
+
+			if (n.type == ExpressionGraph::NODE_EXPRESSION)
+				checkBody(body.body(n), vc);
+		}
+	}
+
+	/** \brief Lists the array variables read by the outputs of a graph */
+	std::vector<unsigned int> arraysRead(const ExpressionGraph& graph, const VariableContext& vc)
+	{
+		std::vector<bool> live = graph.liveNodes();
+		std::vector<unsigned int> arrays;
+
+		for (unsigned int i = 0; i < graph.size(); i++)
+			if (live[i] && graph.node(i).type == ExpressionGraph::NODE_LOAD && vc.isArray(graph.node(i).id))
+				arrays.push_back(graph.node(i).id);
+
+		return arrays;
+	}
+}
+
+/** \brief Constructor
+ *
+ * \param expr	The expression; throws a TokenizerException if it is malformed, and std::invalid_argument
+ *				if it assigns to variables or does not use arrays as described above
+ * \param vc	The variable context that variable names are resolved in; arrays are recognised by
+ *				the bindings it has now
+ * \param fc	The function context that operators and functions are resolved in
+ *
+ */
+ArrayExpression::ArrayExpression(const std::string& expr, VariableContext& vc, const FunctionContext& fc) :
+	_variableContext(vc)
+{
+	ExpressionParser parser(expr, vc, fc);
+	ExpressionGraph graph(fc);
+	unsigned int root = graph.addExpression(parser);
+
+	graph.addOutput(root);
+
+	if (graph.effects() & EFFECT_WRITES_CONTEXT)
+		throw std::invalid_argument("array expressions cannot assign to variables");
+
+	const unsigned int totalId = fc.getFunctionID("total");
+	const unsigned int dotId = fc.getFunctionID("dot");
+	const unsigned int normId = fc.getFunctionID("norm");
+	const unsigned int atId = fc.getFunctionID("at");
+	const unsigned int multiplyId = fc.getOperatorID("*", Operator::POS_INFIX);
+
+	std::vector<bool> live = graph.liveNodes();
+	std::vector<bool> isArray(graph.size(), false);
+	std::vector<std::pair<unsigned int, const double*> > stageResults;		//The node of each stage and where its result is kept
+
+	//Copies the operands of a stage into a graph of their own, reading the results of earlier stages as inputs
+	auto copyInto = [&](ExpressionGraph& target, const std::vector<unsigned int>& nodes)
+	{
+		std::unordered_map<unsigned int, unsigned int> copies;
+		std::vector<unsigned int> result;
+
+		for (unsigned int k = 0; k < stageResults.size(); k++)
+			copies[stageResults[k].first] = target.input(stageResults[k].second);
+
+		for (unsigned int k = 0; k < nodes.size(); k++)
+			result.push_back(target.copy(graph, nodes[k], copies));
+
+		return result;
+	};
+
+	//Arguments come before their users, so a node's arguments are classified when it is reached
+	for (unsigned int i = 0; i < graph.size(); i++)
+	{
+		if (!live[i])
+			continue;
+
+		const ExpressionGraph::Node& n = graph.node(i);
+		std::size_t stride;
+
+		switch (n.type)
+		{
+			case ExpressionGraph::NODE_LOAD:
+				isArray[i] = vc.isArray(n.id);
+
+				if (!isArray[i] && vc.rowBinding(n.id, stride) != nullptr)
+					throw std::invalid_argument("'" + variableName(vc, n.id) + "' is bound to rows rather than to an array");
+
+				break;
+
+			case ExpressionGraph::NODE_REFERENCE:
+				if (vc.isArray(n.id))
+					throw std::invalid_argument("'" + variableName(vc, n.id) + "' is an array and cannot be passed by reference");
+
+				break;
+
+			case ExpressionGraph::NODE_EXPRESSION:
+				checkBody(graph.body(n), vc);
+				break;
+
+			case ExpressionGraph::NODE_POLYNOMIAL:
+			case ExpressionGraph::NODE_CALL:
+				for (unsigned int j = 0; j < n.arguments.size(); j++)
+					isArray[i] = isArray[i] || isArray[n.arguments[j]];
+
+				break;
+
+			default: break;
+		}
+
+		bool reduces = n.type == ExpressionGraph::NODE_CALL && !n.isOperator &&
+				(n.id == totalId || n.id == dotId || n.id == normId || n.id == atId);
+
+		if (!reduces || !isArray[i])
+			continue;
+
+		if (n.id == atId && isArray[n.arguments[1]])
+			throw std::invalid_argument("the index passed to at() must not be an array");
+
+		Stage stage;
+		stage.kind = n.id == atId ? STAGE_ELEMENT : n.id == normId ? STAGE_NORM : STAGE_TOTAL;
+		stage.result.reset(new double(0.0));
+
+		//Arrays reduced as they are need no program
+		const ExpressionGraph::Node& u = graph.node(n.arguments[0]);
+		const ExpressionGraph::Node& v = graph.node(n.arguments[n.arguments.size() - 1]);
+
+		if (stage.kind != STAGE_ELEMENT && u.type == ExpressionGraph::NODE_LOAD && isArray[n.arguments[0]])
+		{
+			if (n.id == totalId)
+				stage.direct.push_back(u.id);
+			else if (n.id == normId)
+				stage.direct.assign(2, u.id);
+			else if (v.type == ExpressionGraph::NODE_LOAD && isArray[n.arguments[1]])
+			{
+				stage.direct.push_back(u.id);
+				stage.direct.push_back(v.id);
+			}
+		}
+
+		if (stage.direct.empty())
+		{
+			ExpressionGraph elements(fc);
+			std::vector<unsigned int> operands = copyInto(elements, n.id == dotId ? n.arguments : std::vector<unsigned int>(1, n.arguments[0]));
+
+			//dot() and norm() sum products, which are computed along with the elements
+			if (n.id == dotId)
+				operands[0] = elements.callOperator(multiplyId, operands);
+			else if (n.id == normId)
+				operands[0] = elements.callOperator(multiplyId, std::vector<unsigned int>(2, operands[0]));
+
+			elements.addOutput(operands[0]);
+			stage.elements.reset(new Program(elements, vc));
+			stage.arrays = arraysRead(elements, vc);
+		}
+		else
+			stage.arrays = stage.direct;
+
+		if (stage.kind == STAGE_ELEMENT)
+		{
+			ExpressionGraph index(fc);
+			index.addOutput(copyInto(index, std::vector<unsigned int>(1, n.arguments[1]))[0]);
+			stage.index.reset(new Program(index, vc));
+		}
+
+		stageResults.push_back(std::make_pair(i, stage.result.get()));
+		_stages.push_back(std::move(stage));
+		isArray[i] = false;
+	}
+
+	ExpressionGraph result(fc);
+	result.addOutput(copyInto(result, std::vector<unsigned int>(1, root))[0]);
+	_result.reset(new Program(result, vc));
+
+	if (isArray[root])
+		_resultArrays = arraysRead(result, vc);
+}
+
+/** \brief Returns the length shared by arrays read together, throwing if they differ */
+std::size_t ArrayExpression::commonLength(const std::vector<unsigned int>& arrays) const
+{
+	std::size_t length = 0;
+
+	for (unsigned int k = 0; k < arrays.size(); k++)
+	{
+		if (!_variableContext.isArray(arrays[k]))
+			throw std::invalid_argument("'" + variableName(_variableContext, arrays[k]) + "' is no longer bound to an array");
+
+		std::size_t l = _variableContext.arrayLength(arrays[k]);
+
+		if (k > 0 && l != length)
+			throw std::invalid_argument("arrays of different lengths cannot be combined element-wise");
+
+		length = l;
+	}
+
+	return length;
+}
+
+void ArrayExpression::runStage(Stage& stage)
+{
+	std::size_t length = commonLength(stage.arrays);
+	double result;
+
+	if (stage.kind == STAGE_ELEMENT)
+	{
+		double index = stage.index->evaluate();
+
+		result = std::numeric_limits<double>::quiet_NaN();
+
+		//Only a whole index in range survives the round trip through size_t unchanged
+		std::size_t row = index >= 0.0 && index < length ? static_cast<std::size_t>(index) : length;
+
+		if (row < length && !(static_cast<double>(row) < index))
+		{
+			double* column = &result;
+			stage.elements->evaluateSelection(&row, 1, &column);
+		}
+	}
+	else if (length == 0)
+	{
+		//Empty arrays may have no storage at all, so nothing must read them
+		result = 0.0;
+	}
+	else if (!stage.direct.empty())
+	{
+		std::size_t stride;
+		const double* a = _variableContext.rowBinding(stage.direct[0], stride);
+		const double* b = stage.direct.size() > 1 ? _variableContext.rowBinding(stage.direct[1], stride) : nullptr;
+
+		result = Exparse::kernels::dot(a, b, length);
+	}
+	else
+	{
+		BlockSum sum;
+		ReductionSink* sinks[1] = { &sum };
+
+		stage.elements->reduceBatch(length, sinks);
+		result = sum.sum();
+	}
+
+	if (stage.kind == STAGE_NORM)
+		result = std::sqrt(result);
+
+	*stage.result = result;
+}
+
+/** \brief Returns the number of elements of the result, which is 1 for a scalar */
+std::size_t ArrayExpression::length() const
+{
+	return isArray() ? commonLength(_resultArrays) : 1;
+}
+
+/** \brief Evaluates an expression whose result is a scalar
+ *
+ * \return	The result
+ *
+ */
+double ArrayExpression::evaluate()
+{
+	assert(!isArray());
+
+	for (auto it = _stages.begin(); it != _stages.end(); ++it)
+		runStage(*it);
+
+	return _result->evaluate();
+}
+
+/** \brief Evaluates the expression
+ *
+ * \param results	Receives the elements of the result, or the single value of a scalar result
+ *
+ */
+void ArrayExpression::evaluate(std::vector<double>& results)
+{
+	for (auto it = _stages.begin(); it != _stages.end(); ++it)
+		runStage(*it);
+
+	if (!isArray())
+	{
+		results.assign(1, _result->evaluate());
+		return;
+	}
+
+	results.resize(commonLength(_resultArrays));
+
+	if (results.empty())
+		return;
+
+	double* column = results.data();
+	_result->evaluateBatch(results.size(), &column);
+}
@@ -0,0 +1,74 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef ARRAY_EXPRESSION_H
+#define ARRAY_EXPRESSION_H
+
+#include	<string>
+#include	<vector>
+#include	<memory>
+#include	<cstddef>
+
+#include	"context.h"
+#include	"program.h"
+
+/** An expression over array variables, see VariableContext::bindArray().
+ *
+ *  Operators and functions apply element-wise, and scalars are broadcast against arrays, so
+ *  "a * x + b" is an array as long as x. total(), dot() and norm() reduce arrays to scalars, and
+ *  at(a, i) picks element i, counting from 0, or NaN if there is no such element. Arrays read
+ *  together must have the same length.
+ *
+ *  Each reduction or index of an array becomes a stage: its element-wise operand is compiled to a
+ *  Program and run over the array in blocks, with the default arithmetic operators running as
+ *  SIMD kernels and the scalar parts hoisted out of the loop, and the block results are reduced
+ *  as they are produced. Reductions of arrays that are read as they are, like dot(x, y), run
+ *  straight over the caller's storage. Stages run in order before the result, and later stages
+ *  read earlier results from storage of the expression's own, e.g. "x - total(x) / n"; no
+ *  variables are created for them.
+ *
+ *  Array expressions cannot assign to variables, and sub-expressions passed unevaluated, like the
+ *  body of sum(), cannot read arrays. Variables bound to arrays must stay bound to arrays, but may
+ *  be rebound to arrays of other lengths between evaluations.
+ */
+class ArrayExpression
+{
+	private:
+		typedef enum StageKind
+		{
+			STAGE_TOTAL,		/**< The sum of the elements */
+			STAGE_NORM,			/**< The square root of the sum of the elements, which are squares */
+			STAGE_ELEMENT		/**< The element selected by the index */
+		} StageKind;
+
+		struct Stage
+		{
+			StageKind kind;
+			std::unique_ptr<double> result;		/**< Receives the result, which later programs read as an input */
+			std::vector<unsigned int> direct;	/**< Arrays whose products are reduced straight from storage, if not empty */
+			std::unique_ptr<Program> elements;	/**< Otherwise the elements, with a single output */
+			std::unique_ptr<Program> index;		/**< STAGE_ELEMENT: the index, with a single output */
+			std::vector<unsigned int> arrays;	/**< The array variables the elements are read from */
+		};
+
+		VariableContext& _variableContext;
+		std::vector<Stage> _stages;
+		std::unique_ptr<Program> _result;
+		std::vector<unsigned int> _resultArrays;	/**< The array variables the result is read from; empty for a scalar */
+
+		std::size_t commonLength(const std::vector<unsigned int>& arrays) const;
+		void runStage(Stage& stage);
+
+	public:
+		ArrayExpression(const std::string& expr, VariableContext& vc, const FunctionContext& fc);
+
+		bool isArray() const { return !_resultArrays.empty(); }
+		std::size_t length() const;
+
+		double evaluate();
+		void evaluate(std::vector<double>& results);
+};
+
+#endif
@@ -0,0 +1,284 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "context.h"
+#include "expression_parser.h"
+#include "fast_math.h"
+
+using namespace std;
+
+/*
+ *	Benchmarks and accuracy reports for the library; built by the Benchmark target.
+ *
+ *	Exits with a non-zero status when a report falls outside its budget, so the tool can gate a build.
+ */
+
+namespace
+{
+	typedef enum ErrorKind
+	{
+		ERROR_RELATIVE = 0,
+		ERROR_ABSOLUTE
+	} ErrorKind;
+
+	/** \brief One row of the precision report: a function, an input range and a reference */
+	struct PrecisionCase
+	{
+		const char* function;
+		const char* range;
+		ErrorKind kind;
+		double (*reference)(double, double);
+		void (*sample)(mt19937_64& rng, double& x, double& y);
+	};
+
+	const double PRECISION_FAST_BUDGET = 1e-7;		/**< The documented error budget of PRECISION_FAST */
+	const unsigned int PRECISION_SAMPLES = 1000000;
+	const unsigned int VALIDATION_ROUNDS = 20000;
+
+	//Half well-formed, half malformed; {} is replaced by a variable name that differs on every round
+	const char* const validationCorpus[] =
+	{
+		"1 + 2 * 3",
+		"sin({}) ^ 2 + cos({}) ^ 2",
+		"{} = max(1, {}, 3); {} * pi",
+		"sum(k, 1, 10, k * {})",
+		"-(-{} + 4) / (2 - e)",
+		"if({} > 1, log({}), exp({}))",
+		"1 +",
+		"(2 * {}",
+		"nosuchfunction({})",
+		"{} * * 3",
+		"max(1, , {})",
+		"sin()"
+	};
+
+	double uniform(mt19937_64& rng, double lo, double hi)
+	{
+		return uniform_real_distribution<double>(lo, hi)(rng);
+	}
+
+	double referenceExp(double x, double)	{ return std::exp(x); }
+	double referenceLog(double x, double)	{ return std::log(x); }
+	double referenceSin(double x, double)	{ return std::sin(x); }
+	double referenceCos(double x, double)	{ return std::cos(x); }
+	double referencePow(double x, double y)	{ return std::pow(x, y); }
+
+	void sampleExp(mt19937_64& rng, double& x, double&)			{ x = uniform(rng, -708.0, 708.0); }
+	void sampleLog(mt19937_64& rng, double& x, double&)			{ x = std::exp2(uniform(rng, -1020.0, 1020.0)); }
+	void sampleLogNearOne(mt19937_64& rng, double& x, double&)	{ x = uniform(rng, 0.5, 2.0); }
+	void sampleTrig(mt19937_64& rng, double& x, double&)		{ x = uniform(rng, -1048576.0, 1048576.0); }
+	void sampleTrigSmall(mt19937_64& rng, double& x, double&)	{ x = uniform(rng, -4.0, 4.0); }
+
+	void samplePow(mt19937_64& rng, double& x, double& y)
+	{
+		x = std::exp2(uniform(rng, -10.0, 10.0));
+		y = uniform(rng, -50.0, 50.0);
+	}
+
+	void samplePowNearLimit(mt19937_64& rng, double& x, double& y)
+	{
+		//|y * log(x)| just below FASTMATH_POW_EXPONENT_LIMIT, where an error in log(x) is magnified the most
+		x = uniform(rng, 0.05, 20.0);
+		y = uniform(rng, -FASTMATH_POW_EXPONENT_LIMIT, FASTMATH_POW_EXPONENT_LIMIT) / std::log(x);
+	}
+
+	void samplePowLargeResult(mt19937_64& rng, double& x, double& y)
+	{
+		x = uniform(rng, 0.05, 20.0);
+		y = uniform(rng, -700.0, 700.0) / std::log(x);
+	}
+
+	const PrecisionCase precisionCases[] =
+	{
+		{ "exp", "|x| <= 708",				ERROR_RELATIVE, &referenceExp, &sampleExp },
+		{ "log", "2^-1020 <= x <= 2^1020",	ERROR_RELATIVE, &referenceLog, &sampleLog },
+		{ "log", "0.5 <= x <= 2",			ERROR_RELATIVE, &referenceLog, &sampleLogNearOne },
+		{ "sin", "|x| <= 2^20",				ERROR_ABSOLUTE, &referenceSin, &sampleTrig },
+		{ "sin", "|x| <= 4",				ERROR_ABSOLUTE, &referenceSin, &sampleTrigSmall },
+		{ "cos", "|x| <= 2^20",				ERROR_ABSOLUTE, &referenceCos, &sampleTrig },
+		{ "cos", "|x| <= 4",				ERROR_ABSOLUTE, &referenceCos, &sampleTrigSmall },
+		{ "pow", "2^-10 <= x <= 2^10, |y| <= 50",	ERROR_RELATIVE, &referencePow, &samplePow },
+		{ "pow", "|y * log(x)| <= 16",		ERROR_RELATIVE, &referencePow, &samplePowNearLimit },
+		{ "pow", "|y * log(x)| <= 700",		ERROR_RELATIVE, &referencePow, &samplePowLargeResult }
+	};
+
+	double measureError(double value, double reference, ErrorKind kind)
+	{
+		double error = std::fabs(value - reference);
+
+		if (kind == ERROR_RELATIVE && std::fpclassify(reference) != FP_ZERO)
+			error /= std::fabs(reference);
+
+		return error;
+	}
+
+	/** \brief Calls a function the way an expression does, through the dispatch table of the given tier */
+	double callTier(const NativeFunction& impl, double x, double y, unsigned int arity, VariableContext& vc)
+	{
+		Value args[2] = { Value(x), Value(y) };
+		return impl.invoke(args, arity, vc).numeric;
+	}
+
+	/** \brief Reports the maximum error and the cost of each precision tier against libm
+	 *
+	 * \return	true if every PRECISION_FAST error is within its budget
+	 *
+	 */
+	bool reportPrecision()
+	{
+		FunctionContext fc;
+		VariableContext vc;
+		bool withinBudget = true;
+
+		cout << "Precision tiers against libm (" << PRECISION_SAMPLES << " samples per range)" << endl << endl;
+		cout << left << setw(6) << "func" << setw(32) << "range" << setw(10) << "error"
+				<< setw(14) << "FULL" << setw(14) << "FAST" << setw(12) << "FULL ns" << setw(12) << "FAST ns" << endl;
+
+		for (const PrecisionCase& c : precisionCases)
+		{
+			const Function* function = fc.lookupFunction(fc.getFunctionID(c.function));
+			unsigned int arity = function->arity();
+
+			mt19937_64 rng(0x5eed);
+			vector<double> xs(PRECISION_SAMPLES), ys(PRECISION_SAMPLES, 0.0), references(PRECISION_SAMPLES);
+
+			for (unsigned int i = 0; i < PRECISION_SAMPLES; i++)
+			{
+				c.sample(rng, xs[i], ys[i]);
+				references[i] = c.reference(xs[i], ys[i]);
+			}
+
+			double maxError[2] = { 0.0, 0.0 };
+			double nanoseconds[2];
+
+			for (unsigned int p = PRECISION_FULL; p <= PRECISION_FAST; p++)
+			{
+				const NativeFunction& impl = function->implementation(static_cast<Precision>(p));
+				double checksum = 0.0;
+
+				chrono::steady_clock::time_point start = chrono::steady_clock::now();
+				for (unsigned int i = 0; i < PRECISION_SAMPLES; i++)
+					checksum += callTier(impl, xs[i], ys[i], arity, vc);
+				chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+				nanoseconds[p] = chrono::duration<double, nano>(end - start).count() / PRECISION_SAMPLES;
+
+				for (unsigned int i = 0; i < PRECISION_SAMPLES; i++)
+				{
+					double error = measureError(callTier(impl, xs[i], ys[i], arity, vc), references[i], c.kind);
+					if (!(error <= maxError[p]))
+						maxError[p] = error;
+				}
+
+				//Keeps the timed loop from being optimized away
+				if (std::isnan(checksum))
+					cout << "";
+			}
+
+			if (!(maxError[PRECISION_FAST] <= PRECISION_FAST_BUDGET))
+				withinBudget = false;
+
+			cout << left << setw(6) << c.function << setw(32) << c.range << setw(10)
+					<< (c.kind == ERROR_RELATIVE ? "relative" : "absolute")
+					<< setw(14) << setprecision(3) << scientific << maxError[PRECISION_FULL]
+					<< setw(14) << maxError[PRECISION_FAST]
+					<< setw(12) << fixed << setprecision(2) << nanoseconds[PRECISION_FULL]
+					<< setw(12) << nanoseconds[PRECISION_FAST] << endl;
+		}
+
+		cout << endl << "PRECISION_FAST budget " << scientific << setprecision(1) << PRECISION_FAST_BUDGET << ": "
+				<< (withinBudget ? "met" : "EXCEEDED") << endl;
+
+		return withinBudget;
+	}
+
+	/** \brief Reports the cost of validate() against a throwing parse on a mixed valid/invalid corpus
+	 *
+	 * \return	true if validate() agreed with the parser on every expression and created no variables
+	 *
+	 */
+	bool reportValidation()
+	{
+		FunctionContext fc;
+		VariableContext vc;
+		vector<string> corpus;
+
+		for (unsigned int round = 0; round < VALIDATION_ROUNDS; round++)
+		{
+			for (const char* pattern : validationCorpus)
+			{
+				string expr(pattern), name = "v" + to_string(round);
+				for (size_t at = expr.find("{}"); at != string::npos; at = expr.find("{}", at))
+					expr.replace(at, 2, name);
+
+				corpus.push_back(expr);
+			}
+		}
+
+		unsigned int variablesBefore = vc.size();
+		unsigned int valid = 0;
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (const string& expr : corpus)
+			valid += ExpressionParser::validate(expr, vc, fc).succeeded() ? 1 : 0;
+		double validateNanoseconds = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+		bool createdNothing = vc.size() == variablesBefore;
+
+		//The parser being compared against creates variables, so it gets a context of its own
+		VariableContext parserContext;
+		unsigned int parsed = 0;
+
+		start = chrono::steady_clock::now();
+		for (const string& expr : corpus)
+		{
+			try
+			{
+				ExpressionParser parser(expr, parserContext, fc);
+				parsed++;
+			}
+			catch (TokenizerException&)
+			{ }
+		}
+		double parseNanoseconds = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+		bool agreed = true;
+		for (const string& expr : corpus)
+		{
+			ParseResult expected;
+			ExpressionParser parser(expr, parserContext, fc, expected);
+			ParseResult actual = ExpressionParser::validate(expr, vc, fc);
+
+			if (actual.code() != expected.code() || actual.column() != expected.column())
+				agreed = false;
+		}
+
+		cout << "Validation of " << corpus.size() << " expressions, " << valid << " well-formed" << endl << endl;
+		cout << left << setw(32) << "validate()" << fixed << setprecision(1) << validateNanoseconds / corpus.size() << " ns each" << endl;
+		cout << left << setw(32) << "throwing parse" << parseNanoseconds / corpus.size() << " ns each" << endl;
+		cout << endl << "Diagnostics match the parser: " << (agreed ? "yes" : "NO")
+				<< ", variables created by validate(): " << vc.size() - variablesBefore << endl;
+
+		return agreed && createdNothing && valid == parsed;
+	}
+}
+
+int main()
+{
+	bool passed = reportPrecision();
+
+	cout << endl;
+	passed = reportValidation() && passed;
+
+	return passed ? 0 : 1;
+}
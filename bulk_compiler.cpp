@@ -0,0 +1,93 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<atomic>
+#include	<thread>
+#include	<exception>
+#include	<mutex>
+
+#include	"bulk_compiler.h"
+
+#define		BULK_COMPILE_BATCH_SIZE		64
+
+namespace Exparse
+{
+	/** \brief Parses a list of expressions in parallel
+	 *
+	 * Workers claim batches of expressions from a shared counter, so uneven expression lengths
+	 * balance out across threads. New variable names are interned through the VariableContext's
+	 * sharded symbol table; nothing else may use the contexts until this function returns.
+	 *
+	 * \param expressions	The expression strings to compile
+	 * \param vc			The variable context that variable names are resolved in
+	 * \param fc			The function context that operators and functions are resolved in
+	 * \param threadCount	The number of threads to use, or 0 to use one per hardware thread
+	 * \return				One entry per input expression, in the same order
+	 *
+	 */
+	std::vector<CompiledExpression> compileAll(const std::vector<std::string>& expressions,
+			VariableContext& vc, const FunctionContext& fc, unsigned int threadCount)
+	{
+		std::vector<CompiledExpression> compiled(expressions.size());
+		std::atomic<std::size_t> nextBatch(0);
+		std::exception_ptr failure;
+		std::mutex failureMutex;
+
+		if (threadCount == 0)
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+		std::size_t batches = (expressions.size() + BULK_COMPILE_BATCH_SIZE - 1) / BULK_COMPILE_BATCH_SIZE;
+		threadCount = static_cast<unsigned int>(std::min<std::size_t>(threadCount, std::max<std::size_t>(batches, 1)));
+
+		auto worker = [&]()
+		{
+			try
+			{
+				std::size_t batch;
+
+				while ((batch = nextBatch.fetch_add(1, std::memory_order_relaxed)) < batches)
+				{
+					std::size_t first = batch * BULK_COMPILE_BATCH_SIZE;
+					std::size_t last = std::min(first + BULK_COMPILE_BATCH_SIZE, expressions.size());
+
+					for (std::size_t i = first; i < last; i++)
+					{
+						CompiledExpression& out = compiled[i];
+						out.expression.reset(new ExpressionParser(expressions[i], vc, fc, out.result));
+
+						if (out.result.failed())
+							out.expression.reset();
+					}
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(failureMutex);
+
+				if (!failure)
+					failure = std::current_exception();
+
+				//Stop the other workers from claiming more work
+				nextBatch.store(batches);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		threads.reserve(threadCount - 1);
+
+		for (unsigned int i = 1; i < threadCount; i++)
+			threads.push_back(std::thread(worker));
+
+		worker();
+
+		for (auto it = threads.begin(); it != threads.end(); ++it)
+			it->join();
+
+		if (failure)
+			std::rethrow_exception(failure);
+
+		return compiled;
+	}
+}
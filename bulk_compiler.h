@@ -0,0 +1,28 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef BULK_COMPILER_H
+#define BULK_COMPILER_H
+
+#include	<string>
+#include	<vector>
+#include	<memory>
+
+#include	"expression_parser.h"
+
+/** The outcome of compiling one expression of a bulk request */
+struct CompiledExpression
+{
+	std::unique_ptr<ExpressionParser> expression;	/**< The parsed expression, or null if parsing failed */
+	ParseResult result;								/**< The error code and column if parsing failed */
+};
+
+namespace Exparse
+{
+	std::vector<CompiledExpression> compileAll(const std::vector<std::string>& expressions,
+			VariableContext& vc, const FunctionContext& fc, unsigned int threadCount = 0);
+}
+
+#endif
@@ -0,0 +1,487 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<assert.h>
+#include	<algorithm>
+
+#include	"bytecode.h"
+
+namespace
+{
+	typedef enum Arithmetic
+	{
+		ARITHMETIC_NONE = 0,
+		ARITHMETIC_ADD,				/**< The default infix + */
+		ARITHMETIC_MULTIPLY			/**< The default infix * */
+	} Arithmetic;
+
+	struct Lowered
+	{
+		Bytecode::Instruction instruction;
+		Arithmetic arithmetic;
+	};
+
+	/** \brief Runs the code compiled from the body of an argument passed unevaluated */
+	class BytecodeSubexpression : public Subexpression
+	{
+		private:
+			Bytecode _code;
+
+		public:
+			BytecodeSubexpression(const std::vector<Token>& body, const FunctionContext& fc, Precision precision) :
+				_code(body, fc, precision)
+			{ }
+
+			double evaluate(VariableContext& vc) { return _code.run(vc); }
+	};
+
+	Arithmetic arithmeticOf(const FunctionContext& fc, unsigned int operatorId)
+	{
+		if (!fc.isBuiltinOperator(operatorId))
+			return ARITHMETIC_NONE;
+
+		const Operator* op = fc.lookupOperator(operatorId);
+
+		if (op->position() != Operator::POS_INFIX)
+			return ARITHMETIC_NONE;
+		else if (op->symbol() == "+")
+			return ARITHMETIC_ADD;
+		else if (op->symbol() == "*")
+			return ARITHMETIC_MULTIPLY;
+
+		return ARITHMETIC_NONE;
+	}
+
+	Lowered instruction(Bytecode::Opcode opcode)
+	{
+		Lowered l;
+		l.instruction.opcode = opcode;
+		l.instruction.count = 0;
+		l.instruction.variables[0] = l.instruction.variables[1] = l.instruction.variables[2] = 0;
+		l.instruction.constants[0] = l.instruction.constants[1] = 0.0;
+		l.instruction.unary = nullptr;
+		l.instruction.binary = nullptr;
+		l.arithmetic = ARITHMETIC_NONE;
+		return l;
+	}
+
+	Lowered call(const NativeFunction& function, unsigned int count, Arithmetic arithmetic)
+	{
+		Lowered l;
+
+		if (function.kind() == NativeFunction::CALL_UNARY && count == 1)
+		{
+			l = instruction(Bytecode::BC_UNARY);
+			l.instruction.unary = function.unaryTarget();
+		}
+		else if (function.kind() == NativeFunction::CALL_BINARY && count == 2)
+		{
+			l = instruction(Bytecode::BC_BINARY);
+			l.instruction.binary = function.binaryTarget();
+			l.arithmetic = arithmetic;
+		}
+		else
+		{
+			l = instruction(Bytecode::BC_CALL);
+			l.instruction.function = function;
+			l.instruction.count = count;
+		}
+
+		return l;
+	}
+
+	bool matches(const std::vector<Lowered>& code, unsigned int i, Bytecode::Opcode first, Bytecode::Opcode second)
+	{
+		return i + 1 < code.size() && code[i].instruction.opcode == first && code[i + 1].instruction.opcode == second;
+	}
+
+	bool matches(const std::vector<Lowered>& code, unsigned int i, Bytecode::Opcode first, Bytecode::Opcode second, Bytecode::Opcode third)
+	{
+		return i + 2 < code.size() && matches(code, i, first, second) && code[i + 2].instruction.opcode == third;
+	}
+
+	/** \brief Fuses variable and constant operands into the unary or binary call that consumes them */
+	std::vector<Lowered> fuseOperands(const std::vector<Lowered>& code)
+	{
+		std::vector<Lowered> fused;
+		fused.reserve(code.size());
+
+		for (unsigned int i = 0; i < code.size(); )
+		{
+			const Bytecode::Instruction& first = code[i].instruction;
+			Lowered l;
+
+			if (matches(code, i, Bytecode::BC_LOAD, Bytecode::BC_CONSTANT, Bytecode::BC_BINARY) ||
+					(matches(code, i, Bytecode::BC_CONSTANT, Bytecode::BC_LOAD, Bytecode::BC_BINARY) && code[i + 2].arithmetic != ARITHMETIC_NONE))
+			{
+				//The default + and * commute exactly, so a constant on the left is moved to the right
+				const Bytecode::Instruction& load = first.opcode == Bytecode::BC_LOAD ? first : code[i + 1].instruction;
+				const Bytecode::Instruction& constant = first.opcode == Bytecode::BC_LOAD ? code[i + 1].instruction : first;
+
+				l = code[i + 2];
+				l.instruction.opcode = Bytecode::BC_VARIABLE_CONSTANT;
+				l.instruction.variables[0] = load.variables[0];
+				l.instruction.constants[0] = constant.constants[0];
+				i += 3;
+			}
+			else if (matches(code, i, Bytecode::BC_CONSTANT, Bytecode::BC_LOAD, Bytecode::BC_BINARY))
+			{
+				l = code[i + 2];
+				l.instruction.opcode = Bytecode::BC_CONSTANT_VARIABLE;
+				l.instruction.constants[0] = first.constants[0];
+				l.instruction.variables[0] = code[i + 1].instruction.variables[0];
+				i += 3;
+			}
+			else if (matches(code, i, Bytecode::BC_LOAD, Bytecode::BC_LOAD, Bytecode::BC_BINARY))
+			{
+				l = code[i + 2];
+				l.instruction.opcode = Bytecode::BC_VARIABLE_VARIABLE;
+				l.instruction.variables[0] = first.variables[0];
+				l.instruction.variables[1] = code[i + 1].instruction.variables[0];
+				i += 3;
+			}
+			else if (matches(code, i, Bytecode::BC_LOAD, Bytecode::BC_BINARY))
+			{
+				l = code[i + 1];
+				l.instruction.opcode = Bytecode::BC_BINARY_VARIABLE;
+				l.instruction.variables[0] = first.variables[0];
+				i += 2;
+			}
+			else if (matches(code, i, Bytecode::BC_CONSTANT, Bytecode::BC_BINARY))
+			{
+				l = code[i + 1];
+				l.instruction.opcode = Bytecode::BC_BINARY_CONSTANT;
+				l.instruction.constants[0] = first.constants[0];
+				i += 2;
+			}
+			else if (matches(code, i, Bytecode::BC_LOAD, Bytecode::BC_UNARY))
+			{
+				l = code[i + 1];
+				l.instruction.opcode = Bytecode::BC_LOAD_UNARY;
+				l.instruction.variables[0] = first.variables[0];
+				i += 2;
+			}
+			else
+				l = code[i++];
+
+			fused.push_back(l);
+		}
+
+		return fused;
+	}
+
+	/** \brief Fuses a default * whose product feeds straight into a default + into one multiply-add */
+	std::vector<Lowered> fuseMultiplyAdds(const std::vector<Lowered>& code)
+	{
+		std::vector<Lowered> fused;
+		fused.reserve(code.size());
+
+		for (unsigned int i = 0; i < code.size(); )
+		{
+			if (i + 1 < code.size() && code[i].arithmetic == ARITHMETIC_MULTIPLY && code[i + 1].arithmetic == ARITHMETIC_ADD)
+			{
+				Bytecode::Instruction product = code[i].instruction;
+				const Bytecode::Instruction& sum = code[i + 1].instruction;
+				Bytecode::Opcode opcode = product.opcode;
+
+				switch (product.opcode)
+				{
+					case Bytecode::BC_BINARY:
+						if (sum.opcode == Bytecode::BC_BINARY)
+							opcode = Bytecode::BC_MULTIPLY_ADD;
+						else if (sum.opcode == Bytecode::BC_BINARY_VARIABLE)
+						{
+							opcode = Bytecode::BC_MULTIPLY_ADD_VARIABLE;
+							product.variables[0] = sum.variables[0];
+						}
+						else if (sum.opcode == Bytecode::BC_BINARY_CONSTANT)
+						{
+							opcode = Bytecode::BC_MULTIPLY_ADD_CONSTANT;
+							product.constants[0] = sum.constants[0];
+						}
+						break;
+
+					case Bytecode::BC_VARIABLE_VARIABLE:
+						if (sum.opcode == Bytecode::BC_BINARY)
+							opcode = Bytecode::BC_ACCUMULATE_VARIABLES;
+						else if (sum.opcode == Bytecode::BC_BINARY_VARIABLE)
+						{
+							opcode = Bytecode::BC_VARIABLES_MULTIPLY_ADD;
+							product.variables[2] = sum.variables[0];
+						}
+						break;
+
+					case Bytecode::BC_VARIABLE_CONSTANT:
+						if (sum.opcode == Bytecode::BC_BINARY)
+							opcode = Bytecode::BC_ACCUMULATE_VARIABLE_CONSTANT;
+						else if (sum.opcode == Bytecode::BC_BINARY_CONSTANT)
+						{
+							opcode = Bytecode::BC_VARIABLE_MULTIPLY_ADD;
+							product.constants[1] = sum.constants[0];
+						}
+						break;
+
+					default: break;
+				}
+
+				if (opcode != product.opcode)
+				{
+					Lowered l = code[i];
+					l.instruction = product;
+					l.instruction.opcode = opcode;
+					l.instruction.binary = nullptr;
+					l.arithmetic = ARITHMETIC_NONE;
+					fused.push_back(l);
+					i += 2;
+					continue;
+				}
+			}
+
+			fused.push_back(code[i++]);
+		}
+
+		return fused;
+	}
+}
+
+/** \brief Compiles a postfix string
+ *
+ * \param postfix		Tokens in evaluation order, as built by ExpressionParser
+ * \param fc			The function context the operator and function IDs belong to
+ * \param precision		The precision tier whose implementations are called
+ *
+ */
+Bytecode::Bytecode(const std::vector<Token>& postfix, const FunctionContext& fc, Precision precision) :
+	_stackDepth(0)
+{
+	const NativeFunction* operatorTable = fc.operatorTable(precision);
+	const NativeFunction* functionTable = fc.functionTable(precision);
+	unsigned int derefFunctionId = fc.getFunctionID("_deref");
+	std::vector<Lowered> code;
+	int depth = 0;		//Signed, so that a malformed postfix string can't wrap it around
+
+	code.reserve(postfix.size());
+
+	for (unsigned int i = 0; i < postfix.size(); i++)
+	{
+		const Token& t = postfix[i];
+		Lowered l;
+
+		switch (t.type())
+		{
+			case Token::NUMBER:
+				l = instruction(BC_CONSTANT);
+				l.instruction.constants[0] = t.toNumber().value();
+				depth++;
+				break;
+
+			case Token::VARIABLE:
+				if (i + 1 < postfix.size() && postfix[i + 1].type() == Token::FUNCTION && postfix[i + 1].toFunction().id() == derefFunctionId)
+				{
+					l = instruction(BC_LOAD);
+					l.instruction.variables[0] = t.toVariable().id() - 1;
+					i++;
+				}
+				else
+				{
+					l = instruction(BC_REFERENCE);
+					l.instruction.variables[0] = t.toVariable().id();
+				}
+
+				depth++;
+				break;
+
+			case Token::OPERATOR:
+			{
+				unsigned int id = t.toOperator().id();
+				const NativeFunction& function = operatorTable[id - 1];
+
+				l = call(function, function.arity(), arithmeticOf(fc, id));
+				assert(depth >= static_cast<int>(function.arity()));
+				depth += 1 - static_cast<int>(function.arity());
+				break;
+			}
+
+			case Token::FUNCTION:
+				if (t.toFunction().id() == derefFunctionId)
+					l = instruction(BC_DEREFERENCE);
+				else
+				{
+					l = call(functionTable[t.toFunction().id() - 1], t.toFunction().arity(), ARITHMETIC_NONE);
+					assert(depth >= static_cast<int>(t.toFunction().arity()));
+					depth += 1 - static_cast<int>(t.toFunction().arity());
+				}
+
+				break;
+
+			case Token::EXPRESSION:
+			{
+				std::vector<Token> body(postfix.begin() + i + 1, postfix.begin() + i + 1 + t.toExpression().length());
+
+				l = instruction(BC_EXPRESSION);
+				l.instruction.variables[0] = _expressions.size();
+				_expressions.push_back(std::make_shared<BytecodeSubexpression>(body, fc, precision));
+				i += t.toExpression().length();
+				depth++;
+				break;
+			}
+
+			case Token::DELIMITER:
+				l = instruction(BC_DISCARD);
+
+				if (depth > 0)
+					depth--;
+
+				break;
+
+			default: assert(false);
+		}
+
+		if (depth > static_cast<int>(_stackDepth))
+			_stackDepth = depth;
+
+		code.push_back(l);
+	}
+
+	code = fuseMultiplyAdds(fuseOperands(code));
+
+	_code.reserve(code.size());
+
+	for (unsigned int i = 0; i < code.size(); i++)
+		_code.push_back(code[i].instruction);
+}
+
+/** \brief Evaluates the code
+ *
+ * \param vc	The variable context the variable IDs belong to
+ * \return		The value of the last statement, or 0 if there is none
+ *
+ */
+double Bytecode::run(VariableContext& vc) const
+{
+	if (_stackDepth <= BYTECODE_LOCAL_STACK)
+	{
+		Value stack[BYTECODE_LOCAL_STACK];
+		return execute(stack, vc);
+	}
+
+	std::vector<Value> stack(_stackDepth);
+	return execute(stack.data(), vc);
+}
+
+double Bytecode::execute(Value* stack, VariableContext& vc) const
+{
+	double* const* slots = vc.slots();
+	Value* top = stack;		//One past the top of the stack
+
+	for (const Instruction* ins = _code.data(), * end = ins + _code.size(); ins != end; ++ins)
+	{
+		switch (ins->opcode)
+		{
+			case BC_CONSTANT:
+				(top++)->numeric = ins->constants[0];
+				break;
+
+			case BC_LOAD:
+				(top++)->numeric = *slots[ins->variables[0]];
+				break;
+
+			case BC_REFERENCE:
+				(top++)->variableId = ins->variables[0];
+				break;
+
+			case BC_EXPRESSION:
+				(top++)->expression = _expressions[ins->variables[0]].get();
+				break;
+
+			case BC_DEREFERENCE:
+				top[-1].numeric = *slots[top[-1].variableId - 1];
+				break;
+
+			case BC_UNARY:
+				top[-1].numeric = ins->unary(top[-1].numeric);
+				break;
+
+			case BC_BINARY:
+				top--;
+				top[-1].numeric = ins->binary(top[-1].numeric, top[0].numeric);
+				break;
+
+			case BC_CALL:
+				top -= ins->count;
+				*top = ins->function.invoke(top, ins->count, vc);
+				top++;
+				break;
+
+			case BC_DISCARD:
+				if (top != stack)
+					top--;
+
+				assert(top == stack);
+				break;
+
+			case BC_LOAD_UNARY:
+				(top++)->numeric = ins->unary(*slots[ins->variables[0]]);
+				break;
+
+			case BC_BINARY_VARIABLE:
+				top[-1].numeric = ins->binary(top[-1].numeric, *slots[ins->variables[0]]);
+				break;
+
+			case BC_BINARY_CONSTANT:
+				top[-1].numeric = ins->binary(top[-1].numeric, ins->constants[0]);
+				break;
+
+			case BC_VARIABLE_VARIABLE:
+				(top++)->numeric = ins->binary(*slots[ins->variables[0]], *slots[ins->variables[1]]);
+				break;
+
+			case BC_VARIABLE_CONSTANT:
+				(top++)->numeric = ins->binary(*slots[ins->variables[0]], ins->constants[0]);
+				break;
+
+			case BC_CONSTANT_VARIABLE:
+				(top++)->numeric = ins->binary(ins->constants[0], *slots[ins->variables[0]]);
+				break;
+
+			case BC_MULTIPLY_ADD:
+				top -= 2;
+				top[-1].numeric = Exparse::multiplyAdd(top[0].numeric, top[1].numeric, top[-1].numeric);
+				break;
+
+			case BC_MULTIPLY_ADD_VARIABLE:
+				top--;
+				top[-1].numeric = Exparse::multiplyAdd(top[-1].numeric, top[0].numeric, *slots[ins->variables[0]]);
+				break;
+
+			case BC_MULTIPLY_ADD_CONSTANT:
+				top--;
+				top[-1].numeric = Exparse::multiplyAdd(top[-1].numeric, top[0].numeric, ins->constants[0]);
+				break;
+
+			case BC_ACCUMULATE_VARIABLES:
+				top[-1].numeric = Exparse::multiplyAdd(*slots[ins->variables[0]], *slots[ins->variables[1]], top[-1].numeric);
+				break;
+
+			case BC_ACCUMULATE_VARIABLE_CONSTANT:
+				top[-1].numeric = Exparse::multiplyAdd(*slots[ins->variables[0]], ins->constants[0], top[-1].numeric);
+				break;
+
+			case BC_VARIABLES_MULTIPLY_ADD:
+				(top++)->numeric = Exparse::multiplyAdd(*slots[ins->variables[0]], *slots[ins->variables[1]], *slots[ins->variables[2]]);
+				break;
+
+			case BC_VARIABLE_MULTIPLY_ADD:
+				(top++)->numeric = Exparse::multiplyAdd(*slots[ins->variables[0]], ins->constants[0], ins->constants[1]);
+				break;
+		}
+	}
+
+	if (top == stack)
+		return 0.0;
+
+	assert(top == stack + 1);
+	return top[-1].numeric;
+}
@@ -0,0 +1,99 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include	<vector>
+#include	<memory>
+
+#include	"context.h"
+#include	"token.h"
+
+#define		BYTECODE_LOCAL_STACK	64		/**< Evaluation stacks up to this deep live on the native stack */
+
+/** The stack code ExpressionParser::evaluate() runs, compiled from a postfix string.
+ *
+ *  Every token of the postfix string maps to one instruction, except that the most frequent
+ *  sequences are fused into superinstructions so that each costs a single dispatch. The patterns
+ *  come from counting adjacent instruction pairs over a corpus of typical expressions:
+ *
+ *		variable, _deref					BC_LOAD
+ *		variable/constant operands of a unary or binary call	BC_LOAD_UNARY, BC_BINARY_VARIABLE, BC_BINARY_CONSTANT,
+ *											BC_VARIABLE_VARIABLE, BC_VARIABLE_CONSTANT, BC_CONSTANT_VARIABLE
+ *		default * feeding default +			the BC_MULTIPLY_ADD family, rounded once where the target has FMA
+ *
+ *  Comparisons are ordinary binary operators, so a comparison against a variable or constant is
+ *  fused like any other. Unary and binary calls go straight through their function pointers.
+ *  The body of an argument passed unevaluated is compiled into its own Bytecode, which the
+ *  callee runs without going back to the tokens.
+ */
+class Bytecode
+{
+	public:
+		typedef enum Opcode
+		{
+			BC_CONSTANT,					/**< push constants[0] */
+			BC_LOAD,						/**< push variable 0 */
+			BC_REFERENCE,					/**< push the ID of variable 0, for parameters taking a variable */
+			BC_EXPRESSION,					/**< push sub-expression variables[0], for parameters taking one unevaluated */
+			BC_DEREFERENCE,					/**< top = value of the variable whose ID is on top */
+			BC_UNARY,						/**< top = unary(top) */
+			BC_BINARY,						/**< pop b; top = binary(top, b) */
+			BC_CALL,						/**< pop count arguments; push function(arguments) */
+			BC_DISCARD,						/**< pop the result of a statement */
+			BC_LOAD_UNARY,					/**< push unary(variable 0) */
+			BC_BINARY_VARIABLE,				/**< top = binary(top, variable 0) */
+			BC_BINARY_CONSTANT,				/**< top = binary(top, constants[0]) */
+			BC_VARIABLE_VARIABLE,			/**< push binary(variable 0, variable 1) */
+			BC_VARIABLE_CONSTANT,			/**< push binary(variable 0, constants[0]) */
+			BC_CONSTANT_VARIABLE,			/**< push binary(constants[0], variable 0) */
+			BC_MULTIPLY_ADD,				/**< pop b, a; top = a * b + top */
+			BC_MULTIPLY_ADD_VARIABLE,		/**< pop b; top = top * b + variable 0 */
+			BC_MULTIPLY_ADD_CONSTANT,		/**< pop b; top = top * b + constants[0] */
+			BC_ACCUMULATE_VARIABLES,		/**< top = variable 0 * variable 1 + top */
+			BC_ACCUMULATE_VARIABLE_CONSTANT,	/**< top = variable 0 * constants[0] + top */
+			BC_VARIABLES_MULTIPLY_ADD,		/**< push variable 0 * variable 1 + variable 2 */
+			BC_VARIABLE_MULTIPLY_ADD		/**< push variable 0 * constants[0] + constants[1] */
+		} Opcode;
+
+		struct Instruction
+		{
+			Opcode opcode;
+			unsigned int count;				/**< Number of arguments of BC_CALL */
+			unsigned int variables[3];		/**< Slot indexes (ID - 1), or the ID itself for BC_REFERENCE */
+			double constants[2];
+			UnaryFunctionPointer unary;
+			BinaryFunctionPointer binary;
+			NativeFunction function;		/**< The callee of BC_CALL */
+		};
+
+	private:
+		std::vector<Instruction> _code;
+		std::vector<std::shared_ptr<Subexpression> > _expressions;		/**< Bodies of unevaluated arguments, compiled separately */
+		unsigned int _stackDepth;
+
+	public:
+		Bytecode() :
+			_stackDepth(0)
+		{ }
+
+		Bytecode(const std::vector<Token>& postfix, const FunctionContext& fc, Precision precision);
+
+		double run(VariableContext& vc) const;
+
+		const std::vector<Instruction>& code() const { return _code; }
+
+		/** \brief Returns the number of instructions dispatched per evaluation */
+		unsigned int size() const { return _code.size(); }
+
+		/** \brief Returns the deepest the evaluation stack gets */
+		unsigned int stackDepth() const { return _stackDepth; }
+
+	private:
+		double execute(Value* stack, VariableContext& vc) const;
+};
+
+#endif
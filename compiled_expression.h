@@ -0,0 +1,732 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef COMPILED_EXPRESSION_H
+#define COMPILED_EXPRESSION_H
+
+#include	<cstddef>
+#include	<string>
+
+#include	"function.h"
+#include	"default_operations.h"
+
+#define	COMPILED_MAX_DECIMAL_EXPONENT	308		/**< The largest power of ten that is a finite double */
+
+/** \brief Parses an expression at compile time, e.g. EXPARSE("x*x + 2*y")(3.0, 4.0)
+ *
+ * Evaluates to an Exparse::compiled::Expression whose call operator takes one double per
+ * variable, in order of first appearance. A malformed expression is a compile error.
+ *
+ */
+#define EXPARSE(literal) \
+	([]() \
+	{ \
+		struct Source { static constexpr const char* text() { return literal; } }; \
+		return Exparse::compiled::Expression<Source>(); \
+	}())
+
+namespace Exparse
+{
+	/** Compile-time parsing of fixed expressions.
+	 *
+	 *  The parser runs in constexpr functions over the string and produces a flat syntax tree; the
+	 *  Term templates turn that tree into a type whose evaluate() is plain nested calls to the
+	 *  inline DefaultOperator and DefaultFunction implementations, which the optimizer reduces to the
+	 *  same code as hand-written arithmetic. Precedence and associativity come from Operator's
+	 *  precedence levels, so results match ExpressionParser with a default FunctionContext, except
+	 *  that numbers with many significant digits or extreme exponents may be rounded differently
+	 *  (see Parser::parseNumber).
+	 *
+	 *  Supported are numbers, variables, the constants pi, e and phi, the default infix and prefix
+	 *  operators except assignments and increments, and the default functions.
+	 */
+	namespace compiled
+	{
+		typedef double (*UnaryOperation)(double);
+		typedef double (*BinaryOperation)(double, double);
+
+		typedef enum NodeKind
+		{
+			NODE_CONSTANT,
+			NODE_VARIABLE,
+			NODE_UNARY,
+			NODE_BINARY,
+			NODE_SELECT			/**< if(condition, left, right) */
+		} NodeKind;
+
+		typedef enum ParseError
+		{
+			ERROR_NONE = 0,
+			ERROR_UNEXPECTED_TOKEN,
+			ERROR_UNEXPECTED_END,
+			ERROR_UNMATCHED_PARENTHESIS,
+			ERROR_MALFORMED_NUMBER,
+			ERROR_UNKNOWN_FUNCTION,
+			ERROR_INVALID_NUM_ARGUMENTS,
+			ERROR_UNSUPPORTED_OPERATOR
+		} ParseError;
+
+		struct OperatorSpec
+		{
+			const char* symbol;
+			unsigned int precedence;
+			Operator::Associativity associativity;
+			UnaryOperation unary;		/**< Prefix operators */
+			BinaryOperation binary;		/**< Infix operators */
+		};
+
+		struct FunctionSpec
+		{
+			const char* name;
+			unsigned int arity;
+			UnaryOperation unary;
+			BinaryOperation binary;
+		};
+
+		struct ConstantSpec
+		{
+			const char* name;
+			double value;
+		};
+
+		//Longest symbols first, so that "<=" is not read as "<". Operators without an implementation
+		//assign to variables and are rejected.
+		constexpr OperatorSpec infixOperators[] =
+		{
+			{ "++", Operator::PREC_POSTFIX, Operator::ASSOC_LEFT, nullptr, nullptr },
+			{ "--", Operator::PREC_POSTFIX, Operator::ASSOC_LEFT, nullptr, nullptr },
+			{ "+=", Operator::PREC_ASSIGNMENT, Operator::ASSOC_RIGHT, nullptr, nullptr },
+			{ "-=", Operator::PREC_ASSIGNMENT, Operator::ASSOC_RIGHT, nullptr, nullptr },
+			{ "*=", Operator::PREC_ASSIGNMENT, Operator::ASSOC_RIGHT, nullptr, nullptr },
+			{ "/=", Operator::PREC_ASSIGNMENT, Operator::ASSOC_RIGHT, nullptr, nullptr },
+			{ "%=", Operator::PREC_ASSIGNMENT, Operator::ASSOC_RIGHT, nullptr, nullptr },
+			{ "==", Operator::PREC_EQUALITY, Operator::ASSOC_LEFT, nullptr, &DefaultOperator::isEqual },
+			{ "!=", Operator::PREC_EQUALITY, Operator::ASSOC_LEFT, nullptr, &DefaultOperator::isNotEqual },
+			{ "<=", Operator::PREC_RELATIONAL, Operator::ASSOC_LEFT, nullptr, &DefaultOperator::isLessOrEqual },
+			{ ">=", Operator::PREC_RELATIONAL, Operator::ASSOC_LEFT, nullptr, &DefaultOperator::isGreaterOrEqual },
+			{ "&&", Operator::PREC_AND, Operator::ASSOC_LEFT, nullptr, &DefaultOperator::booleanAnd },
+			{ "||", Operator::PREC_OR, Operator::ASSOC_LEFT, nullptr, &DefaultOperator::booleanOr },
+			{ "=", Operator::PREC_ASSIGNMENT, Operator::ASSOC_RIGHT, nullptr, nullptr },
+			{ "+", Operator::PREC_ADDITIVE, Operator::ASSOC_LEFT, nullptr, &DefaultOperator::addition },
+			{ "-", Operator::PREC_ADDITIVE, Operator::ASSOC_LEFT, nullptr, &DefaultOperator::subtraction },
+			{ "*", Operator::PREC_MULTIPLICATIVE, Operator::ASSOC_LEFT, nullptr, &DefaultOperator::multiplication },
+			{ "/", Operator::PREC_MULTIPLICATIVE, Operator::ASSOC_LEFT, nullptr, &DefaultOperator::division },
+			{ "%", Operator::PREC_MULTIPLICATIVE, Operator::ASSOC_LEFT, nullptr, &DefaultOperator::modulo },
+			{ "^", Operator::PREC_EXPONENT, Operator::ASSOC_RIGHT, nullptr, &DefaultOperator::exponentiation },
+			{ "<", Operator::PREC_RELATIONAL, Operator::ASSOC_LEFT, nullptr, &DefaultOperator::isLessThan },
+			{ ">", Operator::PREC_RELATIONAL, Operator::ASSOC_LEFT, nullptr, &DefaultOperator::isGreaterThan }
+		};
+
+		constexpr OperatorSpec prefixOperators[] =
+		{
+			{ "++", Operator::PREC_PREFIX, Operator::ASSOC_RIGHT, nullptr, nullptr },
+			{ "--", Operator::PREC_PREFIX, Operator::ASSOC_RIGHT, nullptr, nullptr },
+			{ "+", Operator::PREC_PREFIX, Operator::ASSOC_RIGHT, &DefaultOperator::plus, nullptr },
+			{ "-", Operator::PREC_PREFIX, Operator::ASSOC_RIGHT, &DefaultOperator::minus, nullptr },
+			{ "!", Operator::PREC_PREFIX, Operator::ASSOC_RIGHT, &DefaultOperator::booleanNot, nullptr }
+		};
+
+		constexpr FunctionSpec functions[] =
+		{
+			{ "cos", 1, &DefaultFunction::cos, nullptr },
+			{ "sin", 1, &DefaultFunction::sin, nullptr },
+			{ "tan", 1, &DefaultFunction::tan, nullptr },
+			{ "acos", 1, &DefaultFunction::acos, nullptr },
+			{ "asin", 1, &DefaultFunction::asin, nullptr },
+			{ "atan", 1, &DefaultFunction::atan, nullptr },
+			{ "atan2", 2, nullptr, &DefaultFunction::atan2 },
+			{ "cosh", 1, &DefaultFunction::cosh, nullptr },
+			{ "sinh", 1, &DefaultFunction::sinh, nullptr },
+			{ "tanh", 1, &DefaultFunction::tanh, nullptr },
+			{ "exp", 1, &DefaultFunction::exp, nullptr },
+			{ "log", 1, &DefaultFunction::log, nullptr },
+			{ "log10", 1, &DefaultFunction::log10, nullptr },
+			{ "pow", 2, nullptr, &DefaultFunction::pow },
+			{ "sqrt", 1, &DefaultFunction::sqrt, nullptr },
+			{ "ceil", 1, &DefaultFunction::ceil, nullptr },
+			{ "abs", 1, &DefaultFunction::abs, nullptr },
+			{ "floor", 1, &DefaultFunction::floor, nullptr },
+			{ "mod", 2, nullptr, &DefaultFunction::mod },
+			{ "if", 3, nullptr, nullptr }
+		};
+
+		//The same values VariableContext computes for its constants
+		constexpr ConstantSpec constants[] =
+		{
+			{ "pi", 3.14159265358979323846264338327950288 },
+			{ "e", 2.71828182845904523536028747135266250 },
+			{ "phi", 0.5 + 2.23606797749978969640917366873127624 * 0.5 }
+		};
+
+		constexpr double powersOfTen[] = { 1e1, 1e2, 1e4, 1e8, 1e16, 1e32, 1e64, 1e128, 1e256 };	/**< 10^(2^i) */
+
+		struct Node
+		{
+			NodeKind kind = NODE_CONSTANT;
+			double value = 0.0;
+			unsigned int variable = 0;
+			UnaryOperation unary = nullptr;
+			BinaryOperation binary = nullptr;
+			unsigned int left = 0;
+			unsigned int right = 0;
+			unsigned int condition = 0;
+		};
+
+		struct Name
+		{
+			unsigned int begin = 0;
+			unsigned int length = 0;
+		};
+
+		/** The syntax tree of an expression; every node consumes at least one character, so
+		 *  Capacity = length + 1 always suffices. */
+		template <std::size_t Capacity>
+		struct Ast
+		{
+			Node nodes[Capacity] {};
+			Name variables[Capacity] {};
+			unsigned int nodeCount = 0;
+			unsigned int variableCount = 0;
+			unsigned int root = 0;
+			ParseError error = ERROR_NONE;
+			unsigned int errorColumn = 0;
+		};
+
+		constexpr std::size_t length(const char* str)
+		{
+			std::size_t n = 0;
+
+			while (str[n] != '\0')
+				n++;
+
+			return n;
+		}
+
+		/** Precedence climbing over the default operators, evaluated by the compiler */
+		template <std::size_t Capacity>
+		class Parser
+		{
+			private:
+				static constexpr unsigned int PREC_LOWEST = ~0u;
+
+				const char* _text;
+				unsigned int _pos;
+				Ast<Capacity> _ast;
+
+				static constexpr bool isWhitespace(char c)
+				{
+					return c == ' ' || c == '\t' || c == '\f' || c == '\r' || c == '\n';
+				}
+
+				static constexpr bool isDigit(char c)
+				{
+					return c >= '0' && c <= '9';
+				}
+
+				static constexpr bool isIdentifierChar(char c)
+				{
+					return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+				}
+
+				constexpr bool nameEquals(unsigned int begin, unsigned int count, const char* name) const
+				{
+					for (unsigned int i = 0; i < count; i++)
+						if (name[i] != _text[begin + i])
+							return false;
+
+					return name[count] == '\0';
+				}
+
+				constexpr void skipWhitespace()
+				{
+					while (isWhitespace(_text[_pos]))
+						_pos++;
+				}
+
+				constexpr unsigned int fail(ParseError error, unsigned int column)
+				{
+					if (_ast.error == ERROR_NONE)
+					{
+						_ast.error = error;
+						_ast.errorColumn = column;
+					}
+
+					return 0;
+				}
+
+				constexpr unsigned int fail(ParseError error)
+				{
+					return fail(error, _pos);
+				}
+
+				constexpr unsigned int addNode(NodeKind kind, UnaryOperation unary, BinaryOperation binary, unsigned int left, unsigned int right)
+				{
+					Node& n = _ast.nodes[_ast.nodeCount];
+
+					n.kind = kind;
+					n.unary = unary;
+					n.binary = binary;
+					n.left = left;
+					n.right = right;
+
+					return _ast.nodeCount++;
+				}
+
+				constexpr unsigned int addConstant(double value)
+				{
+					unsigned int index = addNode(NODE_CONSTANT, nullptr, nullptr, 0, 0);
+
+					_ast.nodes[index].value = value;
+					return index;
+				}
+
+				template <std::size_t N>
+				constexpr const OperatorSpec* matchOperator(const OperatorSpec (&table)[N]) const
+				{
+					for (std::size_t i = 0; i < N; i++)
+					{
+						const char* symbol = table[i].symbol;
+						unsigned int j = 0;
+
+						while (symbol[j] != '\0' && symbol[j] == _text[_pos + j])
+							j++;
+
+						if (symbol[j] == '\0')
+							return &table[i];
+					}
+
+					return nullptr;
+				}
+
+				constexpr unsigned int parseBinary(unsigned int limit, bool inclusive)
+				{
+					unsigned int left = parseUnary();
+
+					while (_ast.error == ERROR_NONE)
+					{
+						skipWhitespace();
+
+						const OperatorSpec* op = matchOperator(infixOperators);
+
+						if (op == nullptr || op->precedence > limit || (op->precedence == limit && !inclusive))
+							break;
+
+						if (op->binary == nullptr)
+							return fail(ERROR_UNSUPPORTED_OPERATOR);
+
+						_pos += length(op->symbol);
+
+						unsigned int right = parseBinary(op->precedence, op->associativity == Operator::ASSOC_RIGHT);
+						left = addNode(NODE_BINARY, nullptr, op->binary, left, right);
+					}
+
+					return left;
+				}
+
+				constexpr unsigned int parseUnary()
+				{
+					skipWhitespace();
+
+					const OperatorSpec* op = matchOperator(prefixOperators);
+
+					if (op == nullptr)
+						return parsePrimary();
+
+					if (op->unary == nullptr)
+						return fail(ERROR_UNSUPPORTED_OPERATOR);
+
+					_pos += length(op->symbol);
+
+					unsigned int operand = parseBinary(op->precedence, false);
+					return addNode(NODE_UNARY, op->unary, nullptr, operand, 0);
+				}
+
+				constexpr unsigned int parsePrimary()
+				{
+					char c = _text[_pos];
+
+					if (c == '\0')
+						return fail(ERROR_UNEXPECTED_END);
+
+					if (c == '(')
+					{
+						_pos++;
+
+						unsigned int inner = parseBinary(PREC_LOWEST, false);
+
+						if (_ast.error != ERROR_NONE)
+							return 0;
+
+						skipWhitespace();
+
+						if (_text[_pos] != ')')
+							return fail(_text[_pos] == '\0' ? ERROR_UNMATCHED_PARENTHESIS : ERROR_UNEXPECTED_TOKEN);
+
+						_pos++;
+						return inner;
+					}
+
+					if (isDigit(c) || c == '.')
+						return parseNumber();
+
+					if (isIdentifierChar(c))
+						return parseIdentifier();
+
+					return fail(ERROR_UNEXPECTED_TOKEN);
+				}
+
+				/** \brief Reads a number with the tokenizer's syntax
+				 *
+				 * Up to 19 significant digits are accumulated exactly and scaled by a power of ten,
+				 * which rounds correctly (like strtod) whenever the digits fit in 53 bits and the
+				 * exponent is at most 22, i.e. for all ordinary literals. Other literals, such as ones
+				 * with more than 16 significant digits or near the ends of the double range, may be off
+				 * by a few units in the last place. Literals too large for a double do not compile.
+				 *
+				 */
+				constexpr unsigned int parseNumber()
+				{
+					unsigned int begin = _pos;
+					unsigned long long mantissa = 0;
+					unsigned int digits = 0;
+					int exponent = 0;
+					bool any = false;
+					bool fraction = false;
+
+					while (isDigit(_text[_pos]) || (!fraction && _text[_pos] == '.'))
+					{
+						char c = _text[_pos++];
+
+						if (c == '.')
+						{
+							fraction = true;
+							continue;
+						}
+
+						any = true;
+
+						if (digits < 19)
+						{
+							mantissa = mantissa * 10 + (c - '0');
+
+							if (fraction)
+								exponent--;
+
+							if (mantissa != 0)
+								digits++;
+						}
+						else if (!fraction)
+							exponent++;
+					}
+
+					if (!any)
+						return fail(ERROR_MALFORMED_NUMBER, begin);
+
+					if (_text[_pos] == 'e' || _text[_pos] == 'E')
+					{
+						int sign = 1;
+						int value = 0;
+
+						_pos++;
+
+						if (_text[_pos] == '+' || _text[_pos] == '-')
+							sign = _text[_pos++] == '-' ? -1 : 1;
+
+						if (!isDigit(_text[_pos]))
+							return fail(ERROR_MALFORMED_NUMBER, begin);
+
+						while (isDigit(_text[_pos]))
+							value = value * 10 + (_text[_pos++] - '0');
+
+						exponent += sign * value;
+					}
+
+					double result = static_cast<double>(mantissa);
+					unsigned int magnitude = exponent < 0 ? -exponent : exponent;
+
+					//10^magnitude is out of range beyond 10^308 although the result may not be, e.g. for
+					//subnormals, so the scale is applied in two steps
+					if (magnitude > 2 * COMPILED_MAX_DECIMAL_EXPONENT && exponent < 0)
+						return addConstant(0.0);
+
+					if (magnitude > COMPILED_MAX_DECIMAL_EXPONENT)
+					{
+						double scale = powerOfTen(magnitude - COMPILED_MAX_DECIMAL_EXPONENT);
+						result = exponent < 0 ? result / scale : result * scale;
+						magnitude = COMPILED_MAX_DECIMAL_EXPONENT;
+					}
+
+					double scale = powerOfTen(magnitude);
+					return addConstant(exponent < 0 ? result / scale : result * scale);
+				}
+
+				/** \brief Binary powering over correctly rounded powers of ten; exact up to 10^22 */
+				static constexpr double powerOfTen(unsigned int magnitude)
+				{
+					double scale = 1.0;
+
+					for (unsigned int bit = 0; magnitude != 0; bit++, magnitude >>= 1)
+						if (magnitude & 1)
+							scale *= powersOfTen[bit];
+
+					return scale;
+				}
+
+				constexpr unsigned int parseIdentifier()
+				{
+					unsigned int begin = _pos;
+
+					while (isIdentifierChar(_text[_pos]) || isDigit(_text[_pos]))
+						_pos++;
+
+					unsigned int count = _pos - begin;
+					unsigned int next = _pos;
+
+					while (isWhitespace(_text[next]))
+						next++;
+
+					if (_text[next] == '(')
+						return parseCall(begin, count, next + 1);
+
+					for (const ConstantSpec& constant : constants)
+						if (nameEquals(begin, count, constant.name))
+							return addConstant(constant.value);
+
+					unsigned int variable = 0;
+
+					while (variable < _ast.variableCount && !sameName(_ast.variables[variable], begin, count))
+						variable++;
+
+					if (variable == _ast.variableCount)
+					{
+						_ast.variables[variable].begin = begin;
+						_ast.variables[variable].length = count;
+						_ast.variableCount++;
+					}
+
+					unsigned int index = addNode(NODE_VARIABLE, nullptr, nullptr, 0, 0);
+					_ast.nodes[index].variable = variable;
+					return index;
+				}
+
+				constexpr bool sameName(const Name& name, unsigned int begin, unsigned int count) const
+				{
+					if (name.length != count)
+						return false;
+
+					for (unsigned int i = 0; i < count; i++)
+						if (_text[name.begin + i] != _text[begin + i])
+							return false;
+
+					return true;
+				}
+
+				constexpr unsigned int parseCall(unsigned int begin, unsigned int count, unsigned int argumentsBegin)
+				{
+					const FunctionSpec* func = nullptr;
+
+					for (const FunctionSpec& f : functions)
+						if (nameEquals(begin, count, f.name))
+							func = &f;
+
+					if (func == nullptr)
+						return fail(ERROR_UNKNOWN_FUNCTION, begin);
+
+					unsigned int arguments[3] = { 0, 0, 0 };
+					unsigned int argumentCount = 0;
+
+					_pos = argumentsBegin;
+					skipWhitespace();
+
+					if (_text[_pos] == ')')
+						_pos++;
+					else
+					{
+						while (true)
+						{
+							if (argumentCount == 3)
+								return fail(ERROR_INVALID_NUM_ARGUMENTS, begin);
+
+							arguments[argumentCount++] = parseBinary(PREC_LOWEST, false);
+
+							if (_ast.error != ERROR_NONE)
+								return 0;
+
+							skipWhitespace();
+
+							if (_text[_pos] == ')')
+							{
+								_pos++;
+								break;
+							}
+
+							if (_text[_pos] != ',')
+								return fail(_text[_pos] == '\0' ? ERROR_UNMATCHED_PARENTHESIS : ERROR_UNEXPECTED_TOKEN);
+
+							_pos++;
+						}
+					}
+
+					if (argumentCount != func->arity)
+						return fail(ERROR_INVALID_NUM_ARGUMENTS, begin);
+
+					if (func->arity == 1)
+						return addNode(NODE_UNARY, func->unary, nullptr, arguments[0], 0);
+
+					if (func->arity == 3)
+					{
+						unsigned int index = addNode(NODE_SELECT, nullptr, nullptr, arguments[1], arguments[2]);
+						_ast.nodes[index].condition = arguments[0];
+						return index;
+					}
+
+					return addNode(NODE_BINARY, nullptr, func->binary, arguments[0], arguments[1]);
+				}
+
+			public:
+				constexpr Parser(const char* text) :
+					_text(text),
+					_pos(0),
+					_ast()
+				{ }
+
+				constexpr Ast<Capacity> parse()
+				{
+					unsigned int root = parseBinary(PREC_LOWEST, false);
+
+					skipWhitespace();
+
+					if (_ast.error == ERROR_NONE && _text[_pos] != '\0')
+						fail(_text[_pos] == ')' ? ERROR_UNMATCHED_PARENTHESIS : ERROR_UNEXPECTED_TOKEN);
+
+					_ast.root = root;
+					return _ast;
+				}
+		};
+
+		template <typename Source>
+		struct Parsed
+		{
+			static constexpr std::size_t capacity = length(Source::text()) + 1;
+			static constexpr Ast<capacity> ast = Parser<capacity>(Source::text()).parse();
+		};
+
+		template <typename Source>
+		constexpr Ast<Parsed<Source>::capacity> Parsed<Source>::ast;
+
+		/** A node of the syntax tree as a type; evaluate() compiles to the arithmetic it stands for */
+		template <typename Source, unsigned int Index, NodeKind Kind = Parsed<Source>::ast.nodes[Index].kind>
+		struct Term;
+
+		template <typename Source, unsigned int Index>
+		struct Term<Source, Index, NODE_CONSTANT>
+		{
+			static constexpr double value = Parsed<Source>::ast.nodes[Index].value;
+
+			static double evaluate(const double*) { return value; }
+		};
+
+		template <typename Source, unsigned int Index>
+		struct Term<Source, Index, NODE_VARIABLE>
+		{
+			static constexpr unsigned int variable = Parsed<Source>::ast.nodes[Index].variable;
+
+			static double evaluate(const double* values) { return values[variable]; }
+		};
+
+		template <typename Source, unsigned int Index>
+		struct Term<Source, Index, NODE_UNARY>
+		{
+			typedef Term<Source, Parsed<Source>::ast.nodes[Index].left> Operand;
+
+			static double evaluate(const double* values)
+			{
+				constexpr UnaryOperation operation = Parsed<Source>::ast.nodes[Index].unary;
+				return operation(Operand::evaluate(values));
+			}
+		};
+
+		template <typename Source, unsigned int Index>
+		struct Term<Source, Index, NODE_BINARY>
+		{
+			typedef Term<Source, Parsed<Source>::ast.nodes[Index].left> Left;
+			typedef Term<Source, Parsed<Source>::ast.nodes[Index].right> Right;
+
+			static double evaluate(const double* values)
+			{
+				constexpr BinaryOperation operation = Parsed<Source>::ast.nodes[Index].binary;
+				return operation(Left::evaluate(values), Right::evaluate(values));
+			}
+		};
+
+		template <typename Source, unsigned int Index>
+		struct Term<Source, Index, NODE_SELECT>
+		{
+			typedef Term<Source, Parsed<Source>::ast.nodes[Index].condition> Condition;
+			typedef Term<Source, Parsed<Source>::ast.nodes[Index].left> Left;
+			typedef Term<Source, Parsed<Source>::ast.nodes[Index].right> Right;
+
+			//Nothing here has side effects, so only the selected branch needs computing
+			static double evaluate(const double* values)
+			{
+				return std::fabs(Condition::evaluate(values)) >= 0.5 ? Left::evaluate(values) : Right::evaluate(values);
+			}
+		};
+
+		/** Adapts a string with static storage to a Source, e.g.
+		 *  constexpr char formula[] = "x*x + 2*y"; Expression<Literal<formula> > f; */
+		template <const char* Text>
+		struct Literal
+		{
+			static constexpr const char* text() { return Text; }
+		};
+
+		/** An expression parsed at compile time from Source::text(), a constexpr function returning a string literal */
+		template <typename Source>
+		class Expression
+		{
+			private:
+				typedef Parsed<Source> Result;
+
+				static_assert(Result::ast.error != ERROR_UNEXPECTED_TOKEN, "EXPARSE: unexpected token");
+				static_assert(Result::ast.error != ERROR_UNEXPECTED_END, "EXPARSE: unexpected end of expression");
+				static_assert(Result::ast.error != ERROR_UNMATCHED_PARENTHESIS, "EXPARSE: unmatched parenthesis");
+				static_assert(Result::ast.error != ERROR_MALFORMED_NUMBER, "EXPARSE: malformed number");
+				static_assert(Result::ast.error != ERROR_UNKNOWN_FUNCTION, "EXPARSE: unknown function");
+				static_assert(Result::ast.error != ERROR_INVALID_NUM_ARGUMENTS, "EXPARSE: invalid number of arguments");
+				static_assert(Result::ast.error != ERROR_UNSUPPORTED_OPERATOR, "EXPARSE: assignments and increments cannot be compiled");
+
+			public:
+				typedef Term<Source, Result::ast.root> Root;
+
+				static constexpr unsigned int arity = Result::ast.variableCount;
+
+				/** \brief Evaluates the expression
+				 *
+				 * \param args	One value per variable, in order of first appearance in the expression
+				 * \return		The value of the expression
+				 *
+				 */
+				template <typename... Args>
+				double operator()(Args... args) const
+				{
+					static_assert(sizeof...(Args) == arity, "EXPARSE: expecting one argument per variable");
+
+					const double values[sizeof...(Args) + 1] = { static_cast<double>(args)..., 0.0 };
+					return Root::evaluate(values);
+				}
+
+				double evaluate(const double* values) const { return Root::evaluate(values); }
+
+				/** \brief Returns the name of the variable bound to the given argument position */
+				static std::string variableName(unsigned int index)
+				{
+					return std::string(Source::text() + Result::ast.variables[index].begin, Result::ast.variables[index].length);
+				}
+		};
+	}
+}
+
+#endif
@@ -3,16 +3,26 @@
 * 	Copyright (C) 2013 Jordan Melo				 	*
 ****************************************************/
 
+#include	<stdexcept>
+
 #include	"context.h"
+#include	"user_function.h"
+#include	"tokenizer_exception.h"
 
 FunctionContext::FunctionContext() :
-	operatorOrderedIndex(OperatorComparator(_operators))
+	operatorOrderedIndex(OperatorComparator(_operators)),
+	_precision(PRECISION_FULL),
+	_flushDenormals(false),
+	_builtinOperatorCount(0),
+	_builtinFunctionCount(0)
 {
 	unsigned int numOps = Operator::numDefaultOperators / sizeof(Operator);
 	unsigned int numFuncs = Function::numDefaultFunctions / sizeof(Function);
 
 	//_operators.reserve(numOps);
 	_functions.reserve(numFuncs);
+	_functionTable[PRECISION_FULL].reserve(numFuncs);
+	_functionTable[PRECISION_FAST].reserve(numFuncs);
 	//_operatorIndex.reserve(numOps);
 	_functionIndex.reserve(numFuncs);
 
@@ -21,6 +31,9 @@ FunctionContext::FunctionContext() :
 
 	for (unsigned int i = 0; i < numFuncs; i++)
 		registerFunction(Function::defaults[i]);
+
+	_builtinOperatorCount = _operators.size();
+	_builtinFunctionCount = _functions.size();
 }
 
 void FunctionContext::registerOperator(const Operator& o)
@@ -29,6 +42,12 @@ void FunctionContext::registerOperator(const Operator& o)
 
 	_operators.push_back(o);
 	operatorOrderedIndex.insert(_operators.size() - 1);
+
+	for (unsigned int p = PRECISION_FULL; p <= PRECISION_FAST; p++)
+	{
+		_operatorTable[p].push_back(o.implementation(static_cast<Precision>(p)));
+		_operatorTable[p].back()._arity = o.arity();
+	}
 }
 
 void FunctionContext::registerFunction(const Function& f)
@@ -37,14 +56,78 @@ void FunctionContext::registerFunction(const Function& f)
 
 	assert(_functionIndex.find(f.symbol()) == _functionIndex.end());
 
+	std::shared_ptr<MemoCache> caches[2];
+
+	//Memoized functions are called through their cache; tiers sharing an implementation share a cache
+	if (f.memoCapacity() > 0)
+	{
+		if (!f.isPure())
+			throw std::invalid_argument("'" + f.symbol() + "' cannot be memoized because it is not pure");
+
+		//Cache entries have one key per parameter, so the number of arguments must be fixed
+		if (f.isVariadic())
+			throw std::invalid_argument("'" + f.symbol() + "' cannot be memoized because it takes a variable number of arguments");
+
+		caches[PRECISION_FULL] = std::make_shared<MemoCache>(f.implementation(PRECISION_FULL), f.arity(), f.memoCapacity());
+		caches[PRECISION_FAST] = f.hasApproximation() ?
+				std::make_shared<MemoCache>(f.implementation(PRECISION_FAST), f.arity(), f.memoCapacity()) : caches[PRECISION_FULL];
+	}
+
 	unsigned int index = _functions.size();
 	std::pair<std::string, unsigned int> kvp;
 
 	_functions.push_back(f);
 	kvp = std::pair<std::string, unsigned int>(f.symbol(), index);
+
+	for (unsigned int p = PRECISION_FULL; p <= PRECISION_FAST; p++)
+	{
+		_functionTable[p].push_back(caches[p] ? caches[p]->wrapper() : f.implementation(static_cast<Precision>(p)));
+		_functionTable[p].back()._arity = f.arity();
+		_memoCaches[p].push_back(caches[p]);
+	}
 	_functionIndex.insert(kvp);
 }
 
+/** \brief Defines a function in the expression language, e.g. defineFunction("f(x, y) = x*exp(-y)")
+ *
+ * Throws a TokenizerException if the definition is malformed.
+ *
+ * \param definition	The definition
+ * \return 			The ID of the new function
+ *
+ */
+unsigned int FunctionContext::defineFunction(const std::string& definition)
+{
+	ParseResult result;
+	unsigned int id = defineFunction(definition, result);
+
+	if (result.failed())
+		throwParseError(result);
+
+	return id;
+}
+
+/** \brief Defines a function in the expression language without throwing
+ *
+ * \param definition	The definition
+ * \param result		Receives the outcome
+ * \return 			The ID of the new function, or NULLID if the definition is malformed
+ *
+ */
+unsigned int FunctionContext::defineFunction(const std::string& definition, ParseResult& result)
+{
+	std::shared_ptr<UserFunction> func = UserFunction::parse(definition, *this, result);
+
+	if (!func)
+		return NULLID;
+
+	Function f(func->name(), func->implementation(PRECISION_FULL), func->arity());
+	f.setApproximation(func->implementation(PRECISION_FAST)).setDefinition(func).setEffects(func->effects());
+	registerFunction(f);
+
+	return getFunctionID(func->name());
+}
+
 unsigned int FunctionContext::getFunctionID(std::string name) const
 {
 	std::unordered_map<std::string, unsigned int>::const_iterator it = _functionIndex.find(name);
@@ -55,6 +138,21 @@ unsigned int FunctionContext::getFunctionID(std::string name) const
 		return it->second + 1;
 }
 
+/** \brief Looks up an operator by symbol and position, e.g. ("-", Operator::POS_PREFIX) for negation
+ *
+ * \param symbol		The operator's symbol
+ * \param position	Where the operator stands relative to its operands
+ * \return			The ID of the operator, or NULLID if there is none
+ *
+ */
+unsigned int FunctionContext::getOperatorID(const std::string& symbol, Operator::Positioning position) const
+{
+	for (unsigned int i = 0; i < _operators.size(); i++)
+		if (_operators[i].position() == position && _operators[i].symbol() == symbol)
+			return i + 1;
+
+	return NULLID;
+}
 
 unsigned int FunctionContext::parseOperator(const std::string& expr, unsigned int& index, int positions) const
 {
@@ -101,47 +199,275 @@ const Function* FunctionContext::lookupFunction(unsigned int id) const
 	return &_functions[id - 1];
 }
 
-unsigned int VariableContext::registerVariable(const Variable& var)
+VariableContext::SymbolShard& VariableContext::shardFor(const std::string& name)
 {
-	//TODO: make thread-safe
+	return _variableIndex[std::hash<std::string>()(name) % SYMBOL_TABLE_SHARDS];
+}
 
-	assert(_variableIndex.find(var.name()) == _variableIndex.end());
+unsigned int VariableContext::appendVariable(const Variable& var, double value)
+{
+	std::lock_guard<std::mutex> lock(_storageMutex);
 
 	unsigned int index = _variables.size();
-	std::pair<std::string, unsigned int> kvp;
+	const double* oldStorage = _values.data();
 
+	_values.push_back(value);
+	_slots.push_back(&_values.back());
+	_bound.push_back(false);
 	_variables.push_back(var);
-	kvp = std::pair<std::string, unsigned int>(var.name(), index);
-	_variableIndex.insert(kvp);
+
+	if (_values.data() != oldStorage)
+		refreshInternalSlots();
 
 	return index + 1;
 }
 
+unsigned int VariableContext::registerVariable(const Variable& var, double value)
+{
+	SymbolShard& shard = shardFor(var.name());
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	assert(shard.index.find(var.name()) == shard.index.end());
+
+	unsigned int id = appendVariable(var, value);
+	shard.index.insert(std::pair<std::string, unsigned int>(var.name(), id));
+
+	return id;
+}
+
 VariableContext::VariableContext()
 {
+	_values.reserve(RESERVED_VARIABLE_SPACE);
+	_slots.reserve(RESERVED_VARIABLE_SPACE);
 	_variables.reserve(RESERVED_VARIABLE_SPACE);
-	_variableIndex.reserve(RESERVED_VARIABLE_SPACE);
 
-	registerVariable(Variable("pi", std::acos(-1.0), true));
-	registerVariable(Variable("e", std::exp(1.0), true));
-	registerVariable(Variable("phi", 0.5 + std::sqrt(5.0) * 0.5, true));
+	registerVariable(Variable("pi", true), std::acos(-1.0));
+	registerVariable(Variable("e", true), std::exp(1.0));
+	registerVariable(Variable("phi", true), 0.5 + std::sqrt(5.0) * 0.5);
 }
 
+/** \brief Looks up a variable by name, creating it if it doesn't exist yet
+ *
+ * Safe to call from several threads at once, e.g. while expressions are parsed in parallel.
+ * It must not run concurrently with evaluation or binding, since creating a variable may
+ * move the value array.
+ *
+ * \param name	The name of the variable
+ * \return 		The ID of the variable
+ *
+ */
 unsigned int VariableContext::getId(const std::string& name)
 {
+	SymbolShard& shard = shardFor(name);
+	std::lock_guard<std::mutex> lock(shard.mutex);
 	std::unordered_map<std::string, unsigned int>::iterator it;
 
-	it = _variableIndex.find(name);
+	it = shard.index.find(name);
 
-	if (it == _variableIndex.end())
-		//Create the variable since it doesn't already exist
-		return registerVariable(Variable(name, 0.0));
-	else
-		return it->second + 1;
+	if (it != shard.index.end())
+		return it->second;
+
+	//Create the variable since it doesn't already exist
+	unsigned int id = appendVariable(Variable(name), 0.0);
+	shard.index.insert(std::pair<std::string, unsigned int>(name, id));
+
+	return id;
+}
+
+/** \brief Looks up a variable without creating it
+ *
+ * \param name	The name of the variable
+ * \return		The ID of the variable, or NULLID if it doesn't exist
+ *
+ */
+unsigned int VariableContext::findId(const std::string& name)
+{
+	SymbolShard& shard = shardFor(name);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	std::unordered_map<std::string, unsigned int>::const_iterator it = shard.index.find(name);
+
+	return it != shard.index.end() ? it->second : NULLID;
 }
 
-Variable* VariableContext::lookupVariable(unsigned int id)
+const Variable* VariableContext::lookupVariable(unsigned int id) const
 {
 	assert(id > 0 && id <= _variables.size());
 	return &_variables[id - 1];
 }
+
+void VariableContext::refreshInternalSlots()
+{
+	//The value array moved, so re-point every slot that isn't bound to caller memory
+	for (unsigned int i = 0; i < _slots.size(); i++)
+		if (!_bound[i])
+			_slots[i] = &_values[i];
+}
+
+/** \brief Binds a variable to a double owned by the caller
+ *
+ * Expressions read and write the bound location directly; nothing is copied into the context.
+ * The location must stay valid until the variable is unbound or rebound.
+ *
+ * \param name		The name of the variable, created if it doesn't exist yet
+ * \param location	The caller's storage for the variable
+ * \return 			The ID of the variable
+ *
+ */
+unsigned int VariableContext::bind(const std::string& name, double* location)
+{
+	unsigned int id = getId(name);
+
+	unbind(id);
+	_slots[id - 1] = location;
+	_bound[id - 1] = true;
+
+	return id;
+}
+
+/** \brief Binds a variable to a field in an array of records owned by the caller
+ *
+ * The variable refers to the double at base + row * stride bytes, where row is the value
+ * last passed to setRow(). This lets a single field of an array of structs be fed to
+ * expressions without copying.
+ *
+ * \param name		The name of the variable, created if it doesn't exist yet
+ * \param base		The location of the field in row 0
+ * \param stride	The distance in bytes between consecutive rows
+ * \return 			The ID of the variable
+ *
+ */
+unsigned int VariableContext::bind(const std::string& name, double* base, std::size_t stride)
+{
+	unsigned int id = bind(name, base);
+
+	StridedBinding binding;
+	binding.slot = id - 1;
+	binding.base = reinterpret_cast<char*>(base);
+	binding.stride = stride;
+	binding.array = false;
+	binding.length = 0;
+	_stridedBindings.push_back(binding);
+
+	return id;
+}
+
+/** \brief Binds a variable to an array of doubles owned by the caller
+ *
+ * ArrayExpression treats the variable as the whole array, element-wise. Everywhere else it is a
+ * binding with a stride of one double, so plain evaluation reads the element selected by
+ * setRow(), and batches read one element per row.
+ *
+ * \param name		The name of the variable, created if it doesn't exist yet
+ * \param data		The first element
+ * \param length	The number of elements
+ * \return 			The ID of the variable
+ *
+ */
+unsigned int VariableContext::bindArray(const std::string& name, double* data, std::size_t length)
+{
+	unsigned int id = bind(name, data, sizeof(double));
+
+	_stridedBindings.back().array = true;
+	_stridedBindings.back().length = length;
+
+	return id;
+}
+
+/** \brief Returns a variable to storage owned by the context
+ *
+ * \param id	The ID of the variable
+ *
+ */
+void VariableContext::unbind(unsigned int id)
+{
+	assert(id > 0 && id <= _slots.size());
+
+	if (!_bound[id - 1])
+		return;
+
+	for (auto it = _stridedBindings.begin(); it != _stridedBindings.end(); ++it)
+	{
+		if (it->slot == id - 1)
+		{
+			_stridedBindings.erase(it);
+			break;
+		}
+	}
+
+	_bound[id - 1] = false;
+	_slots[id - 1] = &_values[id - 1];
+}
+
+/** \brief Selects the row that every strided binding refers to
+ *
+ * \param row	The index of the row in the caller's arrays
+ *
+ */
+void VariableContext::setRow(std::size_t row)
+{
+	for (auto it = _stridedBindings.begin(); it != _stridedBindings.end(); ++it)
+		_slots[it->slot] = reinterpret_cast<double*>(it->base + row * it->stride);
+}
+
+VariableContext::RowGuard::RowGuard(VariableContext& context) :
+	_context(context)
+{
+	for (auto it = _context._stridedBindings.begin(); it != _context._stridedBindings.end(); ++it)
+		_savedSlots.push_back(_context._slots[it->slot]);
+}
+
+VariableContext::RowGuard::~RowGuard()
+{
+	for (std::size_t i = 0; i < _savedSlots.size(); i++)
+		_context._slots[_context._stridedBindings[i].slot] = _savedSlots[i];
+}
+
+/** \brief Looks up the strided binding of a variable
+ *
+ * \param id		The ID of the variable
+ * \param stride	Receives the distance in bytes between rows
+ * \return 		The location of the variable in row 0, or nullptr if it isn't bound with a stride
+ *
+ */
+double* VariableContext::rowBinding(unsigned int id, std::size_t& stride) const
+{
+	for (auto it = _stridedBindings.begin(); it != _stridedBindings.end(); ++it)
+	{
+		if (it->slot == id - 1)
+		{
+			stride = it->stride;
+			return reinterpret_cast<double*>(it->base);
+		}
+	}
+
+	return nullptr;
+}
+
+/** \brief Returns whether a variable is bound to an array with bindArray()
+ *
+ * \param id	The ID of the variable
+ *
+ */
+bool VariableContext::isArray(unsigned int id) const
+{
+	for (auto it = _stridedBindings.begin(); it != _stridedBindings.end(); ++it)
+		if (it->slot == id - 1)
+			return it->array;
+
+	return false;
+}
+
+/** \brief Returns the number of elements of an array variable
+ *
+ * \param id	The ID of the variable
+ * \return 	The length passed to bindArray(), or 0 if the variable isn't bound to an array
+ *
+ */
+std::size_t VariableContext::arrayLength(unsigned int id) const
+{
+	for (auto it = _stridedBindings.begin(); it != _stridedBindings.end(); ++it)
+		if (it->slot == id - 1)
+			return it->length;
+
+	return 0;
+}
@@ -17,10 +17,14 @@
 
 #include "function.h"
 #include "variable.h"
+#include "aligned_allocator.h"
 
 #define	RESERVED_VARIABLE_SPACE			64
+#define	SYMBOL_TABLE_SHARDS				16
 #define	NULLID							0
 
+class ParseResult;
+
 class FunctionContext
 {
 	private:
@@ -59,38 +63,188 @@ class FunctionContext
 			}
 		};
 
+		//Cold descriptors: names, handedness and arity, only needed while parsing
 		std::vector<Operator> _operators;
 		std::vector<Function> _functions;
+
+		//Hot dispatch tables, one per precision tier, indexed by ID - 1
+		std::vector<NativeFunction> _operatorTable[2];
+		std::vector<NativeFunction> _functionTable[2];
+		std::vector<std::shared_ptr<MemoCache> > _memoCaches[2];		/**< Per function and tier, null unless memoized */
+
 		std::unordered_map<std::string, unsigned int> _functionIndex;
 		std::set<unsigned int, OperatorComparator> operatorOrderedIndex;
+		Precision _precision;
+		bool _flushDenormals;
+		unsigned int _builtinOperatorCount;
+		unsigned int _builtinFunctionCount;
 
 	public:
 		FunctionContext();
 
+		//The defaults registered by the constructor, whose meaning optimizations may rely on by symbol
+		bool isBuiltinOperator(unsigned int id) const { return id > 0 && id <= _builtinOperatorCount; }
+		bool isBuiltinFunction(unsigned int id) const { return id > 0 && id <= _builtinFunctionCount; }
+
+		Precision precision() const { return _precision; }
+		void setPrecision(Precision p) { _precision = p; }
+
+		bool flushDenormals() const { return _flushDenormals; }
+		void setFlushDenormals(bool enable) { _flushDenormals = enable; }
+
 		void registerOperator(const Operator& o);
 		void registerFunction(const Function& f);
 
+		/** \brief Registers a natively typed function, e.g. registerFunction<double(double, double)>("hypot", &hypot, EFFECT_NONE)
+		 *
+		 * \param name		The name the function is called by in expressions
+		 * \param fn			A function pointer, or any callable (including ones carrying state) with the given signature
+		 * \param effects	A combination of Effect flags; pass EFFECT_NONE for pure functions so calls can be optimized
+		 *
+		 */
+		template <typename Signature, typename Callable>
+		void registerFunction(const std::string& name, Callable fn, unsigned int effects = EFFECT_UNKNOWN)
+		{
+			std::shared_ptr<void> state;
+			NativeFunction native = NativeFunction::create<Signature>(fn, state);
+
+			registerFunction(Function(name, native, NativeSignature<Signature>::arity).retainState(state).setEffects(effects));
+		}
+
+		/** \brief Registers a pure, natively typed function whose recent results are cached, e.g.
+		 * registerMemoizedFunction<double(double)>("lgamma", &lgamma)
+		 *
+		 * \param name		The name the function is called by in expressions
+		 * \param fn			A function pointer or callable with the given signature; must be pure
+		 * \param capacity	The number of results kept, rounded up to a power of two
+		 *
+		 */
+		template <typename Signature, typename Callable>
+		void registerMemoizedFunction(const std::string& name, Callable fn, std::size_t capacity = MEMO_CACHE_CAPACITY)
+		{
+			std::shared_ptr<void> state;
+			NativeFunction native = NativeFunction::create<Signature>(fn, state);
+
+			registerFunction(Function(name, native, NativeSignature<Signature>::arity).retainState(state)
+					.setEffects(EFFECT_NONE).setMemoized(capacity));
+		}
+
+		/** \brief Returns the cache in front of a memoized function, e.g. to read its hit rate
+		 *
+		 * \param functionId	The function's ID
+		 * \param p				The precision tier; tiers with different implementations have separate caches
+		 * \return				The cache, or nullptr if the function is not memoized
+		 *
+		 */
+		MemoCache* memoCache(unsigned int functionId, Precision p = PRECISION_FULL) const
+		{
+			return functionId > 0 && functionId <= _memoCaches[p].size() ? _memoCaches[p][functionId - 1].get() : nullptr;
+		}
+
+		unsigned int defineFunction(const std::string& definition);
+		unsigned int defineFunction(const std::string& definition, ParseResult& result);
+
 		unsigned int getFunctionID(std::string name) const;
+		unsigned int getOperatorID(const std::string& symbol, Operator::Positioning position) const;
 
 		const Operator* lookupOperator(unsigned int id) const;
 		const Function* lookupFunction(unsigned int id) const;
 
+		const NativeFunction* operatorTable(Precision p) const { return _operatorTable[p].data(); }
+		const NativeFunction* functionTable(Precision p) const { return _functionTable[p].data(); }
+
 		unsigned int parseOperator(const std::string& expr, unsigned int& index, int positions) const;
 };
 
 class VariableContext
 {
 	private:
+		struct StridedBinding
+		{
+			unsigned int slot;
+			char* base;
+			std::size_t stride;
+			bool array;				/**< Whether it was bound with bindArray() */
+			std::size_t length;		/**< The number of elements of an array variable */
+		};
+
+		//The name index is split into independently locked shards so that expressions can be parsed concurrently
+		struct SymbolShard
+		{
+			std::mutex mutex;
+			std::unordered_map<std::string, unsigned int> index;
+		};
+
+		//Values are stored apart from the names so that evaluation only ever touches a dense array of doubles.
+		//Every slot is reached through _slots, which points either into _values or into memory owned by the caller.
+		std::vector<double, AlignedAllocator<double> > _values;
+		std::vector<double*, AlignedAllocator<double*> > _slots;
+		std::vector<bool> _bound;
+		std::vector<StridedBinding> _stridedBindings;
 		std::vector<Variable> _variables;
-		std::unordered_map<std::string, unsigned int> _variableIndex;
+		SymbolShard _variableIndex[SYMBOL_TABLE_SHARDS];
+		std::mutex _storageMutex;
 
-		unsigned int registerVariable(const Variable& var);
+		SymbolShard& shardFor(const std::string& name);
+		unsigned int appendVariable(const Variable& var, double value);
+		unsigned int registerVariable(const Variable& var, double value);
+		void refreshInternalSlots();
 
 	public:
 		VariableContext();
 
 		unsigned int getId(const std::string& name);
-		Variable* lookupVariable(unsigned int id);
+		unsigned int findId(const std::string& name);
+		unsigned int size() const { return _values.size(); }
+
+		const Variable* lookupVariable(unsigned int id) const;
+
+		/** \brief Returns a reference to the storage slot of a variable
+		 *
+		 * \param id	The ID of the variable, as returned by getId()
+		 * \return 		A reference to the variable's value
+		 *
+		 */
+		double& value(unsigned int id)
+		{
+			assert(id > 0 && id <= _slots.size());
+			return *_slots[id - 1];
+		}
+
+		/** \brief Returns the slot table; the variable with ID n lives at *slots()[n - 1]
+		 *
+		 * The table is invalidated when a new variable is created.
+		 */
+		double* const* slots() const { return _slots.data(); }
+
+		unsigned int bind(const std::string& name, double* location);
+		unsigned int bind(const std::string& name, double* base, std::size_t stride);
+		unsigned int bindArray(const std::string& name, double* data, std::size_t length);
+		void unbind(unsigned int id);
+
+		void setRow(std::size_t row);
+		double* rowBinding(unsigned int id, std::size_t& stride) const;
+		bool isArray(unsigned int id) const;
+		std::size_t arrayLength(unsigned int id) const;
+
+		/** \brief Restores the rows that strided bindings refer to on destruction, undoing setRow()
+		 *
+		 * Bindings must not change while the guard is alive.
+		 */
+		class RowGuard
+		{
+			private:
+				VariableContext& _context;
+				std::vector<double*> _savedSlots;
+
+			public:
+				RowGuard(VariableContext& context);
+				~RowGuard();
+
+			private:
+				RowGuard(const RowGuard&);
+				RowGuard& operator=(const RowGuard&);
+		};
 };
 
 #endif
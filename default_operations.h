@@ -0,0 +1,75 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef DEFAULT_OPERATIONS_H
+#define DEFAULT_OPERATIONS_H
+
+#include	<cmath>
+#include	<limits>
+
+//Numeric implementations of the default operators and functions. They are inline so that both the
+//runtime dispatch tables and the compile-time expressions of compiled_expression.h can use them.
+
+namespace DefaultOperator
+{
+	inline double plus(double x)						{ return x; }
+	inline double minus(double x)						{ return -x; }
+	inline double addition(double x, double y)			{ return x + y; }
+	inline double subtraction(double x, double y)		{ return x - y; }
+	inline double multiplication(double x, double y)	{ return x * y; }
+	inline double division(double x, double y)			{ return x / y; }
+	inline double modulo(double x, double y)			{ return std::fmod(x, y); }
+	inline double exponentiation(double x, double y)	{ return std::pow(x, y); }
+	inline double isEqual(double x, double y)			{ return (std::fabs(x - y) / (std::fabs(x) + 1.0)) < 0.00001 ? 1.0 : 0.0; }
+	inline double isNotEqual(double x, double y)		{ return (std::fabs(x - y) / (std::fabs(x) + 1.0)) >= 0.00001 ? 1.0 : 0.0; }
+	inline double isLessThan(double x, double y)		{ return x < y ? 1.0 : 0.0; }
+	inline double isGreaterThan(double x, double y)		{ return x > y ? 1.0 : 0.0; }
+	inline double isLessOrEqual(double x, double y)		{ return (isEqual(x, y) + isLessThan(x, y)) > 0.5 ? 1.0 : 0.0; }
+	inline double isGreaterOrEqual(double x, double y)	{ return (isEqual(x, y) + isGreaterThan(x, y)) > 0.5 ? 1.0 : 0.0; }
+	inline double booleanAnd(double x, double y)		{ return std::fabs(x) >= 0.5 && std::fabs(y) >= 0.5 ? 1.0 : 0.0; }
+	inline double booleanOr(double x, double y)			{ return std::fabs(x) >= 0.5 || std::fabs(y) >= 0.5 ? 1.0 : 0.0; }
+	inline double booleanNot(double x)					{ return std::fabs(x) < 0.5 ? 1.0 : 0.0; }
+}
+
+namespace DefaultFunction
+{
+	inline double cos(double x)				{ return std::cos(x);			}
+	inline double sin(double x)				{ return std::sin(x);			}
+	inline double tan(double x)				{ return std::tan(x);			}
+	inline double acos(double x)			{ return std::acos(x);			}
+	inline double asin(double x)			{ return std::asin(x);			}
+	inline double atan(double x)			{ return std::atan(x);			}
+	inline double atan2(double y, double x)	{ return std::atan2(y, x);		}
+	inline double cosh(double x)			{ return std::cosh(x);			}
+	inline double sinh(double x)			{ return std::sinh(x);			}
+	inline double tanh(double x)			{ return std::tanh(x);			}
+	inline double exp(double x)				{ return std::exp(x);			}
+	inline double log(double x)				{ return std::log(x);			}
+	inline double log10(double x)			{ return std::log10(x);			}
+	inline double pow(double x, double y)	{ return std::pow(x, y);		}
+	inline double sqrt(double x)			{ return std::sqrt(x);			}
+	inline double ceil(double x)			{ return std::ceil(x);			}
+	inline double abs(double x)				{ return std::abs(x);			}
+	inline double floor(double x)			{ return std::floor(x);			}
+	inline double mod(double x, double y)	{ return std::fmod(x, y); 		}
+
+	//Array reductions and indexing, see ArrayExpression; a scalar acts as an array of one element
+	inline double total(double x)			{ return x;						}
+	inline double dot(double x, double y)	{ return x * y;					}
+	inline double norm(double x)			{ return std::abs(x);			}
+	inline double at(double x, double i)	{ return std::fpclassify(i) == FP_ZERO ? x : std::numeric_limits<double>::quiet_NaN(); }
+
+	//Window functions, see StreamExpression; evaluated on their own they see a stream of one sample
+	inline double ema(double x, double)		{ return x;						}
+	inline double rollsum(double x, double)	{ return x;						}
+	inline double rollmean(double x, double)	{ return x;						}
+	inline double rollvar(double, double)	{ return NAN;					}
+	inline double rollmin(double x, double)	{ return x;						}
+	inline double rollmax(double x, double)	{ return x;						}
+	inline double lag(double x, double k)	{ return std::fpclassify(k) == FP_ZERO ? x : NAN;	}
+	inline double delta(double)				{ return NAN;					}
+}
+
+#endif
@@ -0,0 +1,495 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<algorithm>
+#include	<cstring>
+#include	<memory>
+#include	<stdexcept>
+
+#include	"expression_builder.h"
+
+ExpressionBuilder::ExpressionBuilder(VariableContext& vc, const FunctionContext& fc) :
+	_variableContext(vc),
+	_functionContext(fc),
+	_derefFunctionId(fc.getFunctionID(std::string("_deref"))),
+	_nodeIndex(BUILDER_INITIAL_INDEX_SIZE, 0)
+{
+	_nodes.reserve(BUILDER_INITIAL_INDEX_SIZE / 2);
+	_arguments.reserve(BUILDER_INITIAL_INDEX_SIZE);
+}
+
+ExpressionBuilder::NodeId ExpressionBuilder::constant(double value)
+{
+	return intern(Token(NumberToken(value), 0), HAND_RVALUE, nullptr, 0);
+}
+
+ExpressionBuilder::NodeId ExpressionBuilder::variable(unsigned int variableId)
+{
+	assert(_variableContext.lookupVariable(variableId) != nullptr);
+	return intern(Token(VariableToken(variableId), 0), HAND_LVALUE, nullptr, 0);
+}
+
+/** \brief Returns a node for a variable, creating the variable if it doesn't exist yet */
+ExpressionBuilder::NodeId ExpressionBuilder::variable(const std::string& name)
+{
+	return variable(_variableContext.getId(name));
+}
+
+ExpressionBuilder::NodeId ExpressionBuilder::callOperator(unsigned int operatorId, const NodeId* arguments, unsigned int count)
+{
+	return call(Token(OperatorToken(operatorId), 0), _functionContext.lookupOperator(operatorId), arguments, count);
+}
+
+ExpressionBuilder::NodeId ExpressionBuilder::callFunction(unsigned int functionId, const NodeId* arguments, unsigned int count)
+{
+	Token t(FunctionToken(functionId), 0);
+
+	t.toFunction().setArity(count);
+	return call(t, _functionContext.lookupFunction(functionId), arguments, count);
+}
+
+/** \brief Returns a node passing a sub-expression unevaluated, e.g. the body of sum(k, 1, n, body)
+ *
+ * \param body	The root of the sub-expression; if it is a variable, the body evaluates to its value
+ * \return		A node that may only be passed to HAND_EXPRESSION parameters
+ *
+ */
+ExpressionBuilder::NodeId ExpressionBuilder::expression(NodeId body)
+{
+	assert(body < _nodes.size() && _nodes[body].handedness != HAND_EXPRESSION);
+
+	NodeId value = rvalue(body);
+	return intern(Token(ExpressionToken(0), 0), HAND_EXPRESSION, &value, 1);
+}
+
+ExpressionBuilder::NodeId ExpressionBuilder::call(const Token& t, const Function* func, const NodeId* arguments, unsigned int count)
+{
+	assert(func != nullptr);
+
+	if (count != func->arity() && !(func->isVariadic() && count > func->arity()))
+	{
+		Token offender(t);
+		throwParseError(ParseResult::invalidNumArguments(offender, _functionContext));
+	}
+
+	NodeId local[BUILDER_LOCAL_ARGUMENTS];
+	std::vector<NodeId> overflow;
+	NodeId* checked = local;
+
+	if (count > BUILDER_LOCAL_ARGUMENTS)
+	{
+		overflow.resize(count);
+		checked = overflow.data();
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		assert(arguments[i] < _nodes.size());
+
+		Handedness parameter = i < func->arity() ? func->argumentHandedness(i) : HAND_RVALUE;
+		Handedness argument = _nodes[arguments[i]].handedness;
+
+		checked[i] = arguments[i];
+
+		if (argument == HAND_LVALUE && parameter == HAND_RVALUE)
+			checked[i] = rvalue(arguments[i]);
+		else if (argument != parameter)
+		{
+			Token offender(t);
+			throwParseError(ParseResult::invalidArgument(offender, i, _functionContext));
+		}
+	}
+
+	return intern(t, func->returnValueHandedness(), checked, count);
+}
+
+ExpressionBuilder::NodeId ExpressionBuilder::rvalue(NodeId node)
+{
+	if (_nodes[node].handedness == HAND_RVALUE)
+		return node;
+
+	Token deref(FunctionToken(_derefFunctionId), 0);
+	deref.toFunction().setArity(1);
+
+	return intern(deref, HAND_RVALUE, &node, 1);
+}
+
+ExpressionBuilder::NodeId ExpressionBuilder::intern(const Token& t, Handedness handedness, const NodeId* arguments, unsigned int count)
+{
+	std::size_t hash = hashNode(t, arguments, count);
+	std::size_t mask = _nodeIndex.size() - 1;
+
+	for (std::size_t bucket = hash & mask; _nodeIndex[bucket] != 0; bucket = (bucket + 1) & mask)
+	{
+		const Node& n = _nodes[_nodeIndex[bucket] - 1];
+
+		if (n.hash == hash && n.argumentCount == count && sameToken(n.token, t) &&
+				std::equal(arguments, arguments + count, _arguments.begin() + n.firstArgument))
+			return _nodeIndex[bucket] - 1;
+	}
+
+	Node n = { t, handedness, static_cast<unsigned int>(_arguments.size()), count, hash };
+
+	_arguments.insert(_arguments.end(), arguments, arguments + count);
+	_nodes.push_back(n);
+
+	//Keep the table at most half full
+	if (_nodes.size() * 2 > _nodeIndex.size())
+		growIndex();
+	else
+	{
+		std::size_t bucket = hash & mask;
+
+		while (_nodeIndex[bucket] != 0)
+			bucket = (bucket + 1) & mask;
+
+		_nodeIndex[bucket] = _nodes.size();
+	}
+
+	return _nodes.size() - 1;
+}
+
+void ExpressionBuilder::growIndex()
+{
+	std::size_t mask = _nodeIndex.size() * 2 - 1;
+
+	_nodeIndex.assign(mask + 1, 0);
+
+	for (unsigned int i = 0; i < _nodes.size(); i++)
+	{
+		std::size_t bucket = _nodes[i].hash & mask;
+
+		while (_nodeIndex[bucket] != 0)
+			bucket = (bucket + 1) & mask;
+
+		_nodeIndex[bucket] = i + 1;
+	}
+}
+
+std::size_t ExpressionBuilder::hashNode(const Token& t, const NodeId* arguments, unsigned int count)
+{
+	std::size_t h = t.type();
+
+	switch (t.type())
+	{
+		case Token::NUMBER:
+		{
+			double value = t.toNumber().value();
+			uint64_t bits;
+
+			std::memcpy(&bits, &value, sizeof(bits));
+			h = h * 31 + (bits ^ (bits >> 29));
+			break;
+		}
+
+		case Token::VARIABLE:	h = h * 31 + t.toVariable().id(); break;
+		case Token::OPERATOR:	h = h * 31 + t.toOperator().id(); break;
+		case Token::FUNCTION:	h = h * 31 + t.toFunction().id(); break;
+		case Token::EXPRESSION:	break;
+		default:				assert(false);
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+		h = h * 31 + arguments[i];
+
+	//Mix the high bits down, since buckets are picked from the low ones
+	h ^= h >> 17;
+	h *= 0xed5ad4bbu;
+	h ^= h >> 11;
+
+	return h;
+}
+
+bool ExpressionBuilder::sameToken(const Token& a, const Token& b)
+{
+	if (a.type() != b.type())
+		return false;
+
+	switch (a.type())
+	{
+		case Token::NUMBER:
+		{
+			//Bitwise, so that 0.0 and -0.0 stay distinct
+			double x = a.toNumber().value();
+			double y = b.toNumber().value();
+			return std::memcmp(&x, &y, sizeof(double)) == 0;
+		}
+
+		case Token::VARIABLE:	return a.toVariable().id() == b.toVariable().id();
+		case Token::OPERATOR:	return a.toOperator().id() == b.toOperator().id();
+		case Token::FUNCTION:	return a.toFunction().id() == b.toFunction().id();
+		case Token::EXPRESSION:	return true;
+		default:				return false;
+	}
+}
+
+/** \brief Returns the number of tokens each node expands to, capped at BUILDER_MAX_POSTFIX_TOKENS + 1 */
+std::vector<unsigned int> ExpressionBuilder::postfixSizes() const
+{
+	std::vector<unsigned int> sizes(_nodes.size());
+
+	//Arguments are always created before the nodes using them
+	for (unsigned int i = 0; i < _nodes.size(); i++)
+	{
+		std::size_t size = 1;
+
+		for (unsigned int j = 0; j < _nodes[i].argumentCount; j++)
+			size += sizes[_arguments[_nodes[i].firstArgument + j]];
+
+		sizes[i] = static_cast<unsigned int>(std::min<std::size_t>(size, BUILDER_MAX_POSTFIX_TOKENS + 1));
+	}
+
+	return sizes;
+}
+
+void ExpressionBuilder::emit(NodeId node, const std::vector<unsigned int>& sizes, std::vector<Token>& postfix) const
+{
+	//Nodes paired with whether their arguments have been emitted; an explicit stack keeps deep chains off the call stack
+	std::vector<std::pair<NodeId, bool> > pending(1, std::make_pair(node, false));
+
+	while (!pending.empty())
+	{
+		std::pair<NodeId, bool> top = pending.back();
+		const Node& n = _nodes[top.first];
+
+		pending.pop_back();
+
+		if (top.second || n.argumentCount == 0)
+			postfix.push_back(n.token);
+		else if (n.token.type() == Token::EXPRESSION)
+		{
+			//Like the parser, mark a sub-expression in front of its body with the number of tokens in it
+			NodeId body = _arguments[n.firstArgument];
+
+			postfix.push_back(Token(ExpressionToken(sizes[body]), 0));
+			pending.push_back(std::make_pair(body, false));
+		}
+		else
+		{
+			pending.push_back(std::make_pair(top.first, true));
+
+			for (unsigned int i = n.argumentCount; i > 0; i--)
+				pending.push_back(std::make_pair(_arguments[n.firstArgument + i - 1], false));
+		}
+	}
+}
+
+/** \brief Adds a node to a graph, translating each shared node once where that keeps the meaning
+ *
+ * A translation is reused as long as no write has happened since it was made, and never when it
+ * writes a variable or calls a nondeterministic function, since every use of such a node runs it.
+ *
+ * \param root			The node to translate
+ * \param graph			The graph receiving it
+ * \param copies		The graph node made for each builder node
+ * \param generations	The generation each entry of copies was made in; only current ones are reused
+ * \param generation	The current generation, advanced by every write
+ * \return				The graph node computing root
+ *
+ */
+unsigned int ExpressionBuilder::translate(NodeId root, ExpressionGraph& graph, std::vector<unsigned int>& copies,
+		std::vector<unsigned int>& generations, unsigned int& generation) const
+{
+	std::vector<std::pair<NodeId, bool> > pending(1, std::make_pair(root, false));
+	std::vector<std::pair<unsigned int, bool> > values;		//Translated operands, and whether they may be reused
+
+	while (!pending.empty())
+	{
+		std::pair<NodeId, bool> top = pending.back();
+		const Node& n = _nodes[top.first];
+
+		pending.pop_back();
+
+		if (generations[top.first] == generation)
+		{
+			values.push_back(std::make_pair(copies[top.first], true));
+			continue;
+		}
+
+		if (!top.second && n.argumentCount > 0 && n.token.type() != Token::EXPRESSION)
+		{
+			pending.push_back(std::make_pair(top.first, true));
+
+			for (unsigned int i = n.argumentCount; i > 0; i--)
+				pending.push_back(std::make_pair(_arguments[n.firstArgument + i - 1], false));
+
+			continue;
+		}
+
+		unsigned int result;
+		bool reusable = true;
+
+		switch (n.token.type())
+		{
+			case Token::NUMBER:		result = graph.constant(n.token.toNumber().value()); break;
+			case Token::VARIABLE:	result = graph.reference(n.token.toVariable().id()); break;
+
+			case Token::EXPRESSION:
+			{
+				//The body runs as often as the callee chooses, so it is a graph of its own
+				std::shared_ptr<ExpressionGraph> body = std::make_shared<ExpressionGraph>(graph.functionContext());
+				std::vector<unsigned int> bodyCopies(_nodes.size()), bodyGenerations(_nodes.size(), 0);
+				unsigned int bodyGeneration = 1;
+
+				body->addOutput(translate(_arguments[n.firstArgument], *body, bodyCopies, bodyGenerations, bodyGeneration));
+				result = graph.subexpression(body);
+				break;
+			}
+
+			default:
+			{
+				bool isOperator = n.token.type() == Token::OPERATOR;
+				unsigned int id = isOperator ? n.token.toOperator().id() : n.token.toFunction().id();
+				const Function* func = isOperator ? _functionContext.lookupOperator(id) : _functionContext.lookupFunction(id);
+				std::vector<unsigned int> arguments(n.argumentCount);
+
+				for (unsigned int i = 0; i < n.argumentCount; i++)
+				{
+					arguments[i] = values[values.size() - n.argumentCount + i].first;
+					reusable = reusable && values[values.size() - n.argumentCount + i].second;
+				}
+
+				values.resize(values.size() - n.argumentCount);
+
+				if (!isOperator && id == _derefFunctionId)
+				{
+					assert(graph.node(arguments[0]).type == ExpressionGraph::NODE_REFERENCE);
+					result = graph.load(graph.node(arguments[0]).id);
+					break;
+				}
+
+				result = isOperator ? graph.callOperator(id, arguments) : graph.callFunction(id, arguments);
+
+				const ExpressionGraph::Node& made = graph.node(result);
+				unsigned int effects = func->effects();
+
+				//A call also has the effects of the sub-expressions passed to it
+				if (made.type == ExpressionGraph::NODE_CALL)
+					effects |= made.effects;
+
+				if (effects & EFFECT_WRITES_CONTEXT)
+				{
+					//Reads translated before this write may no longer hold the current values
+					generation++;
+					reusable = false;
+				}
+				else if (effects & EFFECT_NONDETERMINISTIC)
+					reusable = false;
+
+				break;
+			}
+		}
+
+		if (reusable)
+		{
+			copies[top.first] = result;
+			generations[top.first] = generation;
+		}
+
+		values.push_back(std::make_pair(result, reusable));
+	}
+
+	assert(values.size() == 1);
+	return values.back().first;
+}
+
+/** \brief Creates an expression evaluating a node
+ *
+ * \param root	The node; if it is a variable, the expression evaluates to its value
+ * \return		The expression, ready to evaluate
+ *
+ */
+ExpressionParser ExpressionBuilder::build(NodeId root) const
+{
+	return build(std::vector<NodeId>(1, root));
+}
+
+/** \brief Creates an expression evaluating several nodes in order, like statements separated by ';'
+ *
+ * Every use of a shared node is written out, so this throws std::invalid_argument if that takes
+ * more than BUILDER_MAX_POSTFIX_TOKENS tokens.
+ *
+ * \param statements	The nodes; the expression evaluates to the value of the last one
+ * \return				The expression, ready to evaluate
+ *
+ */
+ExpressionParser ExpressionBuilder::build(const std::vector<NodeId>& statements) const
+{
+	std::vector<unsigned int> sizes = postfixSizes();
+	std::vector<Token> postfix;
+	std::size_t length = statements.size();
+
+	for (unsigned int i = 0; i < statements.size(); i++)
+	{
+		assert(statements[i] < _nodes.size());
+		assert(_nodes[statements[i]].handedness != HAND_EXPRESSION);
+		length += sizes[statements[i]];
+	}
+
+	if (length > BUILDER_MAX_POSTFIX_TOKENS)
+		throw std::invalid_argument("the expression repeats shared nodes into more than " +
+				std::to_string(BUILDER_MAX_POSTFIX_TOKENS) + " tokens; compile it from an ExpressionGraph with addTo() instead");
+
+	postfix.reserve(length);
+
+	for (unsigned int i = 0; i < statements.size(); i++)
+	{
+		if (i > 0)
+			postfix.push_back(Token(DelimiterToken(DelimiterToken::STATEMENT_DELIM), 0));
+
+		emit(statements[i], sizes, postfix);
+	}
+
+	//Like the parser, dereference a final variable so that the numeric result is returned
+	if (!statements.empty() && _nodes[statements.back()].handedness == HAND_LVALUE)
+	{
+		postfix.push_back(Token(FunctionToken(_derefFunctionId), 0));
+		postfix.back().toFunction().setArity(1);
+	}
+
+	return ExpressionParser(std::move(postfix), _variableContext, _functionContext);
+}
+
+/** \brief Adds a node to a graph, keeping shared nodes shared
+ *
+ * \param graph	A graph over this builder's function context
+ * \param root	The node; if it is a variable, the result reads its value
+ * \return		The graph node computing root, e.g. to pass to ExpressionGraph::addOutput()
+ *
+ */
+unsigned int ExpressionBuilder::addTo(ExpressionGraph& graph, NodeId root) const
+{
+	return addTo(graph, std::vector<NodeId>(1, root));
+}
+
+/** \brief Adds several nodes to a graph in order, like statements separated by ';'
+ *
+ * \param graph			A graph over this builder's function context
+ * \param statements	The nodes
+ * \return				The graph node computing the last one
+ *
+ */
+unsigned int ExpressionBuilder::addTo(ExpressionGraph& graph, const std::vector<NodeId>& statements) const
+{
+	assert(&graph.functionContext() == &_functionContext);
+
+	if (statements.empty())
+		return graph.constant(0.0);
+
+	std::vector<unsigned int> copies(_nodes.size()), generations(_nodes.size(), 0);
+	unsigned int generation = 1;
+	unsigned int result = 0;
+
+	for (unsigned int i = 0; i < statements.size(); i++)
+	{
+		assert(statements[i] < _nodes.size() && _nodes[statements[i]].handedness != HAND_EXPRESSION);
+		result = translate(statements[i], graph, copies, generations, generation);
+	}
+
+	if (graph.node(result).type == ExpressionGraph::NODE_REFERENCE)
+		return graph.load(graph.node(result).id);
+
+	return result;
+}
@@ -0,0 +1,115 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef EXPRESSION_BUILDER_H
+#define EXPRESSION_BUILDER_H
+
+#include	<string>
+#include	<vector>
+#include	<initializer_list>
+
+#include	"expression_parser.h"
+#include	"expression_graph.h"
+
+#define	BUILDER_INITIAL_INDEX_SIZE		64
+#define	BUILDER_LOCAL_ARGUMENTS			8
+#define	BUILDER_MAX_POSTFIX_TOKENS		(1u << 20)
+
+/** Builds expressions directly from nodes instead of parsing text.
+ *
+ *  Arguments are checked against the callee the same way ExpressionParser::consumeArguments does:
+ *  variables and variable-returning calls passed to HAND_RVALUE parameters are dereferenced
+ *  automatically, and anything else passed to a HAND_LVALUE parameter throws an
+ *  InvalidArgumentException. A wrong argument count throws an InvalidNumArgumentsException.
+ *  Errors have no meaningful column since there is no source text.
+ *
+ *  Nodes are hash-consed, so building the same subtree twice returns the same node; a node may be
+ *  used any number of times, in any number of expressions built from this builder. A sub-expression
+ *  passed unevaluated to a HAND_EXPRESSION parameter, such as the body of sum(), is made with
+ *  expression().
+ *
+ *  build() produces a postfix string, which repeats a shared node at every use, so a node reused
+ *  in a chain of doublings expands exponentially. Such expressions are rejected once they exceed
+ *  BUILDER_MAX_POSTFIX_TOKENS tokens; addTo() keeps the sharing by adding the nodes to an
+ *  ExpressionGraph instead, from which a Program is compiled.
+ *
+ *  Usage:
+ *  	ExpressionBuilder b(vc, fc);
+ *  	ExpressionParser e = b.build(b.callOperator(plusId, { b.variable("x"), b.constant(2.0) }));
+ */
+class ExpressionBuilder
+{
+	public:
+		typedef unsigned int NodeId;
+
+	private:
+		struct Node
+		{
+			Token token;
+			Handedness handedness;
+			unsigned int firstArgument;		/**< Index into _arguments */
+			unsigned int argumentCount;
+			std::size_t hash;
+		};
+
+		VariableContext& _variableContext;
+		const FunctionContext& _functionContext;
+		unsigned int _derefFunctionId;
+		std::vector<Node> _nodes;
+		std::vector<NodeId> _arguments;
+		std::vector<NodeId> _nodeIndex;		/**< Open-addressed hash table of node IDs + 1; 0 marks a free bucket */
+
+		NodeId call(const Token& t, const Function* func, const NodeId* arguments, unsigned int count);
+		NodeId rvalue(NodeId node);
+		NodeId intern(const Token& t, Handedness handedness, const NodeId* arguments, unsigned int count);
+		void growIndex();
+		void emit(NodeId node, const std::vector<unsigned int>& sizes, std::vector<Token>& postfix) const;
+		std::vector<unsigned int> postfixSizes() const;
+		unsigned int translate(NodeId root, ExpressionGraph& graph, std::vector<unsigned int>& copies,
+				std::vector<unsigned int>& generations, unsigned int& generation) const;
+
+		static std::size_t hashNode(const Token& t, const NodeId* arguments, unsigned int count);
+		static bool sameToken(const Token& a, const Token& b);
+
+	public:
+		ExpressionBuilder(VariableContext& vc, const FunctionContext& fc);
+
+		NodeId constant(double value);
+		NodeId variable(unsigned int variableId);
+		NodeId variable(const std::string& name);
+		NodeId callOperator(unsigned int operatorId, const NodeId* arguments, unsigned int count);
+		NodeId callFunction(unsigned int functionId, const NodeId* arguments, unsigned int count);
+		NodeId expression(NodeId body);
+
+		NodeId callOperator(unsigned int operatorId, std::initializer_list<NodeId> arguments)
+		{
+			return callOperator(operatorId, arguments.begin(), arguments.size());
+		}
+
+		NodeId callFunction(unsigned int functionId, std::initializer_list<NodeId> arguments)
+		{
+			return callFunction(functionId, arguments.begin(), arguments.size());
+		}
+
+		NodeId callOperator(unsigned int operatorId, const std::vector<NodeId>& arguments)
+		{
+			return callOperator(operatorId, arguments.data(), arguments.size());
+		}
+
+		NodeId callFunction(unsigned int functionId, const std::vector<NodeId>& arguments)
+		{
+			return callFunction(functionId, arguments.data(), arguments.size());
+		}
+
+		unsigned int size() const { return _nodes.size(); }
+
+		ExpressionParser build(NodeId root) const;
+		ExpressionParser build(const std::vector<NodeId>& statements) const;
+
+		unsigned int addTo(ExpressionGraph& graph, NodeId root) const;
+		unsigned int addTo(ExpressionGraph& graph, const std::vector<NodeId>& statements) const;
+};
+
+#endif
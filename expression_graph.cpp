@@ -0,0 +1,825 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<algorithm>
+#include	<cmath>
+#include	<climits>
+#include	<cstring>
+#include	<stdexcept>
+
+#include	"expression_graph.h"
+#include	"expression_parser.h"
+#include	"user_function.h"
+
+namespace
+{
+	/** \brief Returns whether a polynomial has a single term, such as 3*x^2 */
+	bool isMonomial(const std::vector<double>& coefficients)
+	{
+		unsigned int terms = 0;
+
+		for (unsigned int i = 0; i < coefficients.size(); i++)
+			if (std::fpclassify(coefficients[i]) != FP_ZERO)
+				terms++;
+
+		return terms == 1;
+	}
+}
+
+ExpressionGraph::ExpressionGraph(const FunctionContext& fc) :
+	_functionContext(fc),
+	_forwardStores(false)
+{ }
+
+unsigned int ExpressionGraph::constant(double value)
+{
+	Node n;
+	n.type = NODE_CONSTANT;
+	n.isOperator = false;
+	n.pure = true;
+	n.sideEffects = false;
+	n.effects = EFFECT_NONE;
+	n.id = NULLID;
+	n.version = 0;
+	n.value = value;
+
+	return intern(n);
+}
+
+unsigned int ExpressionGraph::load(unsigned int variableId)
+{
+	if (_forwardStores)
+	{
+		auto it = _forwardedValues.find(variableId);
+
+		if (it != _forwardedValues.end())
+			return it->second;
+	}
+
+	Node n;
+	n.type = NODE_LOAD;
+	n.isOperator = false;
+	n.pure = true;
+	n.sideEffects = false;
+	n.effects = EFFECT_NONE;
+	n.id = variableId;
+	n.version = _variableVersions[variableId];
+	n.value = 0.0;
+
+	return intern(n);
+}
+
+/** \brief Adds a node reading a value from storage owned by the caller
+ *
+ * \param location	Where the value is read from each time a program compiled from the graph runs
+ * \return			The node holding the value; reading the same location twice gives the same node
+ *
+ */
+unsigned int ExpressionGraph::input(const double* location)
+{
+	assert(location != nullptr);
+
+	Node n;
+	n.type = NODE_INPUT;
+	n.isOperator = false;
+	n.pure = true;
+	n.sideEffects = false;
+	n.effects = EFFECT_NONE;
+	n.id = std::find(_inputs.begin(), _inputs.end(), location) - _inputs.begin();
+	n.version = 0;
+	n.value = 0.0;
+
+	if (n.id == _inputs.size())
+		_inputs.push_back(location);
+
+	return intern(n);
+}
+
+unsigned int ExpressionGraph::reference(unsigned int variableId)
+{
+	Node n;
+	n.type = NODE_REFERENCE;
+	n.isOperator = false;
+	n.pure = true;
+	n.sideEffects = false;
+	n.effects = EFFECT_NONE;
+	n.id = variableId;
+	n.version = 0;
+	n.value = 0.0;
+
+	return intern(n);
+}
+
+/** \brief Adds a node evaluating a polynomial
+ *
+ * \param base			The node holding the polynomial's variable
+ * \param coefficients	The coefficients, lowest degree first
+ * \return				The node holding the value of the polynomial
+ *
+ */
+unsigned int ExpressionGraph::polynomial(unsigned int base, const std::vector<double>& coefficients)
+{
+	assert(base < _nodes.size() && _nodes[base].type != NODE_REFERENCE);
+
+	Node n;
+	n.type = NODE_POLYNOMIAL;
+	n.isOperator = false;
+	n.pure = true;
+	n.sideEffects = false;
+	n.effects = EFFECT_NONE;
+	n.id = NULLID;
+	n.version = 0;
+	n.value = 0.0;
+	n.arguments.push_back(base);
+	n.coefficients = coefficients;
+
+	while (n.coefficients.size() > 1 && std::fpclassify(n.coefficients.back()) == FP_ZERO)
+		n.coefficients.pop_back();
+
+	if (n.coefficients.size() < 2)
+		return constant(n.coefficients.empty() ? 0.0 : n.coefficients[0]);
+
+	return intern(n);
+}
+
+/** \brief Adds a node naming a sub-expression, to be passed to a HAND_EXPRESSION parameter
+ *
+ * \param body		The graph of the sub-expression, with a single output
+ * \return			The node naming it
+ *
+ */
+unsigned int ExpressionGraph::subexpression(const std::shared_ptr<const ExpressionGraph>& body)
+{
+	assert(body->outputs().size() == 1);
+
+	//Bodies are never merged, so the node is not interned
+	Node n;
+	n.type = NODE_EXPRESSION;
+	n.isOperator = false;
+	n.pure = false;
+	n.sideEffects = false;
+	n.effects = EFFECT_NONE;
+	n.id = _bodies.size();
+	n.version = 0;
+	n.value = 0.0;
+
+	_bodies.push_back(body);
+	_nodes.push_back(n);
+
+	return _nodes.size() - 1;
+}
+
+unsigned int ExpressionGraph::callOperator(unsigned int operatorId, const std::vector<unsigned int>& arguments)
+{
+	return call(true, operatorId, arguments);
+}
+
+unsigned int ExpressionGraph::callFunction(unsigned int functionId, const std::vector<unsigned int>& arguments)
+{
+	return call(false, functionId, arguments);
+}
+
+/** \brief Adds a call node, checking argument handedness the same way the parser does
+ *
+ * References passed to HAND_RVALUE parameters are replaced by reads of the variable. Calls to
+ * pure unary and binary functions whose arguments are all constants are folded into a constant.
+ *
+ */
+unsigned int ExpressionGraph::call(bool isOperator, unsigned int id, const std::vector<unsigned int>& arguments)
+{
+	const Function* func = isOperator ? _functionContext.lookupOperator(id) : _functionContext.lookupFunction(id);
+
+	if (arguments.size() != func->arity() && !(func->isVariadic() && arguments.size() > func->arity()))
+		throw std::invalid_argument("wrong number of arguments for '" + func->symbol() + "'");
+
+	if (func->returnValueHandedness() != HAND_RVALUE)
+		throw std::invalid_argument("'" + func->symbol() + "' returns a variable reference, which cannot be compiled");
+
+	Node n;
+	n.type = NODE_CALL;
+	n.isOperator = isOperator;
+	n.effects = func->effects();
+	n.id = id;
+	n.version = 0;
+	n.value = 0.0;
+	n.arguments = arguments;
+
+	bool allConstant = true;
+
+	for (unsigned int i = 0; i < n.arguments.size(); i++)
+	{
+		assert(n.arguments[i] < _nodes.size());
+		Handedness parameter = i < func->arity() ? func->argumentHandedness(i) : HAND_RVALUE;
+
+		if (parameter == HAND_LVALUE)
+		{
+			if (_nodes[n.arguments[i]].type != NODE_REFERENCE)
+				throw std::invalid_argument("argument " + std::to_string(i + 1) + " of '" + func->symbol() + "' must be a variable");
+		}
+		else if (parameter == HAND_EXPRESSION)
+		{
+			if (_nodes[n.arguments[i]].type != NODE_EXPRESSION)
+				throw std::invalid_argument("argument " + std::to_string(i + 1) + " of '" + func->symbol() + "' must be a sub-expression");
+
+			//Whatever the body does, the call does
+			n.effects |= body(_nodes[n.arguments[i]]).effects();
+		}
+		else if (_nodes[n.arguments[i]].type == NODE_EXPRESSION)
+			throw std::invalid_argument("argument " + std::to_string(i + 1) + " of '" + func->symbol() + "' cannot be a sub-expression");
+		else if (_nodes[n.arguments[i]].type == NODE_REFERENCE)
+			n.arguments[i] = load(_nodes[n.arguments[i]].id);
+
+		allConstant = allConstant && _nodes[n.arguments[i]].type == NODE_CONSTANT;
+	}
+
+	n.pure = n.effects == EFFECT_NONE;
+	n.sideEffects = (n.effects & EFFECT_WRITES_CONTEXT) != 0;
+
+	bool builtin = isOperator ? _functionContext.isBuiltinOperator(id) : _functionContext.isBuiltinFunction(id);
+
+	//if() with a constant condition is the branch it selects
+	if (builtin && !isOperator && func->symbol() == "if" && _nodes[n.arguments[0]].type == NODE_CONSTANT)
+		return std::fabs(_nodes[n.arguments[0]].value) >= 0.5 ? n.arguments[1] : n.arguments[2];
+
+	if (_forwardStores && n.sideEffects && builtin && isOperator)
+		return forwardAssignment(*static_cast<const Operator*>(func), n.arguments);
+
+	//Anything else that may touch variables sees their stored values, and whatever it writes is read back
+	if (_forwardStores && (n.effects & (EFFECT_READS_CONTEXT | EFFECT_WRITES_CONTEXT)))
+	{
+		std::set<unsigned int> pending;
+		pending.swap(_pendingStores);
+
+		for (auto it = pending.begin(); it != pending.end(); ++it)
+			store(*it, _forwardedValues[*it]);
+
+		if (n.sideEffects)
+			_forwardedValues.clear();
+	}
+
+	const UserFunction* definition = isOperator ? nullptr : func->definition();
+
+	if (definition != nullptr && definition->isInlinable())
+		return inlineCall(*definition, n.arguments);
+
+	//Polynomials are rewritten as a whole; their first degree parts are remembered until they grow
+	Polynomial form;
+	bool isPolynomial = n.pure && isOperator && builtin && !allConstant &&
+			combinePolynomials(*static_cast<const Operator*>(func), n.arguments, form);
+
+	if (isPolynomial && form.coefficients.size() > 2)
+		return polynomial(form.base, form.coefficients);
+
+	if (n.pure && allConstant)
+	{
+		const NativeFunction& native = isOperator ? _functionContext.operatorTable(PRECISION_FULL)[id - 1]
+				: _functionContext.functionTable(PRECISION_FULL)[id - 1];
+
+		if (native.kind() == NativeFunction::CALL_UNARY)
+			return constant(native.unaryTarget()(_nodes[n.arguments[0]].value));
+		if (native.kind() == NativeFunction::CALL_BINARY)
+			return constant(native.binaryTarget()(_nodes[n.arguments[0]].value, _nodes[n.arguments[1]].value));
+	}
+
+	unsigned int index = intern(n);
+
+	if (isPolynomial && form.coefficients.size() == 2 && _linearForms.count(index) == 0)
+		_linearForms[index] = form;
+
+	//Later reads of a written variable must not be merged with earlier ones. The default operators
+	//only write the variables they are passed; anything else may write any variable.
+	if (n.sideEffects && builtin && isOperator)
+	{
+		for (unsigned int i = 0; i < n.arguments.size(); i++)
+			if (_nodes[n.arguments[i]].type == NODE_REFERENCE)
+				_variableVersions[_nodes[n.arguments[i]].id]++;
+	}
+	else if (n.sideEffects)
+	{
+		for (auto it = _variableVersions.begin(); it != _variableVersions.end(); ++it)
+			it->second++;
+	}
+
+	return index;
+}
+
+ExpressionGraph::Polynomial ExpressionGraph::polynomialForm(unsigned int node) const
+{
+	const Node& n = _nodes[node];
+	Polynomial p;
+
+	if (n.type == NODE_CONSTANT)
+	{
+		p.base = UINT_MAX;
+		p.coefficients.push_back(n.value);
+	}
+	else if (n.type == NODE_POLYNOMIAL)
+	{
+		p.base = n.arguments[0];
+		p.coefficients = n.coefficients;
+	}
+	else
+	{
+		auto it = _linearForms.find(node);
+
+		if (it != _linearForms.end())
+			return it->second;
+
+		p.base = node;
+		p.coefficients.push_back(0.0);
+		p.coefficients.push_back(1.0);
+	}
+
+	return p;
+}
+
+/** \brief Works out the polynomial computed by a default arithmetic operator from the polynomials of its operands
+ *
+ * Only sums of terms written as c*x^k are collected: a power or a product must be of single terms
+ * or by a constant, so no factored form is ever expanded.
+ *
+ * \param op			The operator
+ * \param arguments		Its operands
+ * \param result		Receives the polynomial
+ * \return				Whether the result is a polynomial in a single node of at most POLYNOMIAL_MAX_DEGREE
+ *
+ */
+bool ExpressionGraph::combinePolynomials(const Operator& op, const std::vector<unsigned int>& arguments, Polynomial& result) const
+{
+	const std::string& symbol = op.symbol();
+
+	if (op.position() == Operator::POS_PREFIX)
+	{
+		if (symbol != "-" && symbol != "+")
+			return false;
+
+		result = polynomialForm(arguments[0]);
+
+		if (symbol == "-")
+			for (unsigned int i = 0; i < result.coefficients.size(); i++)
+				result.coefficients[i] = -result.coefficients[i];
+
+		return result.base != UINT_MAX;
+	}
+
+	if (op.position() != Operator::POS_INFIX || (symbol != "+" && symbol != "-" && symbol != "*" && symbol != "^"))
+		return false;
+
+	Polynomial a = polynomialForm(arguments[0]);
+	Polynomial b = polynomialForm(arguments[1]);
+
+	//Only single terms are raised to powers or multiplied together. Expanding (x - 1)^8 or a product
+	//of factors would trade a well conditioned form for one that cancels catastrophically near the roots.
+	if (symbol == "^")
+	{
+		double exponent = b.base == UINT_MAX ? b.coefficients[0] : -1.0;
+
+		if (a.base == UINT_MAX || !isMonomial(a.coefficients) || !(exponent >= 1.0) ||
+				exponent > std::floor(exponent) || (a.coefficients.size() - 1) * exponent > POLYNOMIAL_MAX_DEGREE)
+			return false;
+
+		unsigned int power = static_cast<unsigned int>(exponent);
+
+		result.base = a.base;
+		result.coefficients.assign((a.coefficients.size() - 1) * power + 1, 0.0);
+		result.coefficients.back() = std::pow(a.coefficients.back(), power);
+
+		return true;
+	}
+
+	if (a.base != UINT_MAX && b.base != UINT_MAX && a.base != b.base)
+		return false;
+
+	result.base = a.base != UINT_MAX ? a.base : b.base;
+
+	if (symbol == "*")
+	{
+		bool scaled = a.base == UINT_MAX || b.base == UINT_MAX;
+
+		if ((!scaled && !(isMonomial(a.coefficients) && isMonomial(b.coefficients))) ||
+				a.coefficients.size() + b.coefficients.size() - 2 > POLYNOMIAL_MAX_DEGREE)
+			return false;
+
+		result.coefficients.assign(a.coefficients.size() + b.coefficients.size() - 1, 0.0);
+
+		for (unsigned int i = 0; i < a.coefficients.size(); i++)
+			for (unsigned int j = 0; j < b.coefficients.size(); j++)
+				result.coefficients[i + j] += a.coefficients[i] * b.coefficients[j];
+	}
+	else
+	{
+		double sign = symbol == "-" ? -1.0 : 1.0;
+
+		result.coefficients.assign(std::max(a.coefficients.size(), b.coefficients.size()), 0.0);
+
+		for (unsigned int i = 0; i < a.coefficients.size(); i++)
+			result.coefficients[i] += a.coefficients[i];
+
+		for (unsigned int i = 0; i < b.coefficients.size(); i++)
+			result.coefficients[i] += sign * b.coefficients[i];
+	}
+
+	//Cancelled terms leave nothing to rewrite
+	while (result.coefficients.size() > 1 && std::fpclassify(result.coefficients.back()) == FP_ZERO)
+		result.coefficients.pop_back();
+
+	return result.coefficients.size() >= 2;
+}
+
+/** \brief Replaces a default assignment operator by the value it would store
+ *
+ * \param op			One of the default assignment, compound assignment, increment or decrement operators
+ * \param arguments	The variable reference, followed by the assigned value for infix operators
+ * \return			The node holding the value of the assignment expression
+ *
+ */
+unsigned int ExpressionGraph::forwardAssignment(const Operator& op, const std::vector<unsigned int>& arguments)
+{
+	unsigned int variableId = _nodes[arguments[0]].id;
+	const std::string& symbol = op.symbol();
+	unsigned int result;
+
+	if (op.position() == Operator::POS_INFIX)
+	{
+		if (symbol == "=")
+			result = arguments[1];
+		else
+		{
+			//"+=" combines with "+", and so on
+			unsigned int combine = _functionContext.getOperatorID(symbol.substr(0, symbol.size() - 1), Operator::POS_INFIX);
+			assert(combine != NULLID);
+
+			result = call(true, combine, std::vector<unsigned int>{ load(variableId), arguments[1] });
+		}
+
+		_forwardedValues[variableId] = result;
+	}
+	else
+	{
+		unsigned int combine = _functionContext.getOperatorID(symbol.substr(0, 1), Operator::POS_INFIX);
+		unsigned int previous = load(variableId);
+		unsigned int next = call(true, combine, std::vector<unsigned int>{ previous, constant(1.0) });
+
+		_forwardedValues[variableId] = next;
+		result = op.position() == Operator::POS_POSTFIX ? previous : next;
+	}
+
+	_pendingStores.insert(variableId);
+	return result;
+}
+
+/** \brief Adds a node storing a value into a variable with the default assignment operator
+ *
+ * \param variableId	The variable to write
+ * \param value			The node holding the value
+ *
+ */
+void ExpressionGraph::store(unsigned int variableId, unsigned int value)
+{
+	Node n;
+	n.type = NODE_CALL;
+	n.isOperator = true;
+	n.pure = false;
+	n.sideEffects = true;
+	n.effects = EFFECT_WRITES_CONTEXT;
+	n.id = _functionContext.getOperatorID("=", Operator::POS_INFIX);
+	n.version = 0;
+	n.value = 0.0;
+	n.arguments.push_back(reference(variableId));
+	n.arguments.push_back(value);
+
+	assert(n.id != NULLID);
+
+	intern(n);
+	_variableVersions[variableId]++;
+	_pendingStores.erase(variableId);
+}
+
+/** \brief Keeps assigned values in the graph instead of storing them into variables
+ *
+ * Applies to nodes added afterwards. Stores that are needed anyway, e.g. before a function that
+ * takes a variable reference, are still made.
+ *
+ * \param writtenBack	IDs of the variables that writeBack() stores
+ *
+ */
+void ExpressionGraph::forwardStores(const std::vector<unsigned int>& writtenBack)
+{
+	_forwardStores = true;
+	_writtenBack = writtenBack;
+}
+
+/** \brief Stores the current values of the written-back variables that were assigned since the last store
+ *
+ * The values of all other assigned variables are discarded.
+ *
+ */
+void ExpressionGraph::writeBack()
+{
+	for (unsigned int i = 0; i < _writtenBack.size(); i++)
+		if (_pendingStores.count(_writtenBack[i]) > 0)
+			store(_writtenBack[i], _forwardedValues[_writtenBack[i]]);
+
+	_pendingStores.clear();
+}
+
+/** \brief Copies the body of a user-defined function into the graph in place of a call to it
+ *
+ * \param definition	The function; its body must be pure
+ * \param arguments		The nodes passed as the function's parameters
+ * \return				The node holding the function's result
+ *
+ */
+unsigned int ExpressionGraph::inlineCall(const UserFunction& definition, const std::vector<unsigned int>& arguments)
+{
+	const ExpressionGraph& body = definition.body();
+	std::vector<bool> live = body.liveNodes();
+	std::vector<unsigned int> nodeMap(body.size(), 0);
+
+	for (unsigned int i = 0; i < body.size(); i++)
+	{
+		if (!live[i])
+			continue;
+
+		const Node& n = body.node(i);
+
+		switch (n.type)
+		{
+			case NODE_CONSTANT:
+				nodeMap[i] = constant(n.value);
+				break;
+
+			case NODE_LOAD:
+			{
+				int parameter = definition.parameterIndex(n.id);
+				nodeMap[i] = parameter >= 0 ? arguments[parameter] : constant(definition.constantValue(n.id));
+				break;
+			}
+
+			case NODE_CALL:
+			{
+				std::vector<unsigned int> callArguments(n.arguments.size());
+
+				for (unsigned int j = 0; j < n.arguments.size(); j++)
+					callArguments[j] = nodeMap[n.arguments[j]];
+
+				nodeMap[i] = call(n.isOperator, n.id, callArguments);
+				break;
+			}
+
+			case NODE_POLYNOMIAL:
+				nodeMap[i] = polynomial(nodeMap[n.arguments[0]], n.coefficients);
+				break;
+
+			default: assert(false);
+		}
+	}
+
+	return nodeMap[body.outputs()[0]];
+}
+
+/** \brief Adds the operations of a parsed expression to the graph
+ *
+ * \param expression	A successfully parsed expression
+ * \return				The node holding the value of the expression's last statement
+ *
+ */
+unsigned int ExpressionGraph::addExpression(const ExpressionParser& expression)
+{
+	return addPostfix(expression.postfixString(), 0, expression.postfixString().size());
+}
+
+/** \brief Adds the operations of part of a postfix string to the graph
+ *
+ * \param postfix		A postfix string built by ExpressionParser
+ * \param first			The first token
+ * \param last			One past the last token
+ * \return				The node holding the value of the last statement
+ *
+ */
+unsigned int ExpressionGraph::addPostfix(const std::vector<Token>& postfix, unsigned int first, unsigned int last)
+{
+	unsigned int derefId = _functionContext.getFunctionID(std::string("_deref"));
+	std::vector<unsigned int> stack;
+
+	for (unsigned int i = first; i < last; i++)
+	{
+		const Token& t = postfix[i];
+
+		switch (t.type())
+		{
+			case Token::NUMBER:
+				stack.push_back(constant(t.toNumber().value()));
+				break;
+
+			case Token::VARIABLE:
+				stack.push_back(reference(t.toVariable().id()));
+				break;
+
+			case Token::FUNCTION:
+			case Token::OPERATOR:
+			{
+				bool isOperator = t.type() == Token::OPERATOR;
+				unsigned int id = isOperator ? t.toOperator().id() : t.toFunction().id();
+
+				if (!isOperator && id == derefId)
+				{
+					assert(_nodes[stack.back()].type == NODE_REFERENCE);
+					stack.back() = load(_nodes[stack.back()].id);
+					break;
+				}
+
+				unsigned int arity = isOperator ? _functionContext.lookupOperator(id)->arity() : t.toFunction().arity();
+				assert(stack.size() >= arity);
+
+				std::vector<unsigned int> arguments(stack.end() - arity, stack.end());
+				stack.resize(stack.size() - arity);
+				stack.push_back(call(isOperator, id, arguments));
+				break;
+			}
+
+			case Token::EXPRESSION:
+			{
+				//The body runs as often as the callee chooses, so it is a graph of its own
+				unsigned int length = t.toExpression().length();
+				std::shared_ptr<ExpressionGraph> body = std::make_shared<ExpressionGraph>(_functionContext);
+
+				body->addOutput(body->addPostfix(postfix, i + 1, i + 1 + length));
+				stack.push_back(subexpression(body));
+				i += length;
+				break;
+			}
+
+			case Token::DELIMITER:
+				stack.clear();
+				break;
+
+			default: assert(false);
+		}
+	}
+
+	if (stack.empty())
+		return constant(0.0);
+
+	assert(stack.size() == 1);
+
+	if (_nodes[stack.back()].type == NODE_REFERENCE)
+		return load(_nodes[stack.back()].id);
+
+	return stack.back();
+}
+
+/** \brief Copies a node of another graph into this one, along with the nodes it depends on
+ *
+ * Reads are copied as reads of the current value, so the source graph should not write the
+ * variables it reads.
+ *
+ * \param source	A graph over the same function context
+ * \param node		The node of source to copy
+ * \param copies	Maps nodes of source to their copies and receives those made; nodes mapped
+ *					beforehand are replaced by what they are mapped to rather than copied
+ * \return			The copy of the node
+ *
+ */
+unsigned int ExpressionGraph::copy(const ExpressionGraph& source, unsigned int node, std::unordered_map<unsigned int, unsigned int>& copies)
+{
+	assert(&source._functionContext == &_functionContext);
+
+	auto found = copies.find(node);
+
+	if (found != copies.end())
+		return found->second;
+
+	const Node& n = source.node(node);
+	unsigned int result = 0;
+
+	switch (n.type)
+	{
+		case NODE_CONSTANT:		result = constant(n.value); break;
+		case NODE_LOAD:			result = load(n.id); break;
+		case NODE_REFERENCE:	result = reference(n.id); break;
+		case NODE_EXPRESSION:	result = subexpression(source._bodies[n.id]); break;
+		case NODE_INPUT:		result = input(source._inputs[n.id]); break;
+
+		case NODE_POLYNOMIAL:
+			result = polynomial(copy(source, n.arguments[0], copies), n.coefficients);
+			break;
+
+		case NODE_CALL:
+		{
+			std::vector<unsigned int> arguments;
+
+			for (unsigned int j = 0; j < n.arguments.size(); j++)
+				arguments.push_back(copy(source, n.arguments[j], copies));
+
+			result = call(n.isOperator, n.id, arguments);
+			break;
+		}
+	}
+
+	copies[node] = result;
+	return result;
+}
+
+void ExpressionGraph::addOutput(unsigned int node)
+{
+	assert(node < _nodes.size() && _nodes[node].type != NODE_REFERENCE);
+	_outputs.push_back(node);
+}
+
+/** \brief Determines which nodes contribute to an output or must run for their effects
+ *
+ * \return		One flag per node
+ *
+ */
+std::vector<bool> ExpressionGraph::liveNodes() const
+{
+	std::vector<bool> live(_nodes.size(), false);
+
+	for (unsigned int i = 0; i < _outputs.size(); i++)
+		live[_outputs[i]] = true;
+
+	for (unsigned int i = 0; i < _nodes.size(); i++)
+		if (!_nodes[i].pure && _nodes[i].type == NODE_CALL)
+			live[i] = true;
+
+	//Arguments always precede their users, so one backwards sweep reaches everything
+	for (unsigned int i = _nodes.size(); i-- > 0; )
+	{
+		if (!live[i])
+			continue;
+
+		for (unsigned int j = 0; j < _nodes[i].arguments.size(); j++)
+			live[_nodes[i].arguments[j]] = true;
+	}
+
+	return live;
+}
+
+/** \brief Returns the union of the Effect flags of the calls that contribute to an output or must run */
+unsigned int ExpressionGraph::effects() const
+{
+	std::vector<bool> live = liveNodes();
+	unsigned int effects = EFFECT_NONE;
+
+	for (unsigned int i = 0; i < _nodes.size(); i++)
+		if (live[i] && _nodes[i].type == NODE_CALL)
+			effects |= _nodes[i].effects;
+
+	return effects;
+}
+
+unsigned int ExpressionGraph::intern(const Node& n)
+{
+	if (!n.pure)
+	{
+		_nodes.push_back(n);
+		return _nodes.size() - 1;
+	}
+
+	std::size_t hash = hashNode(n);
+	auto range = _nodeIndex.equal_range(hash);
+
+	for (auto it = range.first; it != range.second; ++it)
+		if (sameNode(_nodes[it->second], n))
+			return it->second;
+
+	_nodes.push_back(n);
+	_nodeIndex.insert(std::pair<std::size_t, unsigned int>(hash, _nodes.size() - 1));
+
+	return _nodes.size() - 1;
+}
+
+std::size_t ExpressionGraph::hashNode(const Node& n)
+{
+	uint64_t bits;
+	std::memcpy(&bits, &n.value, sizeof(bits));
+
+	std::size_t h = std::hash<uint64_t>()(bits);
+	h = h * 31 + n.type;
+	h = h * 31 + n.isOperator;
+	h = h * 31 + n.id;
+	h = h * 31 + n.version;
+
+	for (unsigned int i = 0; i < n.arguments.size(); i++)
+		h = h * 31 + n.arguments[i];
+
+	for (unsigned int i = 0; i < n.coefficients.size(); i++)
+	{
+		std::memcpy(&bits, &n.coefficients[i], sizeof(bits));
+		h = h * 31 + std::hash<uint64_t>()(bits);
+	}
+
+	return h;
+}
+
+bool ExpressionGraph::sameNode(const Node& a, const Node& b)
+{
+	//Constants are compared bitwise so that 0.0 and -0.0 stay distinct
+	return a.type == b.type && a.isOperator == b.isOperator && a.id == b.id && a.version == b.version &&
+			std::memcmp(&a.value, &b.value, sizeof(double)) == 0 && a.arguments == b.arguments &&
+			a.coefficients.size() == b.coefficients.size() &&
+			(a.coefficients.empty() || std::memcmp(a.coefficients.data(), b.coefficients.data(), a.coefficients.size() * sizeof(double)) == 0);
+}
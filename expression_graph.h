@@ -0,0 +1,154 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef EXPRESSION_GRAPH_H
+#define EXPRESSION_GRAPH_H
+
+#include	<map>
+#include	<set>
+#include	<vector>
+#include	<memory>
+#include	<unordered_map>
+
+#include	"context.h"
+#include	"token.h"
+
+#define	POLYNOMIAL_MAX_DEGREE		16
+
+class ExpressionParser;
+class UserFunction;
+
+/** A directed acyclic graph of operations, shared by every expression added to it.
+ *
+ *  Nodes are hash-consed: asking for a pure node that already exists returns the existing one, so
+ *  common subexpressions and repeated variable reads collapse into a single node. Reads are keyed
+ *  on how many writes to the variable precede them, which keeps them correct across assignments.
+ *  Node indices are always a valid evaluation order. Calls to small user-defined functions are
+ *  replaced by a copy of the function's body. Sums of terms c*x^k with constant coefficients
+ *  that form a polynomial of degree two or more in a single node x are replaced by one polynomial
+ *  node, evaluated in Horner or Estrin form. Factored forms such as (x - 1)^8 are kept as written.
+ *
+ *  Arguments passed unevaluated to HAND_EXPRESSION parameters get a graph of their own, named by
+ *  a NODE_EXPRESSION node. A call taking one has the effects of the callee and of the body.
+ *
+ *  Values the caller computes itself, such as intermediate results, are read with input() from
+ *  storage the caller owns, so they need no variable. The storage must outlive every Program
+ *  compiled from the graph.
+ *
+ *  After forwardStores(), assignments with the default assignment operators no longer write the
+ *  variable: later reads use the assigned value directly, and writeBack() stores only the
+ *  variables the caller asked for. Temporaries of multi-statement scripts thus stay in registers,
+ *  and assignments that are overwritten or never read are dropped.
+ */
+class ExpressionGraph
+{
+	public:
+		typedef enum NodeType
+		{
+			NODE_CONSTANT,
+			NODE_LOAD,			/**< Reads the value of a variable */
+			NODE_REFERENCE,		/**< Names a variable passed to a HAND_LVALUE parameter */
+			NODE_CALL,			/**< Calls an operator or function */
+			NODE_POLYNOMIAL,	/**< Evaluates coefficients[0] + coefficients[1] * x + ... where x is the only argument */
+			NODE_EXPRESSION,	/**< Names a sub-expression passed to a HAND_EXPRESSION parameter; id indexes the bodies */
+			NODE_INPUT			/**< Reads a value from storage owned by the caller rather than a variable; id indexes the inputs */
+		} NodeType;
+
+		struct Node
+		{
+			NodeType type;
+			bool isOperator;		/**< NODE_CALL: whether id is an operator ID rather than a function ID */
+			bool pure;				/**< May be merged with identical nodes, folded, and dropped when unused */
+			bool sideEffects;		/**< Writes a variable, so it must run and keep its place relative to other writes */
+			unsigned int effects;	/**< NODE_CALL: the callee's Effect flags; pure exactly when there are none */
+			unsigned int id;		/**< Variable ID for loads and references, operator or function ID for calls */
+			unsigned int version;	/**< NODE_LOAD: the number of writes to the variable that precede the read */
+			double value;			/**< NODE_CONSTANT: the value */
+			std::vector<unsigned int> arguments;
+			std::vector<double> coefficients;	/**< NODE_POLYNOMIAL: lowest degree first; the last one is not zero */
+		};
+
+	private:
+		struct Polynomial
+		{
+			unsigned int base;		/**< The node the polynomial is in, or UINT_MAX for a constant */
+			std::vector<double> coefficients;
+		};
+
+		const FunctionContext& _functionContext;
+		std::vector<Node> _nodes;
+		std::unordered_multimap<std::size_t, unsigned int> _nodeIndex;
+		std::unordered_map<unsigned int, unsigned int> _variableVersions;
+		std::vector<unsigned int> _outputs;
+		std::unordered_map<unsigned int, Polynomial> _linearForms;		/**< Calls computing a first degree polynomial */
+		std::vector<std::shared_ptr<const ExpressionGraph> > _bodies;	/**< Graphs of the sub-expressions passed unevaluated */
+		std::vector<const double*> _inputs;								/**< Locations read by NODE_INPUT nodes */
+
+		bool _forwardStores;
+		std::vector<unsigned int> _writtenBack;
+		std::map<unsigned int, unsigned int> _forwardedValues;	/**< Variable ID to the node holding its current value */
+		std::set<unsigned int> _pendingStores;					/**< Variables whose forwarded value has not been stored */
+
+	public:
+		ExpressionGraph(const FunctionContext& fc);
+
+		unsigned int constant(double value);
+		unsigned int load(unsigned int variableId);
+		unsigned int reference(unsigned int variableId);
+		unsigned int polynomial(unsigned int base, const std::vector<double>& coefficients);
+		unsigned int subexpression(const std::shared_ptr<const ExpressionGraph>& body);
+		unsigned int input(const double* location);
+		unsigned int callOperator(unsigned int operatorId, const std::vector<unsigned int>& arguments);
+		unsigned int callFunction(unsigned int functionId, const std::vector<unsigned int>& arguments);
+
+		unsigned int addExpression(const ExpressionParser& expression);
+		unsigned int copy(const ExpressionGraph& source, unsigned int node, std::unordered_map<unsigned int, unsigned int>& copies);
+		void addOutput(unsigned int node);
+
+		void forwardStores(const std::vector<unsigned int>& writtenBack);
+		void writeBack();
+
+		const Node& node(unsigned int index) const { assert(index < _nodes.size()); return _nodes[index]; }
+		unsigned int size() const { return _nodes.size(); }
+		const std::vector<unsigned int>& outputs() const { return _outputs; }
+		const FunctionContext& functionContext() const { return _functionContext; }
+
+		const Function* callee(const Node& n) const
+		{
+			assert(n.type == NODE_CALL);
+			return n.isOperator ? _functionContext.lookupOperator(n.id) : _functionContext.lookupFunction(n.id);
+		}
+
+		/** \brief Returns the graph of a sub-expression passed unevaluated */
+		const ExpressionGraph& body(const Node& n) const
+		{
+			assert(n.type == NODE_EXPRESSION && n.id < _bodies.size());
+			return *_bodies[n.id];
+		}
+
+		/** \brief Returns the location read by an input node */
+		const double* inputLocation(const Node& n) const
+		{
+			assert(n.type == NODE_INPUT && n.id < _inputs.size());
+			return _inputs[n.id];
+		}
+
+		std::vector<bool> liveNodes() const;
+		unsigned int effects() const;
+
+	private:
+		unsigned int addPostfix(const std::vector<Token>& postfix, unsigned int first, unsigned int last);
+		unsigned int call(bool isOperator, unsigned int id, const std::vector<unsigned int>& arguments);
+		Polynomial polynomialForm(unsigned int node) const;
+		bool combinePolynomials(const Operator& op, const std::vector<unsigned int>& arguments, Polynomial& result) const;
+		unsigned int forwardAssignment(const Operator& op, const std::vector<unsigned int>& arguments);
+		void store(unsigned int variableId, unsigned int value);
+		unsigned int inlineCall(const UserFunction& definition, const std::vector<unsigned int>& arguments);
+		unsigned int intern(const Node& n);
+		static std::size_t hashNode(const Node& n);
+		static bool sameNode(const Node& a, const Node& b);
+};
+
+#endif
@@ -11,9 +11,11 @@
 #include	<stack>
 #include	<assert.h>
 #include	<algorithm>
+#include	<iostream>
 
 #include	"tokenizer.h"
 #include	"argument_list.h"
+#include	"bytecode.h"
 
 class ExpressionParser
 {
@@ -23,116 +25,189 @@ class ExpressionParser
 		std::vector<Token> _postfixString;
 		std::vector<unsigned int> argumentIndexStack;
 		std::vector<unsigned int> varDereferencerIndexes; //Keeps track of locations in postfix string to insert variable dereferencer function calls
+		std::vector<std::pair<unsigned int, unsigned int> > expressionRanges; //First and last tokens of arguments passed unevaluated
 		VariableContext& _variableContext;
 		const FunctionContext& _functionContext;
+		Precision _precision;
+		bool _flushDenormals;
+		bool _createsVariables;
+		unsigned int _derefFunctionId;
+		ParseResult _parseResult;
+		Bytecode _bytecode;
 
 		bool isPostfixStringBuilt; //For ensuring buildPostfixString() is only ever called once
 
 		//TODO: document high level algorithm
 
 	public:
+		/** \brief Parses an expression, throwing a TokenizerException if it is malformed
+		 *
+		 * \param expr	The expression to parse
+		 * \param vc		The variable context that variable names are resolved in
+		 * \param fc		The function context that operators and functions are resolved in
+		 *
+		 */
 		ExpressionParser(const std::string& expr, VariableContext& vc, const FunctionContext& fc) :
 			_expression(expr),
 			_variableContext(vc),
 			_functionContext(fc),
+			_precision(fc.precision()),
+			_flushDenormals(fc.flushDenormals()),
+			_createsVariables(true),
+			_derefFunctionId(fc.getFunctionID(std::string("_deref"))),
 			isPostfixStringBuilt(false)
 		{
-			//_shuntStack.reserve(20);
-			//Reserve space for efficiency by reducing number of reallocations
-			_postfixString.reserve(50);
-			argumentIndexStack.reserve(10);
-			varDereferencerIndexes.reserve(10);
+			initialize();
 
-			buildPostfixString();
+			if (_parseResult.failed())
+				throwParseError(_parseResult);
+
+			compile();
 		}
 
-		void printPostfixString()
+		/** \brief Parses an expression without throwing on malformed input
+		 *
+		 * If parsing fails, the error is stored in result and evaluate() returns 0.
+		 *
+		 * \param expr	The expression to parse
+		 * \param vc		The variable context that variable names are resolved in
+		 * \param fc		The function context that operators and functions are resolved in
+		 * \param result	Receives the outcome of parsing
+		 *
+		 */
+		ExpressionParser(const std::string& expr, VariableContext& vc, const FunctionContext& fc, ParseResult& result) :
+			_expression(expr),
+			_variableContext(vc),
+			_functionContext(fc),
+			_precision(fc.precision()),
+			_flushDenormals(fc.flushDenormals()),
+			_createsVariables(true),
+			_derefFunctionId(fc.getFunctionID(std::string("_deref"))),
+			isPostfixStringBuilt(false)
 		{
-			for (auto it = _postfixString.begin(); it != _postfixString.end(); ++it)
-			{
-				std::cout << Exparse::util::tokenToString(*it, _functionContext, _variableContext) << " ";
-			}
+			initialize();
+			compile();
+			result = _parseResult;
+		}
 
-			std::cout << std::endl;
+		/** \brief Wraps a postfix string built without parsing, e.g. by ExpressionBuilder
+		 *
+		 * \param postfix	Tokens in evaluation order, with variables passed to HAND_RVALUE
+		 *					parameters already wrapped in calls to _deref
+		 * \param vc		The variable context the variable IDs belong to
+		 * \param fc		The function context the operator and function IDs belong to
+		 *
+		 */
+		ExpressionParser(std::vector<Token> postfix, VariableContext& vc, const FunctionContext& fc) :
+			_postfixString(std::move(postfix)),
+			_variableContext(vc),
+			_functionContext(fc),
+			_precision(fc.precision()),
+			_flushDenormals(fc.flushDenormals()),
+			_createsVariables(true),
+			_derefFunctionId(fc.getFunctionID(std::string("_deref"))),
+			isPostfixStringBuilt(true)
+		{
+			compile();
 		}
 
-		double evaluate()
+		/** \brief Checks whether an expression is well-formed without throwing
+		 *
+		 * \param expr	The expression to check
+		 * \param vc		The variable context the expression is meant for; names are looked up but never created
+		 * \param fc		The function context that operators and functions are resolved in
+		 * \return		The outcome of parsing, with the error code and column if the expression is malformed
+		 *
+		 */
+		static ParseResult validate(const std::string& expr, VariableContext& vc, const FunctionContext& fc)
 		{
-			std::vector<Value> resultStack;
+			ExpressionParser parser(expr, vc, fc, false);
+			return parser._parseResult;
+		}
 
-			resultStack.reserve(20);
+		const ParseResult& parseResult() const { return _parseResult; }
 
-			for (unsigned int i = 0; i < _postfixString.size(); i++)
-			{
-				Token t = _postfixString[i];
+		const std::vector<Token>& postfixString() const { return _postfixString; }
+		const Bytecode& bytecode() const { return _bytecode; }
+		VariableContext& variableContext() const { return _variableContext; }
+		const FunctionContext& functionContext() const { return _functionContext; }
 
-				switch (t.type())
-				{
-					case Token::NUMBER:
-						resultStack.push_back(Value(t.toNumber().value()));
-						break;
-					case Token::VARIABLE:
-						resultStack.push_back(Value(t.toVariable().id()));
-						break;
-					case Token::FUNCTION:
-					case Token::OPERATOR:
-					{
-						//TODO: this code seems to be repeated a few times. clean it up?
-						const Function* func = nullptr;
-						unsigned int funcArity;
+		/** \brief Overrides the precision tier inherited from the function context for this expression
+		 *
+		 * \param p	PRECISION_FULL for libm results, PRECISION_FAST for the approximations in Exparse::fastmath
+		 *
+		 */
+		void setPrecision(Precision p)
+		{
+			_precision = p;
+			compile();
+		}
+		Precision precision() const { return _precision; }
 
-						switch (t.type())
-						{
-							case Token::OPERATOR:
-								func = _functionContext.lookupOperator(t.toOperator().id());
-								funcArity = func->arity();
-								break;
+		/** \brief Enables flush-to-zero/denormals-are-zero mode while this expression is evaluated
+		 *
+		 * \param enable	Whether denormal inputs and results should be treated as zero
+		 *
+		 */
+		void setFlushDenormals(bool enable) { _flushDenormals = enable; }
+		bool flushDenormals() const { return _flushDenormals; }
 
-							case Token::FUNCTION:
-								func = _functionContext.lookupFunction(t.toFunction().id());
-								funcArity = t.toFunction().arity();
-								break;
+		void printPostfixString()
+		{
+			for (auto it = _postfixString.begin(); it != _postfixString.end(); ++it)
+			{
+				std::cout << Exparse::util::tokenToString(*it, _functionContext, _variableContext) << " ";
+			}
 
-							default: break;
-						}
+			std::cout << std::endl;
+		}
 
-						ArgumentList args(resultStack.end() - funcArity, resultStack.end(), _variableContext);
-						Value result = func->execute(args);
+		double evaluate()
+		{
+			Exparse::DenormalFlushGuard fpGuard(_flushDenormals);
+			return _bytecode.run(_variableContext);
+		}
 
-						//Pop arguments off the stack since they have been consumed
-						resultStack.resize(resultStack.size() - funcArity);
+	private:
+		/** \brief Only builds the postfix string, for validate(); the result cannot be evaluated */
+		ExpressionParser(const std::string& expr, VariableContext& vc, const FunctionContext& fc, bool createVariables) :
+			_expression(expr),
+			_variableContext(vc),
+			_functionContext(fc),
+			_precision(fc.precision()),
+			_flushDenormals(fc.flushDenormals()),
+			_createsVariables(createVariables),
+			_derefFunctionId(fc.getFunctionID(std::string("_deref"))),
+			isPostfixStringBuilt(false)
+		{
+			initialize();
+		}
 
-						resultStack.push_back(result);
+		void compile()
+		{
+			//Evaluation runs fused stack code rather than walking the tokens, see Bytecode
+			_bytecode = Bytecode(_postfixString, _functionContext, _precision);
+		}
 
-						break;
-					}
-					case Token::DELIMITER:
-					{
-						if (!resultStack.empty())
-							resultStack.pop_back();
+		void initialize()
+		{
+			//_shuntStack.reserve(20);
+			//Reserve space for efficiency by reducing number of reallocations
+			_postfixString.reserve(50);
+			argumentIndexStack.reserve(10);
+			varDereferencerIndexes.reserve(10);
 
-						assert(resultStack.empty());
-						break;
-					}
-					default: assert(false);
-				}
-			}
+			buildPostfixString();
 
-			if (resultStack.empty())
-				return 0.0;
-			else
-			{
-				assert(resultStack.size() == 1);
-				return resultStack.back().numeric;
-			}
+			if (_parseResult.failed())
+				_postfixString.clear();
 		}
 
-	private:
 		void buildPostfixString()
 		{
 			assert(!isPostfixStringBuilt);
 
-			Tokenizer tokenizer(_expression, _functionContext, _variableContext);
+			Tokenizer tokenizer(_expression, _functionContext, _variableContext, _createsVariables);
 			Token t;
 
 			do
@@ -141,10 +216,16 @@ class ExpressionParser
 
 				if (t.type() == Token::END)
 				{
+					if (tokenizer.result().failed())
+					{
+						_parseResult = tokenizer.result();
+						return;
+					}
+
 					popStackUntilEmpty();
 
 					//insert dereferencer for final result if it's an LVALUE, so that the numeric result may be printed
-					if (_postfixString.back().type() != Token::DELIMITER &&
+					if (!_postfixString.empty() && _postfixString.back().type() != Token::DELIMITER &&
 							determineHandedness(_postfixString.back()) == HAND_LVALUE)
 						varDereferencerIndexes.push_back(_postfixString.size() - 1);
 
@@ -185,7 +266,8 @@ class ExpressionParser
 						const OperatorToken& ot1 = t.toOperator();
 						const Operator* op1 = _functionContext.lookupOperator(ot1.id());
 
-						while (_shuntStack.size() > 0 && _shuntStack.top().type() == Token::OPERATOR)
+						//A prefix operator has no left operand yet, so it cannot complete any operator already on the stack
+						while (op1->position() != Operator::POS_PREFIX && _shuntStack.size() > 0 && _shuntStack.top().type() == Token::OPERATOR)
 						{
 							const OperatorToken& ot2 = _shuntStack.top().toOperator();
 							const Operator* op2 = _functionContext.lookupOperator(ot2.id());
@@ -226,6 +308,9 @@ class ExpressionParser
 
 					default: assert(false);
 				}
+
+				if (_parseResult.failed())
+					return;
 			} while (1);
 
 			std::sort(varDereferencerIndexes.begin(), varDereferencerIndexes.end());
@@ -240,21 +325,41 @@ class ExpressionParser
 			at the end, consider checking arguments and inserting these calls as arguments are parsed.
 			I don't think this would be easy since backtracking is involved*/
 
+			//Sub-expressions are marked in front of their first token, enclosing ones first
+			std::sort(expressionRanges.begin(), expressionRanges.end(),
+					[](const std::pair<unsigned int, unsigned int>& a, const std::pair<unsigned int, unsigned int>& b)
+					{ return a.first < b.first || (a.first == b.first && a.second > b.second); });
+
 			std::vector<Token> newPostfixString;
-			newPostfixString.reserve(_postfixString.size() + varDereferencerIndexes.size());
+			std::vector<std::pair<unsigned int, unsigned int> > openExpressions; //Marker positions and the last token of their bodies
+			newPostfixString.reserve(_postfixString.size() + varDereferencerIndexes.size() + expressionRanges.size());
 
-			for (unsigned int i = 0, vdi = 0; i < _postfixString.size(); i++)
+			for (unsigned int i = 0, vdi = 0, eri = 0; i < _postfixString.size(); i++)
 			{
+				while (eri < expressionRanges.size() && expressionRanges[eri].first == i)
+				{
+					openExpressions.push_back(std::make_pair(newPostfixString.size(), expressionRanges[eri].second));
+					newPostfixString.push_back(Token(ExpressionToken(0), _postfixString[i].location()));
+					eri++;
+				}
+
 				newPostfixString.push_back(_postfixString[i]);
 
 				if (vdi < varDereferencerIndexes.size() && i == varDereferencerIndexes[vdi])
 				{
 					//Insert call to hidden _deref function that returns the value stored in a variable
-					newPostfixString.push_back(Token(FunctionToken(_functionContext.getFunctionID(std::string("_deref"))), -1));
+					newPostfixString.push_back(Token(FunctionToken(_derefFunctionId), -1));
 					newPostfixString.back().toFunction().setArity(1);
 					vdi++;
 				}
 
+				//The length of a body counts the calls to _deref inserted into it
+				while (!openExpressions.empty() && openExpressions.back().second == i)
+				{
+					unsigned int marker = openExpressions.back().first;
+					newPostfixString[marker].toExpression().setLength(newPostfixString.size() - marker - 1);
+					openExpressions.pop_back();
+				}
 			}
 
 			_postfixString.swap(newPostfixString);
@@ -320,10 +425,19 @@ class ExpressionParser
 				Token& argToken = _postfixString[tokenIndex];
 				Handedness argHandedness = determineHandedness(argToken);
 
-				if (argHandedness == HAND_LVALUE && func->argumentHandedness(i) == HAND_RVALUE)
+				if (func->argumentHandedness(i) == HAND_EXPRESSION)
+				{
+					//The body is everything after the previous argument, and evaluates to a number like any other expression
+					assert(i > 0);
+					expressionRanges.push_back(std::make_pair(argumentIndexStack[j - 1] + 1, tokenIndex));
+
+					if (argHandedness == HAND_LVALUE)
+						varDereferencerIndexes.push_back(tokenIndex);
+				}
+				else if (argHandedness == HAND_LVALUE && func->argumentHandedness(i) == HAND_RVALUE)
 					varDereferencerIndexes.push_back(tokenIndex);
-				else if (argHandedness != func->argumentHandedness(i))
-					throw InvalidArgumentException(t, i, _functionContext);
+				else if (argHandedness != func->argumentHandedness(i) && _parseResult.succeeded())
+					_parseResult = ParseResult::invalidArgument(t, i, _functionContext);
 			}
 
 			argumentIndexStack.resize(argumentIndexStack.size() - funcArity);
@@ -27,6 +27,7 @@ namespace Exparse
 				case Token::OPERATOR:		return std::string("OPERATOR");
 				case Token::END:			return std::string("END");
 				case Token::DELIMITER:		return std::string("DELIMITER");
+				case Token::EXPRESSION:		return std::string("EXPRESSION");
 				default: 					return std::string("UNKNOWN");
 			}
 
@@ -86,6 +87,14 @@ namespace Exparse
 					}
 				}
 
+				case Token::EXPRESSION:
+				{
+					//Marks the start of an unevaluated argument; the body's tokens follow it
+					std::stringstream exprstr;
+					exprstr << "{" << t.toExpression().length() << "}";
+					return exprstr.str();
+				}
+
 				default: assert(false);
 			}
 
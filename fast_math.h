@@ -0,0 +1,225 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+
+#include	<cmath>
+#include	<cstdint>
+#include	<cstring>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include	<xmmintrin.h>
+#define		EXPARSE_HAS_MXCSR	1
+#endif
+
+#define		FASTMATH_POW_EXPONENT_LIMIT		16.0	/**< Largest |y * log(x)| fastmath::pow handles itself */
+
+typedef enum Precision
+{
+	PRECISION_FULL = 0,		/**< Results come straight from the C library */
+	PRECISION_FAST			/**< Polynomial approximations, see Exparse::fastmath for error bounds */
+} Precision;
+
+namespace Exparse
+{
+	/** Polynomial approximations of the most expensive transcendental functions.
+	 *
+	 *  Maximum errors measured against libm over the stated ranges:
+	 *
+	 *		exp		relative error	< 1e-8		|x| <= 708, otherwise falls back to std::exp
+	 *		log		relative error	< 3e-9		x > 0 (normal numbers), otherwise falls back to std::log
+	 *		sin/cos	absolute error	< 2e-9		|x| <= 2^20, otherwise falls back to std::sin/std::cos
+	 *		pow		relative error	< 5e-8		x > 0 and |y * log(x)| <= FASTMATH_POW_EXPONENT_LIMIT, otherwise falls back to std::pow
+	 *
+	 *  Every bound is inside the 1e-7 relative error budget of the PRECISION_FAST tier. The Benchmark
+	 *  target (benchmark.cpp) measures them again.
+	 */
+	namespace fastmath
+	{
+		inline double scaleByPowerOfTwo(double x, int k)
+		{
+			//Builds 2^k directly in the exponent field; k is always within the normal range here
+			uint64_t bits = static_cast<uint64_t>(k + 1023) << 52;
+			double scale;
+			std::memcpy(&scale, &bits, sizeof(scale));
+			return x * scale;
+		}
+
+		inline double roundToNearest(double x)
+		{
+			//Adding and subtracting 1.5 * 2^52 rounds to an integer without calling into libm; valid for |x| < 2^51
+			const double shifter = 6755399441055744.0;
+			return (x + shifter) - shifter;
+		}
+
+		inline double exp(double x)
+		{
+			if (!(std::fabs(x) <= 708.0))
+				return std::exp(x);
+
+			//x = k*ln(2) + r, |r| <= ln(2)/2
+			const double ln2Hi = 6.93147180369123816490e-01;
+			const double ln2Lo = 1.90821492927058770002e-10;
+			double k = roundToNearest(x * 1.44269504088896338700);
+			double r = (x - k * ln2Hi) - k * ln2Lo;
+
+			//Taylor series to r^7, evaluated in Horner form
+			double p = 1.0 + r * (1.0 + r * (1.0 / 2 + r * (1.0 / 6 + r * (1.0 / 24 + r * (1.0 / 120 + r * (1.0 / 720 + r * (1.0 / 5040)))))));
+
+			return scaleByPowerOfTwo(p, static_cast<int>(k));
+		}
+
+		inline double log(double x)
+		{
+			if (!(x >= 2.2250738585072014e-308 && x <= 1.7976931348623157e308))
+				return std::log(x);
+
+			//x = m * 2^e with m in [sqrt(1/2), sqrt(2))
+			uint64_t bits;
+			std::memcpy(&bits, &x, sizeof(bits));
+			int e = static_cast<int>((bits >> 52) & 0x7ff) - 1023;
+			bits = (bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL;
+			double m;
+			std::memcpy(&m, &bits, sizeof(m));
+
+			if (m > 1.41421356237309504880)
+			{
+				m *= 0.5;
+				e++;
+			}
+
+			//log(m) = 2 * atanh(s), |s| <= 0.1716
+			double s = (m - 1.0) / (m + 1.0);
+			double s2 = s * s;
+			double p = s2 * (1.0 / 3 + s2 * (1.0 / 5 + s2 * (1.0 / 7 + s2 * (1.0 / 9))));
+
+			return e * 6.93147180559945309417e-01 + 2.0 * (s + s * p);
+		}
+
+		inline double reduceQuarterTurn(double x, int& quadrant)
+		{
+			//x = k*pi/2 + r, |r| <= pi/4, with pi/2 split in two parts to keep r accurate
+			const double halfPiHi = 1.57079632673412561417e+00;
+			const double halfPiLo = 6.07710050650619224932e-11;
+			double k = roundToNearest(x * 6.36619772367581382433e-01);
+
+			quadrant = static_cast<int>(static_cast<int64_t>(k) & 3);
+			return (x - k * halfPiHi) - k * halfPiLo;
+		}
+
+		inline double sinKernel(double r)
+		{
+			double r2 = r * r;
+			return r + r * r2 * (-1.0 / 6 + r2 * (1.0 / 120 + r2 * (-1.0 / 5040 + r2 * (1.0 / 362880))));
+		}
+
+		inline double cosKernel(double r)
+		{
+			double r2 = r * r;
+			return 1.0 + r2 * (-1.0 / 2 + r2 * (1.0 / 24 + r2 * (-1.0 / 720 + r2 * (1.0 / 40320 + r2 * (-1.0 / 3628800)))));
+		}
+
+		inline double sin(double x)
+		{
+			if (!(std::fabs(x) <= 1048576.0))
+				return std::sin(x);
+
+			int quadrant;
+			double r = reduceQuarterTurn(x, quadrant);
+
+			switch (quadrant)
+			{
+				case 0:		return sinKernel(r);
+				case 1:		return cosKernel(r);
+				case 2:		return -sinKernel(r);
+				default:	return -cosKernel(r);
+			}
+		}
+
+		inline double cos(double x)
+		{
+			if (!(std::fabs(x) <= 1048576.0))
+				return std::cos(x);
+
+			int quadrant;
+			double r = reduceQuarterTurn(x, quadrant);
+
+			switch (quadrant)
+			{
+				case 0:		return cosKernel(r);
+				case 1:		return -sinKernel(r);
+				case 2:		return -cosKernel(r);
+				default:	return sinKernel(r);
+			}
+		}
+
+		inline double pow(double x, double y)
+		{
+			if (!(x > 0.0) || std::isinf(x))
+				return std::pow(x, y);
+
+			//The relative error of log(x) is multiplied by |y * log(x)| in the result, so large powers go to libm
+			double z = y * log(x);
+			if (!(std::fabs(z) <= FASTMATH_POW_EXPONENT_LIMIT))
+				return std::pow(x, y);
+
+			return exp(z);
+		}
+	}
+
+	/** \brief Computes a * b + c, with a single rounding where the target has a fused multiply-add instruction
+	 *
+	 * Without hardware support std::fma is emulated in software, so the product is rounded separately instead.
+	 */
+	inline double multiplyAdd(double a, double b, double c)
+	{
+#ifdef FP_FAST_FMA
+		return std::fma(a, b, c);
+#else
+		return a * b + c;
+#endif
+	}
+
+	/** \brief Sets the flush-to-zero and denormals-are-zero flags for the lifetime of the object
+	 *
+	 * The previous floating point control state is restored on destruction. On targets without
+	 * an SSE control register the guard does nothing.
+	 */
+	class DenormalFlushGuard
+	{
+		private:
+#ifdef EXPARSE_HAS_MXCSR
+			unsigned int _savedControlWord;
+#endif
+			bool _active;
+
+		public:
+			DenormalFlushGuard(bool enable) :
+				_active(enable)
+			{
+#ifdef EXPARSE_HAS_MXCSR
+				_savedControlWord = _mm_getcsr();
+
+				if (_active)
+					_mm_setcsr(_savedControlWord | 0x8040); //FTZ | DAZ
+#endif
+			}
+
+			~DenormalFlushGuard()
+			{
+#ifdef EXPARSE_HAS_MXCSR
+				if (_active)
+					_mm_setcsr(_savedControlWord);
+#endif
+			}
+
+		private:
+			DenormalFlushGuard(const DenormalFlushGuard&);
+			DenormalFlushGuard& operator=(const DenormalFlushGuard&);
+	};
+}
+
+#endif
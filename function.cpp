@@ -3,69 +3,160 @@
 * 	Copyright (C) 2013 Jordan Melo				 	*
 ****************************************************/
 
+#include	<algorithm>
+
 #include	"function.h"
 #include	"argument_list.h"
+#include	"default_operations.h"
+#include	"higher_order.h"
 
-Function::Function(std::string funcName, FunctionPointer func, unsigned int numArgs,
+Function::Function(std::string funcName, NativeFunction func, unsigned int numArgs,
 				Handedness retHandedness, bool variadic,
 				const std::vector<Handedness>& argHandedness) :
 	_symbol(funcName),
 	_func(func),
+	_approxFunc(func),
 	_arity(numArgs),
 	_variadic(variadic),
+	_effects(EFFECT_UNKNOWN),
+	_memoCapacity(0),
 	_retHandedness(retHandedness),
 	_argHandedness(_arity + 1, HAND_RVALUE)
 {
 	std::copy(argHandedness.begin(), argHandedness.end(), _argHandedness.begin());
+
+	if (std::find(_argHandedness.begin(), _argHandedness.end(), HAND_LVALUE) != _argHandedness.end())
+		_effects |= EFFECT_WRITES_CONTEXT;
+
+	//The parser finds where a sub-expression begins from the end of the argument before it
+	assert(_argHandedness[0] != HAND_EXPRESSION);
+	assert(_func.kind() == NativeFunction::CALL_ARGUMENT_LIST || (_func.arity() == _arity && !_variadic));
 	//TODO: error handling for inputs
 }
 
+/** \brief Sets a cheaper implementation to be used when evaluating with PRECISION_FAST
+ *
+ * \param approxFunc	The approximate implementation of this function
+ * \return 			A reference to this function
+ *
+ */
+Function& Function::setApproximation(NativeFunction approxFunc)
+{
+	assert(approxFunc.kind() == NativeFunction::CALL_ARGUMENT_LIST || approxFunc.arity() == _arity);
+	_approxFunc = approxFunc;
+	return *this;
+}
+
+/** \brief Declares what the function does besides computing its result
+ *
+ * Optimizations that fold, merge, reorder, memoize or parallelize calls rely on these flags,
+ * so a function must not be declared with fewer effects than it has.
+ *
+ * \param effects	A combination of Effect flags, EFFECT_NONE for a pure function
+ * \return 			A reference to this function
+ *
+ */
+Function& Function::setEffects(unsigned int effects)
+{
+	_effects = effects;
+	return *this;
+}
+
+/** \brief Puts a cache of recent results in front of the function once it is registered
+ *
+ * Calls from the interpreter, from compiled programs and from native libraries all go through
+ * the cache. Only pure functions with a fixed number of at most MEMO_MAX_ARGUMENTS arguments, implemented as
+ * function pointers or natively typed callables, can be memoized.
+ *
+ * \param capacity	The number of results kept, rounded up to a power of two
+ * \return 			A reference to this function
+ *
+ */
+Function& Function::setMemoized(std::size_t capacity)
+{
+	_memoCapacity = capacity;
+	return *this;
+}
+
+/** \brief Shares ownership of the state used by a stateful callable
+ *
+ * \param state		The storage that the callable's state pointer refers to
+ * \return 			A reference to this function
+ *
+ */
+Function& Function::retainState(const std::shared_ptr<void>& state)
+{
+	_state = state;
+	return *this;
+}
+
+/** \brief Attaches the body of a function defined in the expression language
+ *
+ * \param definition	The parsed definition, which also owns the state of the implementations
+ * \return 			A reference to this function
+ *
+ */
+Function& Function::setDefinition(const std::shared_ptr<UserFunction>& definition)
+{
+	_definition = definition;
+	return *this;
+}
+
+Value NativeFunction::invokeArgumentList(FunctionPointer func, Value* args, unsigned int count, VariableContext& vc)
+{
+	ArgumentList argList(args, args + count, vc);
+	return func(argList);
+}
+
 namespace DefaultFunction
 {
-	Value deref(ArgumentList& args)		{ return args.dereference(0);			}
-	Value cos(ArgumentList& args)		{ return std::cos(args[0]);				}
-	Value sin(ArgumentList& args)		{ return std::sin(args[0]);				}
-	Value tan(ArgumentList& args)		{ return std::tan(args[0]);				}
-	Value acos(ArgumentList& args)		{ return std::acos(args[0]);			}
-	Value asin(ArgumentList& args)		{ return std::asin(args[0]);			}
-	Value atan(ArgumentList& args)		{ return std::atan(args[0]);			}
-	Value atan2(ArgumentList& args)		{ return std::atan2(args[0], args[1]);	}
-	Value cosh(ArgumentList& args)		{ return std::cosh(args[0]);			}
-	Value sinh(ArgumentList& args)		{ return std::sinh(args[0]);			}
-	Value tanh(ArgumentList& args)		{ return std::tanh(args[0]);			}
-	Value exp(ArgumentList& args)		{ return std::exp(args[0]);				}
-	Value log(ArgumentList& args)		{ return std::log(args[0]);				}
-	Value log10(ArgumentList& args)		{ return std::log10(args[0]);			}
-	Value pow(ArgumentList& args)		{ return std::pow(args[0], args[1]);	}
-	Value sqrt(ArgumentList& args)		{ return std::sqrt(args[0]);			}
-	Value ceil(ArgumentList& args)		{ return std::ceil(args[0]);			}
-	Value abs(ArgumentList& args)		{ return std::abs(args[0]);				}
-	Value floor(ArgumentList& args)		{ return std::floor(args[0]);			}
-	Value mod(ArgumentList& args) 		{ return std::fmod(args[0], args[1]); 	}
+	Value deref(ArgumentList& args)		{ return args.dereference(0);	}
+	Value select(ArgumentList& args)	{ return std::fabs(args[0]) >= 0.5 ? args[1] : args[2]; }
+
+	//The bound variable is written while the body runs but restored before returning
+	const std::vector<Handedness> boundBody = { HAND_LVALUE, HAND_RVALUE, HAND_RVALUE, HAND_EXPRESSION };
 }
 
 const Function Function::defaults[] =
 {
-	Function("_deref", &DefaultFunction::deref, 1, HAND_RVALUE, false, std::vector<Handedness>(1, HAND_LVALUE)),
-	Function("cos", &DefaultFunction::cos, 1),
-	Function("sin", &DefaultFunction::sin, 1),
-	Function("tan", &DefaultFunction::tan, 1),
-	Function("acos", &DefaultFunction::acos, 1),
-	Function("asin", &DefaultFunction::asin, 1),
-	Function("atan", &DefaultFunction::atan, 1),
-	Function("atan2", &DefaultFunction::atan2, 2),
-	Function("cosh", &DefaultFunction::cosh, 1),
-	Function("sinh", &DefaultFunction::sinh, 1),
-	Function("tanh", &DefaultFunction::tanh, 1),
-	Function("exp", &DefaultFunction::exp, 1),
-	Function("log", &DefaultFunction::log, 1),
-	Function("log10", &DefaultFunction::log10, 1),
-	Function("pow", &DefaultFunction::pow, 2),
-	Function("sqrt", &DefaultFunction::sqrt, 1),
-	Function("ceil", &DefaultFunction::ceil, 1),
-	Function("abs", &DefaultFunction::abs, 1),
-	Function("floor", &DefaultFunction::floor, 1),
-	Function("mod", &DefaultFunction::mod, 2)
+	Function("_deref", &DefaultFunction::deref, 1, HAND_RVALUE, false, std::vector<Handedness>(1, HAND_LVALUE)).setEffects(EFFECT_READS_CONTEXT),
+	Function("cos", &DefaultFunction::cos, 1).setApproximation(&Exparse::fastmath::cos).setEffects(EFFECT_NONE),
+	Function("sin", &DefaultFunction::sin, 1).setApproximation(&Exparse::fastmath::sin).setEffects(EFFECT_NONE),
+	Function("tan", &DefaultFunction::tan, 1).setEffects(EFFECT_NONE),
+	Function("acos", &DefaultFunction::acos, 1).setEffects(EFFECT_NONE),
+	Function("asin", &DefaultFunction::asin, 1).setEffects(EFFECT_NONE),
+	Function("atan", &DefaultFunction::atan, 1).setEffects(EFFECT_NONE),
+	Function("atan2", &DefaultFunction::atan2, 2).setEffects(EFFECT_NONE),
+	Function("cosh", &DefaultFunction::cosh, 1).setEffects(EFFECT_NONE),
+	Function("sinh", &DefaultFunction::sinh, 1).setEffects(EFFECT_NONE),
+	Function("tanh", &DefaultFunction::tanh, 1).setEffects(EFFECT_NONE),
+	Function("exp", &DefaultFunction::exp, 1).setApproximation(&Exparse::fastmath::exp).setEffects(EFFECT_NONE),
+	Function("log", &DefaultFunction::log, 1).setApproximation(&Exparse::fastmath::log).setEffects(EFFECT_NONE),
+	Function("log10", &DefaultFunction::log10, 1).setEffects(EFFECT_NONE),
+	Function("pow", &DefaultFunction::pow, 2).setApproximation(&Exparse::fastmath::pow).setEffects(EFFECT_NONE),
+	Function("sqrt", &DefaultFunction::sqrt, 1).setEffects(EFFECT_NONE),
+	Function("ceil", &DefaultFunction::ceil, 1).setEffects(EFFECT_NONE),
+	Function("abs", &DefaultFunction::abs, 1).setEffects(EFFECT_NONE),
+	Function("floor", &DefaultFunction::floor, 1).setEffects(EFFECT_NONE),
+	Function("mod", &DefaultFunction::mod, 2).setEffects(EFFECT_NONE),
+	Function("if", &DefaultFunction::select, 3).setEffects(EFFECT_NONE),
+	Function("sum", &DefaultFunction::sum, 4, HAND_RVALUE, false, DefaultFunction::boundBody).setEffects(EFFECT_READS_CONTEXT),
+	Function("prod", &DefaultFunction::product, 4, HAND_RVALUE, false, DefaultFunction::boundBody).setEffects(EFFECT_READS_CONTEXT),
+	Function("integrate", &DefaultFunction::integrate, 4, HAND_RVALUE, false, DefaultFunction::boundBody).setEffects(EFFECT_READS_CONTEXT),
+	Function("total", &DefaultFunction::total, 1).setEffects(EFFECT_NONE),
+	Function("dot", &DefaultFunction::dot, 2).setEffects(EFFECT_NONE),
+	Function("norm", &DefaultFunction::norm, 1).setEffects(EFFECT_NONE),
+	Function("at", &DefaultFunction::at, 2).setEffects(EFFECT_NONE),
+
+	//Window functions keep state per call in a StreamExpression, so they are never folded or merged
+	Function("ema", &DefaultFunction::ema, 2).setEffects(EFFECT_READS_CONTEXT),
+	Function("rollsum", &DefaultFunction::rollsum, 2).setEffects(EFFECT_READS_CONTEXT),
+	Function("rollmean", &DefaultFunction::rollmean, 2).setEffects(EFFECT_READS_CONTEXT),
+	Function("rollvar", &DefaultFunction::rollvar, 2).setEffects(EFFECT_READS_CONTEXT),
+	Function("rollmin", &DefaultFunction::rollmin, 2).setEffects(EFFECT_READS_CONTEXT),
+	Function("rollmax", &DefaultFunction::rollmax, 2).setEffects(EFFECT_READS_CONTEXT),
+	Function("lag", &DefaultFunction::lag, 2).setEffects(EFFECT_READS_CONTEXT),
+	Function("delta", &DefaultFunction::delta, 1).setEffects(EFFECT_READS_CONTEXT)
 };
 
 unsigned int Function::numDefaultFunctions = sizeof(defaults);
@@ -9,42 +9,58 @@
 #include	<cmath>
 #include	<string>
 #include	<vector>
+#include	<memory>
+#include	<algorithm>
 #include	<assert.h>
 
+#include	"fast_math.h"
+#include	"native_function.h"
+#include	"memo_cache.h"
+
 typedef enum Handedness
 {
 	HAND_RVALUE,
-	HAND_LVALUE
+	HAND_LVALUE,
+	HAND_EXPRESSION		/**< The argument is passed unevaluated, as a Subexpression; never the first parameter */
 } Handedness;
 
-union Value
+/** What a function may do besides computing its result from its arguments. A function with no
+ *  flags is pure: calls with equal arguments may be folded, merged, hoisted, memoized or run
+ *  concurrently. The flags combine with |.
+ */
+typedef enum Effect
 {
-	double numeric;
-	unsigned int variableId;
-
-	Value() 									{ }
-	Value(unsigned int vid) : variableId(vid) 	{ }
-	Value(double val) : numeric(val) 			{ }
-};
+	EFFECT_NONE = 0,
+	EFFECT_READS_CONTEXT = 1,		/**< Reads variables, either through reference parameters or state of its own */
+	EFFECT_WRITES_CONTEXT = 2,		/**< Writes variables, so calls must run and keep their order relative to reads and writes */
+	EFFECT_NONDETERMINISTIC = 4,	/**< May return different results for the same arguments, e.g. a random number generator */
 
-class ArgumentList;
+	/** Assumed for functions registered without flags: never folded, merged or memoized, and only
+	 *  treated as writing variables if it takes some by reference */
+	EFFECT_UNKNOWN = EFFECT_READS_CONTEXT | EFFECT_NONDETERMINISTIC
+} Effect;
 
-typedef Value (*FunctionPointer)(ArgumentList& args);
+class UserFunction;
 
 class Function
 {
 	private:
 		std::string _symbol;
-		FunctionPointer _func;
+		NativeFunction _func;
+		NativeFunction _approxFunc;
+		std::shared_ptr<void> _state;	/**< Keeps the storage of stateful callables alive */
+		std::shared_ptr<UserFunction> _definition;
 		unsigned int _arity;
 		bool _variadic;
+		unsigned int _effects;
+		std::size_t _memoCapacity;		/**< Results kept by the function's memo cache, or 0 if it has none */
 		Handedness _retHandedness;
 		std::vector<Handedness> _argHandedness;
 
 		static unsigned int numDefaultFunctions;
 
 	public:
-		Function(std::string funcName, FunctionPointer func, unsigned int arity,
+		Function(std::string funcName, NativeFunction func, unsigned int arity,
 				Handedness retHandedness = HAND_RVALUE, bool variadic = false,
 				const std::vector<Handedness>& argHandedness = std::vector<Handedness>());
 
@@ -53,15 +69,39 @@ class Function
 		bool isVariadic() const { return _variadic; }
 		Handedness returnValueHandedness() const { return _retHandedness; }
 
+		/** \brief Returns the function's Effect flags */
+		unsigned int effects() const { return _effects; }
+		bool isPure() const { return _effects == EFFECT_NONE; }
+		bool isDeterministic() const { return (_effects & EFFECT_NONDETERMINISTIC) == 0; }
+
+		std::size_t memoCapacity() const { return _memoCapacity; }
+
 		Handedness argumentHandedness(unsigned int index) const
 		{
 			assert(index < _argHandedness.size());
 			return _argHandedness[index];
 		}
 
-		Value execute(ArgumentList& args) const
+		/** \brief Returns whether some parameter takes an unevaluated sub-expression */
+		bool takesExpressions() const
 		{
-			return _func(args);
+			return std::find(_argHandedness.begin(), _argHandedness.end(), HAND_EXPRESSION) != _argHandedness.end();
+		}
+
+		bool hasApproximation() const { return _approxFunc != _func; }
+
+		Function& setApproximation(NativeFunction approxFunc);
+		Function& setEffects(unsigned int effects);
+		Function& setMemoized(std::size_t capacity = MEMO_CACHE_CAPACITY);
+		Function& retainState(const std::shared_ptr<void>& state);
+		Function& setDefinition(const std::shared_ptr<UserFunction>& definition);
+
+		/** \brief Returns the body of a function defined in the expression language, or nullptr for native functions */
+		const UserFunction* definition() const { return _definition.get(); }
+
+		const NativeFunction& implementation(Precision precision = PRECISION_FULL) const
+		{
+			return precision == PRECISION_FAST ? _approxFunc : _func;
 		}
 
 		static const Function defaults[];
@@ -88,6 +128,21 @@ class Operator : public Function
 			ASSOC_RIGHT
 		} Associativity;
 
+		//Precedence levels of the default operators; lower values bind tighter
+		typedef enum Precedence
+		{
+			PREC_POSTFIX = 2,
+			PREC_EXPONENT = 3,
+			PREC_PREFIX = 4,
+			PREC_MULTIPLICATIVE = 5,
+			PREC_ADDITIVE = 6,
+			PREC_RELATIONAL = 8,
+			PREC_EQUALITY = 9,
+			PREC_AND = 13,
+			PREC_OR = 14,
+			PREC_ASSIGNMENT = 15
+		} Precedence;
+
 	private:
 		unsigned int _precedence;
 		Positioning _position;
@@ -96,7 +151,7 @@ class Operator : public Function
 		static unsigned int numDefaultOperators;
 
 	public:
-		Operator(std::string opSymbol, FunctionPointer func, unsigned int opPrecedence,
+		Operator(std::string opSymbol, NativeFunction func, unsigned int opPrecedence,
 				Positioning pos, Associativity assoc = ASSOC_LEFT, Handedness retHandedness = HAND_RVALUE,
 				const std::vector<Handedness>& argHandedness = std::vector<Handedness>());
 
@@ -106,6 +161,18 @@ class Operator : public Function
 
 		Operator& setReferenceParameters(const std::vector<unsigned int>& paramIndices);
 
+		Operator& setApproximation(NativeFunction approxFunc)
+		{
+			Function::setApproximation(approxFunc);
+			return *this;
+		}
+
+		Operator& setEffects(unsigned int effects)
+		{
+			Function::setEffects(effects);
+			return *this;
+		}
+
 		static const Operator defaults[];
 
 	friend class FunctionContext;
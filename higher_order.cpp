@@ -0,0 +1,210 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<cmath>
+#include	<limits>
+#include	<vector>
+#include	<algorithm>
+
+#include	"higher_order.h"
+#include	"argument_list.h"
+
+namespace
+{
+	//Abscissae of the 15-point Kronrod rule on [-1, 1]; the odd ones are those of the embedded 7-point Gauss rule
+	const double kronrodNodes[8] =
+	{
+		0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+		0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+		0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+		0.207784955007898467600689403773245, 0.000000000000000000000000000000000
+	};
+
+	const double kronrodWeights[8] =
+	{
+		0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+		0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+		0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+		0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+	};
+
+	const double gaussWeights[4] =
+	{
+		0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+		0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+	};
+
+	struct Interval
+	{
+		double a;
+		double b;
+		double value;
+		double error;
+
+		bool operator<(const Interval& other) const { return error < other.error; }
+	};
+
+	/** Gives the bound variable values for the body, restoring the caller's value on destruction,
+	 *  including when evaluating the body throws.
+	 */
+	class BoundVariable
+	{
+		private:
+			double& _variable;
+			double _saved;
+
+		public:
+			BoundVariable(double& variable) :
+				_variable(variable),
+				_saved(variable)
+			{ }
+
+			~BoundVariable() { _variable = _saved; }
+
+			double& value() { return _variable; }
+
+		private:
+			BoundVariable(const BoundVariable&);
+			BoundVariable& operator=(const BoundVariable&);
+	};
+
+	/** \brief Evaluates the body for each whole step from the lower bound up to the upper one
+	 *
+	 * \param args		The bound variable, the bounds and the body
+	 * \param identity	The result for an empty range
+	 * \param combine	Folds the value of the body into the result
+	 * \return			The result, or NaN if the bounds are not finite or too far apart
+	 *
+	 */
+	template <typename Combine>
+	double iterate(ArgumentList& args, double identity, Combine combine)
+	{
+		double first = args[1];
+		double last = args[2];
+
+		//NaN or infinite bounds have no whole steps, even when the range would be empty
+		if (!std::isfinite(first) || !std::isfinite(last))
+			return std::numeric_limits<double>::quiet_NaN();
+
+		double count = std::floor(last - first) + 1.0;
+
+		//Steps past 2^53 would no longer be exact
+		if (!(count < 9007199254740992.0))
+			return std::numeric_limits<double>::quiet_NaN();
+
+		BoundVariable k(args.dereference(0));
+		double result = identity;
+
+		for (double step = 0.0; step < count; step += 1.0)
+		{
+			k.value() = first + step;
+			result = combine(result, args.evaluate(3));
+		}
+
+		return result;
+	}
+
+	/** \brief Applies the Gauss-Kronrod 7/15 pair to one interval, estimating the error from their difference */
+	Interval gaussKronrod(ArgumentList& args, double& x, double a, double b)
+	{
+		double center = 0.5 * (a + b);
+		double half = 0.5 * (b - a);
+		Interval interval = { a, b, 0.0, 0.0 };
+
+		x = center;
+
+		double f = args.evaluate(3);
+		double kronrod = f * kronrodWeights[7];
+		double gauss = f * gaussWeights[3];
+
+		for (unsigned int j = 0; j < 7; j++)
+		{
+			x = center - half * kronrodNodes[j];
+			double pair = args.evaluate(3);
+
+			x = center + half * kronrodNodes[j];
+			pair += args.evaluate(3);
+
+			kronrod += kronrodWeights[j] * pair;
+
+			if (j % 2 == 1)
+				gauss += gaussWeights[j / 2] * pair;
+		}
+
+		interval.value = kronrod * half;
+		interval.error = std::fabs((kronrod - gauss) * half);
+		return interval;
+	}
+}
+
+namespace DefaultFunction
+{
+	Value sum(ArgumentList& args)
+	{
+		return iterate(args, 0.0, [](double total, double term) { return total + term; });
+	}
+
+	Value product(ArgumentList& args)
+	{
+		return iterate(args, 1.0, [](double total, double factor) { return total * factor; });
+	}
+
+	/** \brief Integrates the body with globally adaptive Gauss-Kronrod quadrature
+	 *
+	 * The interval with the largest error estimate is halved until the estimates add up to less
+	 * than the tolerance or INTEGRATE_MAX_INTERVALS is reached. Bounds in decreasing order give
+	 * the negated integral.
+	 *
+	 */
+	Value integrate(ArgumentList& args)
+	{
+		double a = args[1];
+		double b = args[2];
+
+		if (!std::isfinite(a) || !std::isfinite(b))
+			return std::numeric_limits<double>::quiet_NaN();
+
+		BoundVariable bound(args.dereference(0));
+		double& x = bound.value();
+		std::vector<Interval> intervals;
+
+		intervals.reserve(INTEGRATE_MAX_INTERVALS);
+		intervals.push_back(gaussKronrod(args, x, a, b));
+
+		double value = intervals[0].value;
+		double error = intervals[0].error;
+
+		while (intervals.size() < INTEGRATE_MAX_INTERVALS &&
+				error > std::max(INTEGRATE_ABSOLUTE_TOLERANCE, INTEGRATE_RELATIVE_TOLERANCE * std::fabs(value)))
+		{
+			std::pop_heap(intervals.begin(), intervals.end());
+			Interval worst = intervals.back();
+			double middle = 0.5 * (worst.a + worst.b);
+
+			//Nothing is left to split once the interval is down to adjacent doubles
+			if (!(worst.a < middle && middle < worst.b))
+			{
+				std::push_heap(intervals.begin(), intervals.end());
+				break;
+			}
+
+			intervals.back() = gaussKronrod(args, x, worst.a, middle);
+			std::push_heap(intervals.begin(), intervals.end());
+			intervals.push_back(gaussKronrod(args, x, middle, worst.b));
+			std::push_heap(intervals.begin(), intervals.end());
+
+			value = 0.0;
+			error = 0.0;
+
+			for (unsigned int i = 0; i < intervals.size(); i++)
+			{
+				value += intervals[i].value;
+				error += intervals[i].error;
+			}
+		}
+
+		return value;
+	}
+}
@@ -0,0 +1,30 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef HIGHER_ORDER_H
+#define HIGHER_ORDER_H
+
+#include	"native_function.h"
+
+#define		INTEGRATE_RELATIVE_TOLERANCE	1e-10	/**< integrate() stops once its error estimate is this small relative to the result */
+#define		INTEGRATE_ABSOLUTE_TOLERANCE	1e-14	/**< ... or this small in absolute terms */
+#define		INTEGRATE_MAX_INTERVALS			256		/**< Subintervals integrate() may split the range into, 15 evaluations each */
+
+//The default functions taking a bound variable and a body evaluated for values of it:
+//
+//	sum(k, a, b, body)			the sum of body for k = a, a + 1, ... up to b; 0 if a > b
+//	prod(k, a, b, body)			the product of body for the same values; 1 if a > b
+//	integrate(x, a, b, body)	the integral of body over x from a to b
+//
+//The bound variable is restored afterwards. Bounds that are not finite give NaN.
+
+namespace DefaultFunction
+{
+	Value sum(ArgumentList& args);
+	Value product(ArgumentList& args);
+	Value integrate(ArgumentList& args);
+}
+
+#endif
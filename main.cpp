@@ -9,6 +9,7 @@
 
 #include "expression_parser.h"
 #include "tokenizer.h"
+#include "user_function.h"
 
 using namespace std;
 
@@ -28,8 +29,16 @@ int main()
 
 		try
 		{
-			ExpressionParser ep(strinput, vc, fc);
-			cout << "   = " << ep.evaluate() << endl;
+			if (UserFunction::isDefinition(strinput))
+			{
+				fc.defineFunction(strinput);
+				cout << "   defined" << endl;
+			}
+			else
+			{
+				ExpressionParser ep(strinput, vc, fc);
+				cout << "   = " << ep.evaluate() << endl;
+			}
 		}
 		catch (TokenizerException& tex)
 		{
@@ -0,0 +1,191 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<cstring>
+#include	<stdexcept>
+#include	<string>
+
+#include	"memo_cache.h"
+
+namespace
+{
+	uint64_t bitsOf(double value)
+	{
+		uint64_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	double valueOf(uint64_t bits)
+	{
+		double value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	uint64_t hashArguments(const uint64_t* bits, unsigned int count)
+	{
+		uint64_t h = 0x9E3779B97F4A7C15ull;
+
+		for (unsigned int k = 0; k < count; k++)
+			h = (h ^ bits[k]) * 0xFF51AFD7ED558CCDull;
+
+		//Round numbers differ only in their high bits, so those have to be mixed into the low ones the slot is taken from
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ull;
+		h ^= h >> 33;
+
+		return h;
+	}
+}
+
+/** \brief Creates an empty cache in front of a function
+ *
+ * \param function	The function; must be pure, and a unary, binary or natively typed callable
+ * \param arity		The number of arguments, at most MEMO_MAX_ARGUMENTS
+ * \param capacity	The number of results kept, rounded up to a power of two
+ *
+ */
+MemoCache::MemoCache(const NativeFunction& function, unsigned int arity, std::size_t capacity) :
+	_function(function),
+	_arity(arity),
+	_mask(1),
+	_hits(0),
+	_misses(0)
+{
+	if (function.kind() == NativeFunction::CALL_ARGUMENT_LIST)
+		throw std::invalid_argument("functions taking an ArgumentList cannot be memoized");
+
+	if (arity > MEMO_MAX_ARGUMENTS)
+		throw std::invalid_argument("functions of more than " + std::to_string(MEMO_MAX_ARGUMENTS) + " arguments cannot be memoized");
+
+	//Slots are used in pairs, so there are at least two
+	while (_mask + 1 < capacity)
+		_mask = (_mask << 1) | 1;
+
+	//Value-initialization zeroes every slot, which marks it empty
+	_entries.reset(new Entry[_mask + 1]());
+}
+
+double MemoCache::callThunk(void* state, const Value* args)
+{
+	return static_cast<MemoCache*>(state)->call(args);
+}
+
+/** \brief Looks the arguments up in one slot
+ *
+ * \param e			The slot
+ * \param bits		The bits of the arguments
+ * \param sequence	Receives the sequence number the slot had, for claiming it afterwards
+ * \param result		Receives the cached result on a hit
+ * \return			Whether the slot holds a result for the arguments
+ *
+ */
+bool MemoCache::lookup(Entry& e, const uint64_t* bits, uint32_t& sequence, double& result) const
+{
+	sequence = e.sequence.load(std::memory_order_acquire);
+
+	if (sequence == 0 || (sequence & 1) != 0)
+		return false;
+
+	bool same = true;
+
+	for (unsigned int k = 0; k < _arity; k++)
+		same = same && e.arguments[k].load(std::memory_order_relaxed) == bits[k];
+
+	uint64_t cached = e.result.load(std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	if (!same || e.sequence.load(std::memory_order_relaxed) != sequence)
+		return false;
+
+	result = valueOf(cached);
+	return true;
+}
+
+/** \brief Stores a result in a slot, unless the slot changed since it was looked up
+ *
+ * \param e			The slot
+ * \param sequence	The sequence number the slot had when it was looked up
+ * \param bits		The bits of the arguments
+ * \param result		The result
+ *
+ */
+void MemoCache::store(Entry& e, uint32_t sequence, const uint64_t* bits, double result)
+{
+	//Claim the slot by making its sequence odd; if someone else holds it, leave the result uncached
+	if ((sequence & 1) != 0 || !e.sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_relaxed))
+		return;
+
+	std::atomic_thread_fence(std::memory_order_release);
+
+	for (unsigned int k = 0; k < _arity; k++)
+		e.arguments[k].store(bits[k], std::memory_order_relaxed);
+
+	e.result.store(bitsOf(result), std::memory_order_relaxed);
+	e.sequence.store(sequence + 2 == 0 ? 2 : sequence + 2, std::memory_order_release);
+}
+
+/** \brief Returns the cached result for the arguments, calling the function on a miss
+ *
+ * \param args		The arguments
+ * \return			The function's result
+ *
+ */
+double MemoCache::call(const Value* args)
+{
+	uint64_t bits[MEMO_MAX_ARGUMENTS];
+
+	for (unsigned int k = 0; k < _arity; k++)
+		bits[k] = bitsOf(args[k].numeric);
+
+	uint64_t hash = hashArguments(bits, _arity);
+	Entry* set = &_entries[hash & _mask & ~static_cast<std::size_t>(1)];
+	uint32_t sequences[2];
+	double result;
+
+	for (unsigned int way = 0; way < 2; way++)
+	{
+		if (lookup(set[way], bits, sequences[way], result))
+		{
+			_hits.fetch_add(1, std::memory_order_relaxed);
+			return result;
+		}
+	}
+
+	_misses.fetch_add(1, std::memory_order_relaxed);
+
+	switch (_function.kind())
+	{
+		case NativeFunction::CALL_UNARY:	result = _function.unaryTarget()(args[0].numeric); break;
+		case NativeFunction::CALL_BINARY:	result = _function.binaryTarget()(args[0].numeric, args[1].numeric); break;
+		default:							result = _function.callableTarget()(_function.state(), args); break;
+	}
+
+	//An empty way is filled first; otherwise the hash picks the way to replace
+	unsigned int victim = sequences[0] == 0 ? 0 : sequences[1] == 0 ? 1 : static_cast<unsigned int>(hash >> 63);
+	store(set[victim], sequences[victim], bits, result);
+
+	return result;
+}
+
+/** \brief Returns the number of lookups that were answered from the cache and the number that were not */
+MemoStats MemoCache::stats() const
+{
+	MemoStats s;
+	s.hits = _hits.load(std::memory_order_relaxed);
+	s.misses = _misses.load(std::memory_order_relaxed);
+	return s;
+}
+
+/** \brief Empties the cache and resets its statistics; must not run concurrently with calls */
+void MemoCache::clear()
+{
+	for (std::size_t i = 0; i <= _mask; i++)
+		_entries[i].sequence.store(0, std::memory_order_relaxed);
+
+	_hits.store(0, std::memory_order_relaxed);
+	_misses.store(0, std::memory_order_relaxed);
+}
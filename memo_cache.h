@@ -0,0 +1,76 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef MEMO_CACHE_H
+#define MEMO_CACHE_H
+
+#include	<atomic>
+#include	<cstdint>
+#include	<memory>
+
+#include	"native_function.h"
+
+#define		MEMO_CACHE_CAPACITY		1024	/**< Default number of results kept per memoized function */
+#define		MEMO_MAX_ARGUMENTS		4		/**< Functions taking more arguments cannot be memoized */
+
+struct MemoStats
+{
+	uint64_t hits;
+	uint64_t misses;
+
+	double hitRate() const { return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+};
+
+/** A bounded cache of the results of a pure function, keyed on the bits of its arguments.
+ *
+ *  The cache is two-way set-associative: each argument list can go in either slot of one pair,
+ *  and a new result replaces one of them. Lookups and updates are lock-free, so one cache can serve every
+ *  thread evaluating the function. Each slot carries a sequence number that is odd while the
+ *  slot is written; a reader that sees it change treats the lookup as a miss, and a writer
+ *  that finds another one in the slot leaves the result uncached.
+ *
+ *  Arguments are compared bitwise, so 0 and -0 are cached separately and NaN arguments hit.
+ */
+class MemoCache
+{
+	private:
+		struct Entry
+		{
+			std::atomic<uint32_t> sequence;		/**< 0 while empty, odd while being written */
+			std::atomic<uint64_t> arguments[MEMO_MAX_ARGUMENTS];
+			std::atomic<uint64_t> result;
+		};
+
+		NativeFunction _function;
+		unsigned int _arity;
+		std::unique_ptr<Entry[]> _entries;
+		std::size_t _mask;
+		std::atomic<uint64_t> _hits;
+		std::atomic<uint64_t> _misses;
+
+		MemoCache(const MemoCache&);
+		MemoCache& operator=(const MemoCache&);
+
+		bool lookup(Entry& e, const uint64_t* bits, uint32_t& sequence, double& result) const;
+		void store(Entry& e, uint32_t sequence, const uint64_t* bits, double result);
+
+		static double callThunk(void* state, const Value* args);
+
+	public:
+		MemoCache(const NativeFunction& function, unsigned int arity, std::size_t capacity = MEMO_CACHE_CAPACITY);
+
+		double call(const Value* args);
+
+		/** \brief Returns a descriptor that calls the function through this cache */
+		NativeFunction wrapper() { return NativeFunction(&callThunk, this, _arity); }
+
+		const NativeFunction& function() const { return _function; }
+		std::size_t capacity() const { return _mask + 1; }
+
+		MemoStats stats() const;
+		void clear();
+};
+
+#endif
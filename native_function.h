@@ -0,0 +1,245 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef NATIVE_FUNCTION_H
+#define NATIVE_FUNCTION_H
+
+#include	<memory>
+#include	<type_traits>
+
+#include	"subexpression.h"
+
+union Value
+{
+	double numeric;
+	unsigned int variableId;
+	Subexpression* expression;
+
+	Value() 									{ }
+	Value(unsigned int vid) : variableId(vid) 	{ }
+	Value(double val) : numeric(val) 			{ }
+	Value(Subexpression* expr) : expression(expr)	{ }
+};
+
+class ArgumentList;
+class VariableContext;
+
+typedef Value (*FunctionPointer)(ArgumentList& args);
+typedef double (*UnaryFunctionPointer)(double);
+typedef double (*BinaryFunctionPointer)(double, double);
+typedef double (*CallableThunkPointer)(void* state, const Value* args);
+
+namespace Exparse
+{
+	namespace detail
+	{
+		template <unsigned int... Indices>
+		struct IndexList { };
+
+		template <unsigned int N, unsigned int... Indices>
+		struct MakeIndexList : MakeIndexList<N - 1, N - 1, Indices...> { };
+
+		template <unsigned int... Indices>
+		struct MakeIndexList<0, Indices...>
+		{
+			typedef IndexList<Indices...> type;
+		};
+
+		template <typename... Args>
+		struct AllDoubles : std::true_type { };
+
+		template <typename First, typename... Rest>
+		struct AllDoubles<First, Rest...> :
+			std::integral_constant<bool, std::is_same<First, double>::value && AllDoubles<Rest...>::value> { };
+	}
+}
+
+/** \brief Describes the signature of a natively typed function, e.g. double(double, double)
+ *
+ * Only signatures taking and returning doubles are supported.
+ */
+template <typename Signature>
+struct NativeSignature;
+
+template <typename... Args>
+struct NativeSignature<double(Args...)>
+{
+	static_assert(Exparse::detail::AllDoubles<Args...>::value, "native functions may only take double arguments");
+
+	static const unsigned int arity = sizeof...(Args);
+};
+
+/** The hot part of a function descriptor: just enough to make the call.
+ *
+ *  Unary and binary function pointers are called directly with unboxed doubles. Callables of any
+ *  other arity, or ones that carry state, go through a small thunk that receives the state pointer.
+ *  Functions written against the original FunctionPointer signature still work and receive an
+ *  ArgumentList, which is the only form that can dereference variable arguments.
+ */
+class NativeFunction
+{
+	public:
+		typedef enum CallKind
+		{
+			CALL_ARGUMENT_LIST = 0,
+			CALL_UNARY,
+			CALL_BINARY,
+			CALL_CALLABLE
+		} CallKind;
+
+	private:
+		union
+		{
+			FunctionPointer argumentList;
+			UnaryFunctionPointer unary;
+			BinaryFunctionPointer binary;
+			CallableThunkPointer callable;
+		} _target;
+
+		void* _state;
+		CallKind _kind;
+		unsigned int _arity;
+
+		static Value invokeArgumentList(FunctionPointer func, Value* args, unsigned int count, VariableContext& vc);
+
+	public:
+		NativeFunction() :
+			_state(nullptr),
+			_kind(CALL_ARGUMENT_LIST),
+			_arity(0)
+		{
+			_target.argumentList = nullptr;
+		}
+
+		NativeFunction(FunctionPointer func) :
+			_state(nullptr),
+			_kind(CALL_ARGUMENT_LIST),
+			_arity(0)
+		{
+			_target.argumentList = func;
+		}
+
+		NativeFunction(UnaryFunctionPointer func) :
+			_state(nullptr),
+			_kind(CALL_UNARY),
+			_arity(1)
+		{
+			_target.unary = func;
+		}
+
+		NativeFunction(BinaryFunctionPointer func) :
+			_state(nullptr),
+			_kind(CALL_BINARY),
+			_arity(2)
+		{
+			_target.binary = func;
+		}
+
+		NativeFunction(CallableThunkPointer thunk, void* state, unsigned int arity) :
+			_state(state),
+			_kind(CALL_CALLABLE),
+			_arity(arity)
+		{
+			_target.callable = thunk;
+		}
+
+		CallKind kind() const { return _kind; }
+		unsigned int arity() const { return _arity; }
+		void* state() const { return _state; }
+
+		UnaryFunctionPointer unaryTarget() const		{ return _kind == CALL_UNARY ? _target.unary : nullptr; }
+		BinaryFunctionPointer binaryTarget() const		{ return _kind == CALL_BINARY ? _target.binary : nullptr; }
+		FunctionPointer argumentListTarget() const		{ return _kind == CALL_ARGUMENT_LIST ? _target.argumentList : nullptr; }
+		CallableThunkPointer callableTarget() const		{ return _kind == CALL_CALLABLE ? _target.callable : nullptr; }
+
+		bool operator==(const NativeFunction& other) const
+		{
+			if (_kind != other._kind || _state != other._state)
+				return false;
+
+			switch (_kind)
+			{
+				case CALL_UNARY:	return _target.unary == other._target.unary;
+				case CALL_BINARY:	return _target.binary == other._target.binary;
+				case CALL_CALLABLE:	return _target.callable == other._target.callable;
+				default:			return _target.argumentList == other._target.argumentList;
+			}
+		}
+
+		bool operator!=(const NativeFunction& other) const { return !(*this == other); }
+
+		/** \brief Calls the function
+		 *
+		 * \param args		Pointer to the first argument on the evaluation stack
+		 * \param count		The number of arguments
+		 * \param vc		A variable context for functions that dereference variable arguments
+		 * \return			The function's result
+		 *
+		 */
+		Value invoke(Value* args, unsigned int count, VariableContext& vc) const
+		{
+			switch (_kind)
+			{
+				case CALL_UNARY:	return _target.unary(args[0].numeric);
+				case CALL_BINARY:	return _target.binary(args[0].numeric, args[1].numeric);
+				case CALL_CALLABLE:	return _target.callable(_state, args);
+				default:			return invokeArgumentList(_target.argumentList, args, count, vc);
+			}
+		}
+
+		/** \brief Wraps a plain function pointer or an arbitrary (possibly stateful) callable
+		 *
+		 * \param fn		The callable. Copied into heap storage unless it is a unary or binary function pointer.
+		 * \param owner		Receives ownership of the copied callable; must outlive every call.
+		 * \return			A descriptor for the callable
+		 *
+		 */
+		template <typename Signature, typename Callable>
+		static NativeFunction create(Callable fn, std::shared_ptr<void>& owner)
+		{
+			const unsigned int arity = NativeSignature<Signature>::arity;
+
+			return createImpl<Callable>(fn, owner,
+					std::integral_constant<bool, arity == 1 && std::is_convertible<Callable, UnaryFunctionPointer>::value>(),
+					std::integral_constant<bool, arity == 2 && std::is_convertible<Callable, BinaryFunctionPointer>::value>(),
+					typename Exparse::detail::MakeIndexList<arity>::type());
+		}
+
+	private:
+		template <typename Callable, bool IsBinary, unsigned int... Indices>
+		static NativeFunction createImpl(Callable fn, std::shared_ptr<void>&, std::true_type, std::integral_constant<bool, IsBinary>,
+				Exparse::detail::IndexList<Indices...>)
+		{
+			return NativeFunction(static_cast<UnaryFunctionPointer>(fn));
+		}
+
+		template <typename Callable, unsigned int... Indices>
+		static NativeFunction createImpl(Callable fn, std::shared_ptr<void>&, std::false_type, std::true_type,
+				Exparse::detail::IndexList<Indices...>)
+		{
+			return NativeFunction(static_cast<BinaryFunctionPointer>(fn));
+		}
+
+		template <typename Callable, unsigned int... Indices>
+		static NativeFunction createImpl(Callable fn, std::shared_ptr<void>& owner, std::false_type, std::false_type,
+				Exparse::detail::IndexList<Indices...>)
+		{
+			std::shared_ptr<Callable> state = std::make_shared<Callable>(fn);
+			owner = state;
+
+			return NativeFunction(&callThunk<Callable, Indices...>, state.get(), sizeof...(Indices));
+		}
+
+		template <typename Callable, unsigned int... Indices>
+		static double callThunk(void* state, const Value* args)
+		{
+			(void) args;
+			return (*static_cast<Callable*>(state))(args[Indices].numeric...);
+		}
+
+	friend class FunctionContext;
+};
+
+#endif
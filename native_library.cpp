@@ -0,0 +1,624 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<cassert>
+#include	<cerrno>
+#include	<cmath>
+#include	<cstdio>
+#include	<cstdlib>
+#include	<cstring>
+#include	<sstream>
+#include	<fstream>
+#include	<stdexcept>
+
+#include	<dlfcn.h>
+#include	<pwd.h>
+#include	<unistd.h>
+#include	<sys/stat.h>
+#include	<sys/wait.h>
+
+#include	"native_library.h"
+#include	"expression_graph.h"
+
+namespace
+{
+	//Semantics of the comparison and boolean operators, copied from default_operations.h
+	const char* const sourcePrelude =
+		"#include <math.h>\n"
+		"#include <stddef.h>\n"
+		"\n"
+		"typedef struct { double (*call)(void*, unsigned int, const double*, unsigned int); void* self; } exparse_context;\n"
+		"\n"
+		"static inline double ex_eq(double x, double y) { return (fabs(x - y) / (fabs(x) + 1.0)) < 0.00001 ? 1.0 : 0.0; }\n"
+		"static inline double ex_ne(double x, double y) { return (fabs(x - y) / (fabs(x) + 1.0)) >= 0.00001 ? 1.0 : 0.0; }\n"
+		"static inline double ex_lt(double x, double y) { return x < y ? 1.0 : 0.0; }\n"
+		"static inline double ex_gt(double x, double y) { return x > y ? 1.0 : 0.0; }\n"
+		"static inline double ex_le(double x, double y) { return (ex_eq(x, y) + ex_lt(x, y)) > 0.5 ? 1.0 : 0.0; }\n"
+		"static inline double ex_ge(double x, double y) { return (ex_eq(x, y) + ex_gt(x, y)) > 0.5 ? 1.0 : 0.0; }\n"
+		"static inline double ex_and(double x, double y) { return fabs(x) >= 0.5 && fabs(y) >= 0.5 ? 1.0 : 0.0; }\n"
+		"static inline double ex_or(double x, double y) { return fabs(x) >= 0.5 || fabs(y) >= 0.5 ? 1.0 : 0.0; }\n"
+		"static inline double ex_not(double x) { return fabs(x) < 0.5 ? 1.0 : 0.0; }\n"
+		"\n";
+
+	struct Template
+	{
+		const char* symbol;
+		int position;			/**< Operator::Positioning, or 0 for functions */
+		const char* code;		/**< $1, $2, ... stand for the arguments */
+	};
+
+	const Template templates[] =
+	{
+		{ "++", Operator::POS_POSTFIX, "($1++)" },
+		{ "--", Operator::POS_POSTFIX, "($1--)" },
+		{ "++", Operator::POS_PREFIX, "(++$1)" },
+		{ "--", Operator::POS_PREFIX, "(--$1)" },
+		{ "+", Operator::POS_PREFIX, "(+$1)" },
+		{ "-", Operator::POS_PREFIX, "(-$1)" },
+		{ "!", Operator::POS_PREFIX, "ex_not($1)" },
+		{ "+", Operator::POS_INFIX, "($1 + $2)" },
+		{ "-", Operator::POS_INFIX, "($1 - $2)" },
+		{ "*", Operator::POS_INFIX, "($1 * $2)" },
+		{ "/", Operator::POS_INFIX, "($1 / $2)" },
+		{ "%", Operator::POS_INFIX, "fmod($1, $2)" },
+		{ "^", Operator::POS_INFIX, "pow($1, $2)" },
+		{ "=", Operator::POS_INFIX, "($1 = $2)" },
+		{ "+=", Operator::POS_INFIX, "($1 += $2)" },
+		{ "-=", Operator::POS_INFIX, "($1 -= $2)" },
+		{ "*=", Operator::POS_INFIX, "($1 *= $2)" },
+		{ "/=", Operator::POS_INFIX, "($1 /= $2)" },
+		{ "%=", Operator::POS_INFIX, "($1 = fmod($1, $2))" },
+		{ "==", Operator::POS_INFIX, "ex_eq($1, $2)" },
+		{ "!=", Operator::POS_INFIX, "ex_ne($1, $2)" },
+		{ "<", Operator::POS_INFIX, "ex_lt($1, $2)" },
+		{ ">", Operator::POS_INFIX, "ex_gt($1, $2)" },
+		{ "<=", Operator::POS_INFIX, "ex_le($1, $2)" },
+		{ ">=", Operator::POS_INFIX, "ex_ge($1, $2)" },
+		{ "&&", Operator::POS_INFIX, "ex_and($1, $2)" },
+		{ "||", Operator::POS_INFIX, "ex_or($1, $2)" },
+		{ "cos", 0, "cos($1)" },
+		{ "sin", 0, "sin($1)" },
+		{ "tan", 0, "tan($1)" },
+		{ "acos", 0, "acos($1)" },
+		{ "asin", 0, "asin($1)" },
+		{ "atan", 0, "atan($1)" },
+		{ "atan2", 0, "atan2($1, $2)" },
+		{ "cosh", 0, "cosh($1)" },
+		{ "sinh", 0, "sinh($1)" },
+		{ "tanh", 0, "tanh($1)" },
+		{ "exp", 0, "exp($1)" },
+		{ "log", 0, "log($1)" },
+		{ "log10", 0, "log10($1)" },
+		{ "pow", 0, "pow($1, $2)" },
+		{ "sqrt", 0, "sqrt($1)" },
+		{ "ceil", 0, "ceil($1)" },
+		{ "abs", 0, "fabs($1)" },
+		{ "floor", 0, "floor($1)" },
+		{ "mod", 0, "fmod($1, $2)" },
+		{ "if", 0, "(fabs($1) >= 0.5 ? $2 : $3)" }
+	};
+
+	const char* findTemplate(const ExpressionGraph& graph, const ExpressionGraph::Node& n)
+	{
+		const FunctionContext& fc = graph.functionContext();
+		bool builtin = n.isOperator ? fc.isBuiltinOperator(n.id) : fc.isBuiltinFunction(n.id);
+
+		if (!builtin)
+			return nullptr;
+
+		const Function* func = graph.callee(n);
+		int position = n.isOperator ? static_cast<const Operator*>(func)->position() : 0;
+
+		for (unsigned int i = 0; i < sizeof(templates) / sizeof(templates[0]); i++)
+			if (templates[i].position == position && func->symbol() == templates[i].symbol)
+				return templates[i].code;
+
+		return nullptr;
+	}
+
+	std::string substitute(const char* code, const std::vector<std::string>& arguments)
+	{
+		std::string result;
+
+		for (const char* c = code; *c != '\0'; c++)
+		{
+			if (*c == '$' && c[1] >= '1' && c[1] <= '9')
+				result += arguments[*++c - '1'];
+			else
+				result += *c;
+		}
+
+		return result;
+	}
+
+	std::string literal(double value)
+	{
+		char buffer[64];
+
+		//Hexadecimal floating point literals are exact
+		std::snprintf(buffer, sizeof(buffer), "%a", value);
+
+		if (std::isinf(value))
+			return value > 0 ? "HUGE_VAL" : "(-HUGE_VAL)";
+		if (std::isnan(value))
+			return "NAN";
+
+		return std::string("(") + buffer + ")";
+	}
+
+	struct GeneratedCode
+	{
+		std::string source;
+		std::vector<NativeFunction> callees;
+		std::vector<unsigned int> batchVariables;
+	};
+
+	/** \brief Emits the body shared by the scalar and batch functions of one expression
+	 *
+	 * Variables are accessed through EX_V(slot, batchIndex), which each variant defines.
+	 *
+	 */
+	std::string generateBody(const ExpressionGraph& graph, GeneratedCode& code, std::vector<int>& batchIndex)
+	{
+		std::ostringstream body;
+		std::vector<bool> live = graph.liveNodes();
+		std::vector<std::string> values(graph.size());
+		Precision precision = graph.functionContext().precision();
+
+		for (unsigned int i = 0; i < graph.size(); i++)
+		{
+			if (!live[i])
+				continue;
+
+			const ExpressionGraph::Node& n = graph.node(i);
+			std::ostringstream temp;
+
+			temp << "t" << i;
+
+			switch (n.type)
+			{
+				case ExpressionGraph::NODE_CONSTANT:
+					values[i] = literal(n.value);
+					break;
+
+				case ExpressionGraph::NODE_LOAD:
+				case ExpressionGraph::NODE_REFERENCE:
+				{
+					if (batchIndex[n.id - 1] < 0)
+					{
+						batchIndex[n.id - 1] = code.batchVariables.size();
+						code.batchVariables.push_back(n.id);
+					}
+
+					std::ostringstream access;
+					access << "EX_V(" << n.id - 1 << ", " << batchIndex[n.id - 1] << ")";
+
+					//References name the variable itself; loads take a snapshot of its value
+					if (n.type == ExpressionGraph::NODE_REFERENCE)
+						values[i] = access.str();
+					else
+					{
+						body << "\tconst double " << temp.str() << " = " << access.str() << ";\n";
+						values[i] = temp.str();
+					}
+
+					break;
+				}
+
+				case ExpressionGraph::NODE_EXPRESSION:
+					throw std::invalid_argument("sub-expressions passed unevaluated cannot be exported");
+
+				case ExpressionGraph::NODE_INPUT:
+					throw std::invalid_argument("values read from the caller's storage cannot be exported");
+
+				case ExpressionGraph::NODE_POLYNOMIAL:
+				{
+					//Horner's rule; the C compiler contracts the multiply-adds where it may
+					const std::string& x = values[n.arguments[0]];
+					std::string horner = literal(n.coefficients.back());
+
+					for (unsigned int k = n.coefficients.size() - 1; k-- > 0; )
+						horner = "(" + horner + " * " + x + " + " + literal(n.coefficients[k]) + ")";
+
+					body << "\tconst double " << temp.str() << " = " << horner << ";\n";
+					values[i] = temp.str();
+					break;
+				}
+
+				case ExpressionGraph::NODE_CALL:
+				{
+					std::vector<std::string> arguments;
+					const char* tmpl = findTemplate(graph, n);
+
+					for (unsigned int j = 0; j < n.arguments.size(); j++)
+						arguments.push_back(values[n.arguments[j]]);
+
+					body << "\tconst double " << temp.str() << " = ";
+
+					if (tmpl != nullptr)
+						body << substitute(tmpl, arguments) << ";\n";
+					else
+					{
+						if (n.sideEffects)
+							throw std::invalid_argument("'" + graph.callee(n)->symbol() + "' takes a variable reference and cannot be exported");
+
+						const FunctionContext& fc = graph.functionContext();
+
+						body << "((const exparse_context*) ctx)->call(((const exparse_context*) ctx)->self, "
+								<< code.callees.size() << ", (const double[]) { ";
+
+						for (unsigned int j = 0; j < arguments.size(); j++)
+							body << (j > 0 ? ", " : "") << arguments[j];
+
+						body << (arguments.empty() ? "0.0" : "") << " }, " << arguments.size() << ");\n";
+
+						code.callees.push_back(n.isOperator ? fc.operatorTable(precision)[n.id - 1] : fc.functionTable(precision)[n.id - 1]);
+					}
+
+					values[i] = temp.str();
+					break;
+				}
+			}
+		}
+
+		body << "\tresult = " << values[graph.outputs()[0]] << ";\n";
+		return body.str();
+	}
+
+	VariableContext& sharedVariableContext(const std::vector<const ExpressionParser*>& expressions)
+	{
+		if (expressions.empty())
+			throw std::invalid_argument("a native library needs at least one expression");
+
+		return expressions[0]->variableContext();
+	}
+
+	GeneratedCode generateCode(const std::vector<const ExpressionParser*>& expressions)
+	{
+		GeneratedCode code;
+		std::ostringstream source;
+
+		source << sourcePrelude;
+
+		if (expressions.empty())
+		{
+			code.source = source.str();
+			return code;
+		}
+
+		const FunctionContext& fc = expressions[0]->functionContext();
+		std::vector<int> batchIndex(expressions[0]->variableContext().size(), -1);
+
+		for (unsigned int k = 0; k < expressions.size(); k++)
+		{
+			assert(&expressions[k]->functionContext() == &fc);
+
+			ExpressionGraph graph(fc);
+			graph.addOutput(graph.addExpression(*expressions[k]));
+
+			std::string body = generateBody(graph, code, batchIndex);
+
+			source << "#define EX_V(slot, index) (*s[slot])\n";
+			source << "double exparse_scalar_" << k << "(double* const* s, void* ctx)\n{\n";
+			source << "\tdouble result;\n\t(void) s; (void) ctx;\n" << body << "\treturn result;\n}\n#undef EX_V\n\n";
+
+			source << "#define EX_V(slot, index) (*(double*) (b[index] + r * st[index]))\n";
+			source << "void exparse_batch_" << k << "(size_t rows, char* const* b, const size_t* st, double* out, void* ctx)\n{\n";
+			source << "\tsize_t r;\n\t(void) b; (void) st; (void) ctx;\n\n\tfor (r = 0; r < rows; r++)\n\t{\n";
+			source << "\t\tdouble result;\n";
+
+			std::istringstream lines(body);
+			std::string line;
+
+			while (std::getline(lines, line))
+				source << "\t" << line << "\n";
+
+			source << "\t\tout[r] = result;\n\t}\n}\n#undef EX_V\n\n";
+		}
+
+		code.source = source.str();
+		return code;
+	}
+
+	/** \brief Runs a program without a shell and waits for it
+	 *
+	 * \param arguments	The program followed by its arguments; the program is searched for in PATH
+	 * \return			The exit status, or -1 if the program could not be run or was killed
+	 *
+	 */
+	int runProgram(const std::vector<std::string>& arguments)
+	{
+		std::vector<char*> argv;
+
+		for (unsigned int i = 0; i < arguments.size(); i++)
+			argv.push_back(const_cast<char*>(arguments[i].c_str()));
+
+		argv.push_back(nullptr);
+
+		pid_t pid = fork();
+
+		if (pid < 0)
+			return -1;
+
+		if (pid == 0)
+		{
+			//Only async-signal-safe calls are allowed in the child of a possibly multithreaded process
+			execvp(argv[0], argv.data());
+			_exit(127);
+		}
+
+		int status;
+
+		while (waitpid(pid, &status, 0) < 0)
+			if (errno != EINTR)
+				return -1;
+
+		return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	}
+
+	/** \brief Creates a directory and any missing parents with mode 0700, like mkdir -p
+	 *
+	 * \return		false, with errno set, if a directory could not be created for a reason other than existing already
+	 *
+	 */
+	bool makeDirectories(const std::string& path)
+	{
+		if (mkdir(path.c_str(), 0700) == 0 || errno == EEXIST)
+			return true;
+
+		std::size_t separator = path.find_last_of('/');
+
+		if (errno != ENOENT || separator == std::string::npos || separator == 0 || !makeDirectories(path.substr(0, separator)))
+			return false;
+
+		return mkdir(path.c_str(), 0700) == 0 || errno == EEXIST;
+	}
+
+	/** \brief Throws unless a path is a directory or regular file (not a link) that only the current user can write to
+	 *
+	 * Loading a library runs its code, so neither it nor the directory holding it may be replaceable by anyone else.
+	 */
+	void checkPrivatePath(const std::string& path, bool directory)
+	{
+		struct stat info;
+
+		if (lstat(path.c_str(), &info) != 0)
+			throw std::runtime_error("cannot inspect '" + path + "': " + std::strerror(errno));
+
+		bool rightType = directory ? S_ISDIR(info.st_mode) : S_ISREG(info.st_mode);
+
+		if (!rightType || info.st_uid != geteuid() || (info.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+			throw std::runtime_error("'" + path + "' must be a " + (directory ? "directory" : "file") +
+					" owned by the current user and not writable by others");
+	}
+}
+
+/** \brief Compiles expressions to a shared object, or loads it from the cache
+ *
+ * \param expressions		Parsed expressions sharing one variable and one function context
+ * \param cacheDirectory	Where generated sources and shared objects are kept; created if missing
+ * \param compiler			The C compiler to invoke
+ *
+ */
+NativeLibrary::NativeLibrary(const std::vector<const ExpressionParser*>& expressions, const std::string& cacheDirectory,
+		const std::string& compiler) :
+	_variableContext(sharedVariableContext(expressions)),
+	_handle(nullptr),
+	_loadedFromCache(false)
+{
+	GeneratedCode code = generateCode(expressions);
+
+	_source.swap(code.source);
+	_callees.swap(code.callees);
+	_batchVariables.swap(code.batchVariables);
+
+	_context.call = &NativeLibrary::callThunk;
+	_context.self = this;
+
+	build(cacheDirectory, compiler);
+
+	for (unsigned int k = 0; k < expressions.size(); k++)
+	{
+		std::string index = std::to_string(k);
+		void* scalar = dlsym(_handle, ("exparse_scalar_" + index).c_str());
+		void* batch = dlsym(_handle, ("exparse_batch_" + index).c_str());
+
+		if (scalar == nullptr || batch == nullptr)
+			throw std::runtime_error("'" + _libraryPath + "' does not export expression " + index);
+
+		_scalar.push_back(reinterpret_cast<ScalarFunction>(scalar));
+		_batch.push_back(reinterpret_cast<BatchFunction>(batch));
+	}
+}
+
+NativeLibrary::~NativeLibrary()
+{
+	if (_handle != nullptr)
+		dlclose(_handle);
+}
+
+/** \brief Generates the C source for a set of expressions without compiling it
+ *
+ * \param expressions	Parsed expressions sharing one variable and one function context
+ * \return				A C99 translation unit defining exparse_scalar_N and exparse_batch_N for each expression
+ *
+ */
+std::string NativeLibrary::exportSource(const std::vector<const ExpressionParser*>& expressions)
+{
+	return generateCode(expressions).source;
+}
+
+/** \brief Returns the per-user cache directory used unless another one is given
+ *
+ * \return		$XDG_CACHE_HOME/exparse, or ~/.cache/exparse if XDG_CACHE_HOME is unset or relative
+ *
+ */
+std::string NativeLibrary::defaultCacheDirectory()
+{
+	const char* cacheHome = std::getenv("XDG_CACHE_HOME");
+
+	if (cacheHome != nullptr && cacheHome[0] == '/')
+		return std::string(cacheHome) + "/" NATIVE_CACHE_SUBDIRECTORY;
+
+	const char* home = std::getenv("HOME");
+
+	if (home == nullptr || home[0] != '/')
+	{
+		const passwd* user = getpwuid(getuid());
+		home = user != nullptr ? user->pw_dir : nullptr;
+	}
+
+	if (home == nullptr)
+		throw std::runtime_error("cannot find the home directory for the native library cache");
+
+	return std::string(home) + "/.cache/" NATIVE_CACHE_SUBDIRECTORY;
+}
+
+void NativeLibrary::build(const std::string& cacheDirectory, const std::string& compiler)
+{
+	const char* const flags[] = { "-std=c99", "-O2", "-fPIC", "-shared" };
+	std::vector<std::string> arguments;
+	std::istringstream words(compiler);
+	std::string word;
+
+	while (words >> word)
+		arguments.push_back(word);
+
+	for (const char* flag : flags)
+		arguments.push_back(flag);
+
+	if (arguments.size() == sizeof(flags) / sizeof(flags[0]))
+		throw std::runtime_error("no compiler given");
+
+	std::string command;
+
+	for (unsigned int i = 0; i < arguments.size(); i++)
+		command += (i > 0 ? " " : "") + arguments[i];
+
+	char name[32];
+
+	std::snprintf(name, sizeof(name), "exparse_%016llx", static_cast<unsigned long long>(hashString(command + "\n" + _source)));
+
+	std::string base = cacheDirectory + "/" + name;
+	_libraryPath = base + ".so";
+
+	if (!makeDirectories(cacheDirectory))
+		throw std::runtime_error("cannot create '" + cacheDirectory + "': " + std::strerror(errno));
+
+	checkPrivatePath(cacheDirectory, true);
+
+	struct stat info;
+
+	if (lstat(_libraryPath.c_str(), &info) == 0)
+		_loadedFromCache = true;
+	else
+	{
+		//Build under a private name and rename, so concurrent processes never load a partial file
+		std::string sourcePath = base + ".c";
+		std::string temporaryPath = base + "." + std::to_string(getpid()) + ".tmp";
+		std::ofstream file(sourcePath.c_str());
+
+		file << _source;
+		file.close();
+
+		if (!file)
+			throw std::runtime_error("cannot write '" + sourcePath + "'");
+
+		arguments.push_back("-o");
+		arguments.push_back(temporaryPath);
+		arguments.push_back(sourcePath);
+		arguments.push_back("-lm");
+
+		//The compiler's output follows the umask, which may leave it group writable
+		if (runProgram(arguments) != 0 || chmod(temporaryPath.c_str(), 0700) != 0 ||
+				std::rename(temporaryPath.c_str(), _libraryPath.c_str()) != 0)
+		{
+			std::remove(temporaryPath.c_str());
+			throw std::runtime_error("compiling '" + sourcePath + "' failed: " + command + " -o " + temporaryPath + " " + sourcePath + " -lm");
+		}
+	}
+
+	checkPrivatePath(_libraryPath, false);
+
+	_handle = dlopen(_libraryPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+	if (_handle == nullptr)
+		throw std::runtime_error(std::string("cannot load '") + _libraryPath + "': " + dlerror());
+}
+
+/** \brief Evaluates an expression with the current variable values
+ *
+ * \param index		The position of the expression in the list the library was built from
+ * \return			The value of the expression
+ *
+ */
+double NativeLibrary::evaluate(unsigned int index)
+{
+	assert(index < _scalar.size());
+	return _scalar[index](_variableContext.slots(), &_context);
+}
+
+/** \brief Evaluates an expression for every row of the variables bound with a stride
+ *
+ * \param index		The position of the expression in the list the library was built from
+ * \param rowCount	The number of rows
+ * \param results	Receives rowCount values
+ *
+ */
+void NativeLibrary::evaluateBatch(unsigned int index, std::size_t rowCount, double* results)
+{
+	assert(index < _batch.size());
+
+	std::vector<char*> bases(_batchVariables.size() + 1);
+	std::vector<std::size_t> strides(_batchVariables.size() + 1, 0);
+
+	for (unsigned int i = 0; i < _batchVariables.size(); i++)
+	{
+		double* base = _variableContext.rowBinding(_batchVariables[i], strides[i]);
+
+		if (base == nullptr)
+		{
+			base = _variableContext.slots()[_batchVariables[i] - 1];
+			strides[i] = 0;
+		}
+
+		bases[i] = reinterpret_cast<char*>(base);
+	}
+
+	_batch[index](rowCount, bases.data(), strides.data(), results, &_context);
+}
+
+double NativeLibrary::callThunk(void* context, unsigned int callee, const double* args, unsigned int count)
+{
+	NativeLibrary* library = static_cast<NativeLibrary*>(context);
+	Value buffer[NATIVE_CALL_STACK_ARGUMENTS];
+	std::vector<Value> overflow;
+	Value* values = buffer;
+
+	if (count > NATIVE_CALL_STACK_ARGUMENTS)
+	{
+		overflow.resize(count);
+		values = overflow.data();
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+		values[i] = Value(args[i]);
+
+	return library->_callees[callee].invoke(values, count, library->_variableContext).numeric;
+}
+
+uint64_t NativeLibrary::hashString(const std::string& str)
+{
+	//64-bit FNV-1a
+	uint64_t h = 14695981039346656037ull;
+
+	for (unsigned int i = 0; i < str.size(); i++)
+	{
+		h ^= static_cast<unsigned char>(str[i]);
+		h *= 1099511628211ull;
+	}
+
+	return h;
+}
@@ -0,0 +1,91 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef NATIVE_LIBRARY_H
+#define NATIVE_LIBRARY_H
+
+#include	<string>
+#include	<vector>
+#include	<cstdint>
+
+#include	"expression_parser.h"
+
+#define	NATIVE_CACHE_SUBDIRECTORY			"exparse"
+#define	NATIVE_DEFAULT_COMPILER				"cc"
+#define	NATIVE_CALL_STACK_ARGUMENTS			8		/**< Arguments of callbacks passed without a heap allocation */
+
+/** Expressions compiled ahead of time to C, built into a shared object and loaded with dlopen.
+ *
+ *  Each expression becomes two C functions: a scalar one reading the variables through the slot
+ *  table, and a batch one reading every variable bound with a stride row by row (others have the
+ *  same value in every row), with the same semantics as Program::evaluateBatch. Built-in operators
+ *  and functions become plain C arithmetic and direct libm calls; anything else registered in the
+ *  FunctionContext is called back through its NativeFunction. Generated code always uses libm, so
+ *  PRECISION_FAST approximations are not carried over.
+ *
+ *  Shared objects are cached under the cache directory by a hash of the generated source and the
+ *  compiler command, so later runs with the same expressions load the cached library without
+ *  invoking the compiler. Variable IDs are part of the source, so a cached library only matches a
+ *  VariableContext whose variables were created in the same order.
+ *
+ *  The cache directory defaults to $XDG_CACHE_HOME/exparse, or ~/.cache/exparse. It is created
+ *  with mode 0700, and it and any cached library must be owned by the current user and not be
+ *  writable by anyone else, since loading a library runs its code. The compiler is run directly,
+ *  without a shell; the compiler string is split on whitespace, so it may carry extra options.
+ *
+ *  Throws std::invalid_argument for expressions that cannot be exported (calls returning variable
+ *  references, or non-default functions taking them) and std::runtime_error if compiling or
+ *  loading fails.
+ */
+class NativeLibrary
+{
+	private:
+		typedef double (*ScalarFunction)(double* const* slots, void* context);
+		typedef void (*BatchFunction)(std::size_t rows, char* const* bases, const std::size_t* strides, double* out, void* context);
+
+		struct CallContext
+		{
+			double (*call)(void* self, unsigned int callee, const double* args, unsigned int count);
+			void* self;
+		};
+
+		VariableContext& _variableContext;
+		CallContext _context;
+		std::vector<NativeFunction> _callees;		/**< Non-default functions called back from generated code */
+		std::vector<unsigned int> _batchVariables;	/**< Variable IDs behind the batch functions' bases and strides */
+		std::vector<ScalarFunction> _scalar;
+		std::vector<BatchFunction> _batch;
+		std::string _source;
+		std::string _libraryPath;
+		void* _handle;
+		bool _loadedFromCache;
+
+		static double callThunk(void* context, unsigned int callee, const double* args, unsigned int count);
+		static uint64_t hashString(const std::string& str);
+
+		void build(const std::string& cacheDirectory, const std::string& compiler);
+
+	public:
+		NativeLibrary(const std::vector<const ExpressionParser*>& expressions,
+				const std::string& cacheDirectory = defaultCacheDirectory(),
+				const std::string& compiler = NATIVE_DEFAULT_COMPILER);
+		~NativeLibrary();
+
+		NativeLibrary(const NativeLibrary&) = delete;
+		NativeLibrary& operator=(const NativeLibrary&) = delete;
+
+		static std::string exportSource(const std::vector<const ExpressionParser*>& expressions);
+		static std::string defaultCacheDirectory();
+
+		unsigned int size() const { return _scalar.size(); }
+		const std::string& source() const { return _source; }
+		const std::string& libraryPath() const { return _libraryPath; }
+		bool loadedFromCache() const { return _loadedFromCache; }
+
+		double evaluate(unsigned int index);
+		void evaluateBatch(unsigned int index, std::size_t rowCount, double* results);
+};
+
+#endif
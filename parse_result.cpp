@@ -0,0 +1,170 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<sstream>
+
+#include	"parse_result.h"
+#include	"exputil.h"
+
+ParseResult ParseResult::unknownFunction(const std::string& name, unsigned int column)
+{
+	ParseResult r(UNKNOWN_FUNCTION, column);
+	r._text = name;
+	return r;
+}
+
+ParseResult ParseResult::unknownToken(unsigned int column)
+{
+	return ParseResult(UNKNOWN_TOKEN, column);
+}
+
+ParseResult ParseResult::unexpectedToken(const Token& t)
+{
+	if (t.type() == Token::END)
+		return unexpectedEnd(t.location());
+
+	ParseResult r(UNEXPECTED_TOKEN, t.location());
+	r._tokenType = t.type();
+	return r;
+}
+
+ParseResult ParseResult::unexpectedEnd(unsigned int column)
+{
+	return ParseResult(UNEXPECTED_END, column);
+}
+
+ParseResult ParseResult::malformedNumber(const std::string& text, unsigned int column)
+{
+	ParseResult r(MALFORMED_NUMBER, column);
+	r._text = text;
+	return r;
+}
+
+ParseResult ParseResult::malformedIdentifier(const std::string& text, unsigned int column)
+{
+	ParseResult r(MALFORMED_IDENTIFIER, column);
+	r._text = text;
+	return r;
+}
+
+ParseResult ParseResult::unmatchedParenthesis(const Token& t)
+{
+	return ParseResult(UNMATCHED_PARENTHESIS, t.location());
+}
+
+ParseResult ParseResult::invalidArgument(Token& t, unsigned int argumentIndex, const FunctionContext& fc)
+{
+	ParseResult r(INVALID_ARGUMENT, t.location());
+
+	r._functionContext = &fc;
+	r._isOperator = t.type() == Token::OPERATOR;
+	r._functionId = r._isOperator ? t.toOperator().id() : t.toFunction().id();
+	r._count = argumentIndex;
+
+	return r;
+}
+
+ParseResult ParseResult::invalidNumArguments(Token& t, const FunctionContext& fc)
+{
+	ParseResult r(INVALID_NUM_ARGUMENTS, t.location());
+
+	r._functionContext = &fc;
+	r._functionId = t.toFunction().id();
+	r._count = t.toFunction().arity();
+
+	return r;
+}
+
+ParseResult ParseResult::malformedDefinition(unsigned int column)
+{
+	return ParseResult(MALFORMED_DEFINITION, column);
+}
+
+ParseResult ParseResult::duplicateFunction(const std::string& name, unsigned int column)
+{
+	ParseResult r(DUPLICATE_FUNCTION, column);
+	r._text = name;
+	return r;
+}
+
+ParseResult ParseResult::recursiveDefinition(const std::string& name, unsigned int column)
+{
+	ParseResult r(RECURSIVE_DEFINITION, column);
+	r._text = name;
+	return r;
+}
+
+ParseResult ParseResult::undefinedVariable(const std::string& name, unsigned int column)
+{
+	ParseResult r(UNDEFINED_VARIABLE, column);
+	r._text = name;
+	return r;
+}
+
+ParseResult ParseResult::assignmentInDefinition(unsigned int column)
+{
+	return ParseResult(ASSIGNMENT_IN_DEFINITION, column);
+}
+
+/** \brief Returns a human-readable description of the error, formatting it on first use
+ *
+ * \return		The error message, or an empty string if parsing succeeded
+ *
+ */
+const std::string& ParseResult::message() const
+{
+	if (_code == OK || !_message.empty())
+		return _message;
+
+	std::stringstream s;
+
+	switch (_code)
+	{
+		case UNKNOWN_FUNCTION:		s << "Unknown function '" << _text << "'"; break;
+		case UNKNOWN_TOKEN:			s << "Unknown token"; break;
+		case UNEXPECTED_TOKEN:		s << "Unexpected " << Exparse::util::lookupTokenTypeString(_tokenType) << " token"; break;
+		case UNEXPECTED_END:		s << "Unexpected end of statement"; break;
+		case MALFORMED_NUMBER:		s << "Malformed number '" << _text << "'"; break;
+		case MALFORMED_IDENTIFIER:	s << "Malformed identifier '" << _text << "'"; break;
+		case UNMATCHED_PARENTHESIS:	s << "Unmatched parenthesis"; break;
+
+		case INVALID_ARGUMENT:
+		{
+			const Function* func = _isOperator ? _functionContext->lookupOperator(_functionId)
+					: _functionContext->lookupFunction(_functionId);
+
+			Handedness expected = _count < func->arity() ? func->argumentHandedness(_count) : HAND_RVALUE;
+
+			s << "Invalid argument: Expecting ";
+			s << (expected == HAND_LVALUE ? "variable reference" : expected == HAND_EXPRESSION ? "sub-expression" : "value");
+			s << " as argument " << _count + 1 << " for function '" << func->symbol() << "'";
+			break;
+		}
+
+		case INVALID_NUM_ARGUMENTS:
+		{
+			const Function* func = _functionContext->lookupFunction(_functionId);
+
+			s << "Invalid number of arguments for function '";
+			s << func->symbol() << "' (expecting ";
+
+			if (func->isVariadic())
+				s << " at least ";
+
+			s << func->arity() << " arguments but got " << _count << ")";
+			break;
+		}
+
+		case MALFORMED_DEFINITION:		s << "Malformed function definition, expecting 'name(parameters) = body'"; break;
+		case DUPLICATE_FUNCTION:		s << "Function '" << _text << "' is already defined"; break;
+		case RECURSIVE_DEFINITION:		s << "Function '" << _text << "' cannot call itself"; break;
+		case UNDEFINED_VARIABLE:		s << "'" << _text << "' is not a parameter of the function"; break;
+		case ASSIGNMENT_IN_DEFINITION:	s << "Function bodies cannot assign to variables"; break;
+		default: break;
+	}
+
+	_message = s.str();
+	return _message;
+}
@@ -0,0 +1,103 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef PARSE_RESULT_H
+#define PARSE_RESULT_H
+
+#include	<string>
+
+#include	"token.h"
+#include	"context.h"
+
+/** The outcome of parsing an expression, returned instead of throwing by the non-throwing entry points.
+ *
+ *  Only the error code, the column and the raw details are recorded when parsing fails; the
+ *  human-readable message is built the first time message() is called, so rejecting an
+ *  expression costs about as much as accepting it.
+ */
+class ParseResult
+{
+	public:
+		typedef enum ErrorCode
+		{
+			OK = 0,
+			UNKNOWN_FUNCTION,
+			UNKNOWN_TOKEN,
+			UNEXPECTED_TOKEN,
+			UNEXPECTED_END,
+			MALFORMED_NUMBER,
+			MALFORMED_IDENTIFIER,
+			UNMATCHED_PARENTHESIS,
+			INVALID_ARGUMENT,
+			INVALID_NUM_ARGUMENTS,
+			MALFORMED_DEFINITION,
+			DUPLICATE_FUNCTION,
+			RECURSIVE_DEFINITION,
+			UNDEFINED_VARIABLE,
+			ASSIGNMENT_IN_DEFINITION
+		} ErrorCode;
+
+	private:
+		ErrorCode _code;
+		unsigned int _column;
+		Token::TokenType _tokenType;				/**< Type of the offending token, for UNEXPECTED_TOKEN */
+		std::string _text;							/**< Offending source text, for unknown functions and malformed tokens */
+		const FunctionContext* _functionContext;	/**< For looking up function names of argument errors */
+		unsigned int _functionId;
+		bool _isOperator;
+		unsigned int _count;						/**< Argument index for INVALID_ARGUMENT, argument count for INVALID_NUM_ARGUMENTS */
+		mutable std::string _message;
+
+		ParseResult(ErrorCode code, unsigned int column) :
+			_code(code),
+			_column(column),
+			_tokenType(Token::NONE),
+			_functionContext(nullptr),
+			_functionId(NULLID),
+			_isOperator(false),
+			_count(0)
+		{ }
+
+	public:
+		ParseResult() :
+			_code(OK),
+			_column(0),
+			_tokenType(Token::NONE),
+			_functionContext(nullptr),
+			_functionId(NULLID),
+			_isOperator(false),
+			_count(0)
+		{ }
+
+		bool succeeded() const 		{ return _code == OK; }
+		bool failed() const 		{ return _code != OK; }
+		ErrorCode code() const 		{ return _code; }
+		unsigned int column() const { return _column; }
+
+		const std::string& message() const;
+
+		/** \brief Returns the offending name for errors that have one, such as the unknown function */
+		const std::string& subject() const { return _text; }
+
+		/** \brief Moves the error column, for results of parsing part of a longer string */
+		void offsetColumn(unsigned int offset) { if (_code != OK) _column += offset; }
+
+		static ParseResult unknownFunction(const std::string& name, unsigned int column);
+		static ParseResult unknownToken(unsigned int column);
+		static ParseResult unexpectedToken(const Token& t);
+		static ParseResult unexpectedEnd(unsigned int column);
+		static ParseResult malformedNumber(const std::string& text, unsigned int column);
+		static ParseResult malformedIdentifier(const std::string& text, unsigned int column);
+		static ParseResult unmatchedParenthesis(const Token& t);
+		static ParseResult invalidArgument(Token& t, unsigned int argumentIndex, const FunctionContext& fc);
+		static ParseResult invalidNumArguments(Token& t, const FunctionContext& fc);
+		static ParseResult malformedDefinition(unsigned int column);
+		static ParseResult duplicateFunction(const std::string& name, unsigned int column);
+		static ParseResult recursiveDefinition(const std::string& name, unsigned int column);
+		static ParseResult undefinedVariable(const std::string& name, unsigned int column);
+		static ParseResult assignmentInDefinition(unsigned int column);
+};
+
+#endif
@@ -0,0 +1,183 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<algorithm>
+#include	<chrono>
+#include	<cmath>
+
+#include	"predicate.h"
+#include	"expression_parser.h"
+#include	"expression_graph.h"
+
+namespace
+{
+	void collectConjuncts(const ExpressionGraph& graph, unsigned int node, std::vector<unsigned int>& conjuncts)
+	{
+		const ExpressionGraph::Node& n = graph.node(node);
+
+		if (n.type == ExpressionGraph::NODE_CALL && n.isOperator && graph.functionContext().isBuiltinOperator(n.id))
+		{
+			const Operator* op = static_cast<const Operator*>(graph.callee(n));
+
+			if (op->symbol() == "&&" && op->position() == Operator::POS_INFIX)
+			{
+				collectConjuncts(graph, n.arguments[0], conjuncts);
+				collectConjuncts(graph, n.arguments[1], conjuncts);
+				return;
+			}
+		}
+
+		//Shared nodes make repeated conjuncts identical
+		if (std::find(conjuncts.begin(), conjuncts.end(), node) == conjuncts.end())
+			conjuncts.push_back(node);
+	}
+
+	bool passes(double value)
+	{
+		return std::fabs(value) >= 0.5;
+	}
+}
+
+/** \brief Compiles a predicate
+ *
+ * \param expr	The boolean expression; throws a TokenizerException if it is malformed
+ * \param vc	The variable context that variable names are resolved in
+ * \param fc	The function context that operators and functions are resolved in
+ *
+ */
+Predicate::Predicate(const std::string& expr, VariableContext& vc, const FunctionContext& fc) :
+	_reorder(true)
+{
+	ExpressionParser parser(expr, vc, fc);
+	ExpressionGraph graph(fc);
+	unsigned int root = graph.addExpression(parser);
+	std::vector<unsigned int> conjuncts;
+
+	for (unsigned int i = 0; i < graph.size(); i++)
+		_reorder = _reorder && !graph.node(i).sideEffects;
+
+	if (_reorder)
+		collectConjuncts(graph, root, conjuncts);
+	else
+		conjuncts.push_back(root);
+
+	_conjuncts.resize(conjuncts.size());
+
+	for (unsigned int i = 0; i < conjuncts.size(); i++)
+	{
+		ExpressionGraph conjunctGraph(graph);
+		conjunctGraph.addOutput(conjuncts[i]);
+
+		Conjunct& c = _conjuncts[i];
+		c.program.reset(new Program(conjunctGraph, vc));
+		c.stats.rowsTested = 0;
+		c.stats.rowsPassed = 0;
+		c.stats.selectivity = 0.5;
+		c.stats.nanosecondsPerRow = 0.0;
+
+		_order.push_back(i);
+	}
+}
+
+/** \brief Finds the rows that satisfy the predicate
+ *
+ * Rows are read the same way as by Program::evaluateBatch().
+ *
+ * \param rowCount		The number of rows
+ * \param selection		Receives the numbers of the matching rows in increasing order
+ * \return				The number of matching rows
+ *
+ */
+std::size_t Predicate::filter(std::size_t rowCount, std::vector<std::size_t>& selection)
+{
+	selection.clear();
+
+	for (std::size_t first = 0; first < rowCount; first += PREDICATE_CHUNK_SIZE)
+	{
+		std::size_t count = std::min<std::size_t>(PREDICATE_CHUNK_SIZE, rowCount - first);
+
+		_chunk.resize(count);
+		_results.resize(count);
+
+		for (std::size_t k = 0; k < count; k++)
+			_chunk[k] = first + k;
+
+		for (unsigned int position = 0; position < _order.size() && count > 0; position++)
+		{
+			Conjunct& c = _conjuncts[_order[position]];
+			double* columns[1] = { _results.data() };
+			std::size_t passed = 0;
+
+			auto start = std::chrono::steady_clock::now();
+			c.program->evaluateSelection(_chunk.data(), count, columns);
+
+			//Compact the selection in place; it only ever shrinks
+			for (std::size_t k = 0; k < count; k++)
+			{
+				_chunk[passed] = _chunk[k];
+				passed += passes(_results[k]);
+			}
+
+			auto elapsed = std::chrono::steady_clock::now() - start;
+			record(c, count, passed, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+			count = passed;
+		}
+
+		selection.insert(selection.end(), _chunk.begin(), _chunk.begin() + count);
+
+		if (_reorder)
+			updateOrder();
+	}
+
+	return selection.size();
+}
+
+/** \brief Tests the predicate once with the current variable values, stopping at the first conjunct that fails
+ *
+ * \return		Whether the predicate holds
+ *
+ */
+bool Predicate::test()
+{
+	for (unsigned int position = 0; position < _order.size(); position++)
+		if (!passes(_conjuncts[_order[position]].program->evaluate()))
+			return false;
+
+	return true;
+}
+
+void Predicate::record(Conjunct& conjunct, std::size_t tested, std::size_t passed, uint64_t nanoseconds)
+{
+	ConjunctStats& s = conjunct.stats;
+	double selectivity = static_cast<double>(passed) / tested;
+	double cost = static_cast<double>(nanoseconds) / tested;
+
+	if (s.rowsTested == 0)
+	{
+		s.selectivity = selectivity;
+		s.nanosecondsPerRow = cost;
+	}
+	else
+	{
+		s.selectivity += PREDICATE_STATS_WEIGHT * (selectivity - s.selectivity);
+		s.nanosecondsPerRow += PREDICATE_STATS_WEIGHT * (cost - s.nanosecondsPerRow);
+	}
+
+	s.rowsTested += tested;
+	s.rowsPassed += passed;
+}
+
+void Predicate::updateOrder()
+{
+	//Testing a before b is cheaper on average when cost(a) / (1 - sel(a)) < cost(b) / (1 - sel(b)).
+	//Conjuncts that were never reached rank first so that they get measured.
+	auto rank = [this](unsigned int i)
+	{
+		const ConjunctStats& s = _conjuncts[i].stats;
+		return s.rowsTested == 0 ? 0.0 : s.nanosecondsPerRow / std::max(1.0 - s.selectivity, 1e-6);
+	};
+
+	std::stable_sort(_order.begin(), _order.end(), [&rank](unsigned int a, unsigned int b) { return rank(a) < rank(b); });
+}
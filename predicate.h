@@ -0,0 +1,77 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include	<string>
+#include	<vector>
+#include	<memory>
+#include	<cstdint>
+
+#include	"context.h"
+#include	"program.h"
+
+#define	PREDICATE_CHUNK_SIZE		4096
+#define	PREDICATE_STATS_WEIGHT		0.25		/**< Weight of the latest chunk in the running selectivity and cost estimates */
+
+/** Runtime statistics of one conjunct of a Predicate.
+ *
+ *  Only rows that passed the conjuncts ordered before it are tested, so the selectivity is
+ *  conditional on them.
+ */
+struct ConjunctStats
+{
+	uint64_t rowsTested;
+	uint64_t rowsPassed;
+	double selectivity;				/**< Running estimate of the fraction of tested rows that pass */
+	double nanosecondsPerRow;		/**< Running estimate of the cost of testing a row */
+};
+
+/** A boolean expression used to select rows of the variables bound with a stride.
+ *
+ *  The expression is split at its top-level '&&' operators into conjuncts, each compiled to its own
+ *  Program. filter() works through the rows in chunks of PREDICATE_CHUNK_SIZE: the first conjunct
+ *  is evaluated for every row of the chunk, each following one only for the rows that passed so
+ *  far, and a chunk stops as soon as no row is left. A value passes when its magnitude is at least
+ *  0.5, like the operands of '&&'.
+ *
+ *  Between chunks the conjuncts are reordered by their measured cost per row divided by the
+ *  fraction of rows they reject, so that cheap, selective tests run first. Expressions that assign
+ *  to variables are kept whole, since skipping or reordering their parts would change the writes.
+ *
+ *  Like Program, a predicate must not be evaluated from several threads at once.
+ */
+class Predicate
+{
+	private:
+		struct Conjunct
+		{
+			std::unique_ptr<Program> program;
+			ConjunctStats stats;
+		};
+
+		std::vector<Conjunct> _conjuncts;
+		std::vector<unsigned int> _order;		/**< Conjunct indices in evaluation order */
+		bool _reorder;
+
+		std::vector<std::size_t> _chunk;
+		std::vector<double> _results;
+
+		void record(Conjunct& conjunct, std::size_t tested, std::size_t passed, uint64_t nanoseconds);
+		void updateOrder();
+
+	public:
+		Predicate(const std::string& expr, VariableContext& vc, const FunctionContext& fc);
+
+		std::size_t filter(std::size_t rowCount, std::vector<std::size_t>& selection);
+		bool test();
+
+		unsigned int conjunctCount() const { return _conjuncts.size(); }
+		const std::vector<unsigned int>& order() const { return _order; }
+		const ConjunctStats& stats(unsigned int conjunct) const { assert(conjunct < _conjuncts.size()); return _conjuncts[conjunct].stats; }
+};
+
+#endif
@@ -0,0 +1,1098 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<algorithm>
+#include	<climits>
+#include	<cmath>
+#include	<cstring>
+
+#include	"program.h"
+#include	"expression_parser.h"
+#include	"vector_kernels.h"
+#include	"default_operations.h"
+
+namespace
+{
+	struct GuardRegion
+	{
+		unsigned int condition;		/**< Node of the condition */
+		bool whenTrue;
+		unsigned int parent;
+		unsigned int members;
+		bool hasCall;
+	};
+
+	struct AllRows
+	{
+		unsigned int operator[](unsigned int k) const { return k; }
+	};
+
+	struct SelectedRows
+	{
+		const unsigned int* rows;
+
+		unsigned int operator[](unsigned int k) const { return rows[k]; }
+	};
+
+	/** \brief Runs the program compiled from the body of an argument passed unevaluated */
+	class ProgramSubexpression : public Subexpression
+	{
+		private:
+			Program _program;
+
+		public:
+			ProgramSubexpression(const ExpressionGraph& body, VariableContext& vc, Precision precision) :
+				_program(body, vc, precision)
+			{ }
+
+			double evaluate(VariableContext&) { return _program.evaluate(); }
+	};
+
+	/** \brief Picks the kernel of a default arithmetic operator, or returns false for other functions */
+	bool arithmeticKind(const NativeFunction& native, Program::Arithmetic& kind)
+	{
+		if (native.kind() == NativeFunction::CALL_UNARY)
+		{
+			kind = Program::ARITHMETIC_NEGATE;
+			return native.unaryTarget() == &DefaultOperator::minus;
+		}
+
+		if (native.kind() != NativeFunction::CALL_BINARY)
+			return false;
+
+		BinaryFunctionPointer f = native.binaryTarget();
+
+		if (f == &DefaultOperator::addition)
+			kind = Program::ARITHMETIC_ADD;
+		else if (f == &DefaultOperator::subtraction)
+			kind = Program::ARITHMETIC_SUBTRACT;
+		else if (f == &DefaultOperator::multiplication)
+			kind = Program::ARITHMETIC_MULTIPLY;
+		else if (f == &DefaultOperator::division)
+			kind = Program::ARITHMETIC_DIVIDE;
+		else
+			return false;
+
+		return true;
+	}
+
+	/** \brief Runs an arithmetic instruction over a whole block, where the rows are contiguous */
+	inline void arithmetic(unsigned int kind, double* dest, const double* a, const double* b, unsigned int count, AllRows)
+	{
+		switch (kind)
+		{
+			case Program::ARITHMETIC_ADD:		Exparse::kernels::add(dest, a, b, count); break;
+			case Program::ARITHMETIC_SUBTRACT:	Exparse::kernels::subtract(dest, a, b, count); break;
+			case Program::ARITHMETIC_MULTIPLY:	Exparse::kernels::multiply(dest, a, b, count); break;
+			case Program::ARITHMETIC_DIVIDE:	Exparse::kernels::divide(dest, a, b, count); break;
+			case Program::ARITHMETIC_NEGATE:	Exparse::kernels::negate(dest, a, count); break;
+		}
+	}
+
+	/** \brief Runs an arithmetic instruction over the rows selected by a guard */
+	template <typename Rows>
+	inline void arithmetic(unsigned int kind, double* dest, const double* a, const double* b, unsigned int count, Rows rows)
+	{
+		for (unsigned int k = 0; k < count; k++)
+		{
+			unsigned int r = rows[k];
+
+			switch (kind)
+			{
+				case Program::ARITHMETIC_ADD:		dest[r] = a[r] + b[r]; break;
+				case Program::ARITHMETIC_SUBTRACT:	dest[r] = a[r] - b[r]; break;
+				case Program::ARITHMETIC_MULTIPLY:	dest[r] = a[r] * b[r]; break;
+				case Program::ARITHMETIC_DIVIDE:	dest[r] = a[r] / b[r]; break;
+				case Program::ARITHMETIC_NEGATE:	dest[r] = -a[r]; break;
+			}
+		}
+	}
+
+	bool passes(double value)
+	{
+		return std::fabs(value) >= 0.5;
+	}
+
+	/** \brief Evaluates a polynomial with Horner's rule, one dependent multiply-add per coefficient */
+	inline double horner(const double* coefficients, unsigned int count, double x)
+	{
+		double result = coefficients[count - 1];
+
+		for (unsigned int k = count - 1; k-- > 0; )
+			result = Exparse::multiplyAdd(result, x, coefficients[k]);
+
+		return result;
+	}
+
+	/** \brief Evaluates a polynomial in Estrin's form: pairs of terms are combined independently with powers of x^2,
+	 *  which shortens the chain of dependent operations from n to about 2 log2(n) */
+	inline double estrin(const double* coefficients, unsigned int count, double x)
+	{
+		double terms[POLYNOMIAL_MAX_DEGREE + 1];
+		double power = x;
+
+		for (unsigned int k = 0; k < count; k++)
+			terms[k] = coefficients[k];
+
+		while (count > 1)
+		{
+			unsigned int k;
+
+			for (k = 0; k + 1 < count; k += 2)
+				terms[k / 2] = Exparse::multiplyAdd(terms[k + 1], power, terms[k]);
+
+			if (k < count)
+				terms[k / 2] = terms[k];
+
+			count = (count + 1) / 2;
+			power *= power;
+		}
+
+		return terms[0];
+	}
+
+	/** \brief Finds the innermost region containing two others; UINT_MAX stands for no region yet */
+	unsigned int commonRegion(const std::vector<GuardRegion>& regions, unsigned int a, unsigned int b)
+	{
+		if (a == UINT_MAX)
+			return b;
+
+		for (unsigned int x = a; x != 0; x = regions[x].parent)
+			for (unsigned int y = b; y != 0; y = regions[y].parent)
+				if (x == y)
+					return x;
+
+		return 0;
+	}
+
+	bool conditionsPrecede(const std::vector<GuardRegion>& regions, unsigned int region, unsigned int node)
+	{
+		for (unsigned int x = region; x != 0; x = regions[x].parent)
+			if (regions[x].condition >= node)
+				return false;
+
+		return true;
+	}
+
+	/** \brief Works out for which rows each node is needed
+	 *
+	 * Every argument of if() but the condition opens a region, nested in the region of the if()
+	 * itself. A node belongs to the innermost region containing all of its users; outputs and
+	 * nodes that are not pure belong to region 0, which is every row. Regions that are too cheap
+	 * to be worth masking are merged into their parent.
+	 *
+	 * \param graph		The graph being compiled
+	 * \param live		The live nodes of the graph
+	 * \param selectId	The function ID of if()
+	 * \param regions	Receives the regions
+	 * \return			The region of each live node
+	 *
+	 */
+	std::vector<unsigned int> assignRegions(const ExpressionGraph& graph, const std::vector<bool>& live, unsigned int selectId,
+			std::vector<GuardRegion>& regions)
+	{
+		std::vector<unsigned int> region(graph.size(), UINT_MAX);
+		GuardRegion all = { 0, true, 0, 0, false };
+
+		regions.assign(1, all);
+
+		for (unsigned int i = 0; i < graph.outputs().size(); i++)
+			region[graph.outputs()[i]] = 0;
+
+		//Users come after their arguments, so a node's region is final when the sweep reaches it
+		for (unsigned int i = graph.size(); i-- > 0; )
+		{
+			if (!live[i])
+				continue;
+
+			const ExpressionGraph::Node& n = graph.node(i);
+			unsigned int r = n.type == ExpressionGraph::NODE_CALL && !n.pure ? 0 : region[i];
+
+			//A guarded node runs after the conditions guarding it
+			while (r != 0 && !conditionsPrecede(regions, r, i))
+				r = regions[r].parent;
+
+			region[i] = r;
+
+			if (n.type != ExpressionGraph::NODE_CONSTANT && n.type != ExpressionGraph::NODE_REFERENCE)
+			{
+				regions[r].members++;
+				regions[r].hasCall = regions[r].hasCall || (n.type == ExpressionGraph::NODE_CALL && !n.isOperator && n.id != selectId);
+			}
+
+			bool select = n.type == ExpressionGraph::NODE_CALL && !n.isOperator && n.id == selectId;
+
+			for (unsigned int j = 0; j < n.arguments.size(); j++)
+			{
+				unsigned int argumentRegion = r;
+
+				if (select && j > 0)
+				{
+					GuardRegion branch = { n.arguments[0], j == 1, r, 0, false };
+					regions.push_back(branch);
+					argumentRegion = regions.size() - 1;
+				}
+
+				region[n.arguments[j]] = commonRegion(regions, region[n.arguments[j]], argumentRegion);
+			}
+		}
+
+		//Regions are created after their parents
+		std::vector<unsigned int> merged(regions.size(), 0);
+
+		for (unsigned int g = 1; g < regions.size(); g++)
+		{
+			regions[g].parent = merged[regions[g].parent];
+			merged[g] = regions[g].hasCall || regions[g].members > PROGRAM_BLEND_LIMIT ? g : regions[g].parent;
+		}
+
+		for (unsigned int i = 0; i < graph.size(); i++)
+			if (region[i] != UINT_MAX)
+				region[i] = merged[region[i]];
+
+		return region;
+	}
+}
+
+Program::Program(const ExpressionGraph& graph, VariableContext& vc) :
+	_variableContext(vc),
+	_registerCount(0),
+	_effects(EFFECT_NONE),
+	_hasSideEffects(false),
+	_flushDenormals(graph.functionContext().flushDenormals()),
+	_selection(nullptr),
+	_runStamp(0)
+{
+	compile(graph, graph.functionContext().precision());
+}
+
+Program::Program(const ExpressionGraph& graph, VariableContext& vc, Precision precision) :
+	_variableContext(vc),
+	_registerCount(0),
+	_effects(EFFECT_NONE),
+	_hasSideEffects(false),
+	_flushDenormals(graph.functionContext().flushDenormals()),
+	_selection(nullptr),
+	_runStamp(0)
+{
+	compile(graph, precision);
+}
+
+/** \brief Compiles several expressions into one program with one output per expression
+ *
+ * Subexpressions and variable reads shared between the expressions are computed once.
+ *
+ * \param expressions	The expressions to compile; throws a TokenizerException if one is malformed
+ * \param vc			The variable context that variable names are resolved in
+ * \param fc			The function context that operators and functions are resolved in
+ * \return				The fused program
+ *
+ */
+Program Program::fuse(const std::vector<std::string>& expressions, VariableContext& vc, const FunctionContext& fc)
+{
+	ExpressionGraph graph(fc);
+
+	for (unsigned int i = 0; i < expressions.size(); i++)
+	{
+		ExpressionParser parser(expressions[i], vc, fc);
+		graph.addOutput(graph.addExpression(parser));
+	}
+
+	return Program(graph, vc);
+}
+
+/** \brief Compiles a multi-statement script whose assignments only reach the listed variables
+ *
+ * Variables assigned in the script but not listed are temporaries that live in registers and are
+ * never written to the variable context; assignments that are overwritten or never read are
+ * removed. Listed variables receive the last value assigned to them once the script has run.
+ *
+ * \param script		Statements separated by ';'; throws a TokenizerException if malformed
+ * \param outputs		Names of the variables to write back
+ * \param vc			The variable context that variable names are resolved in
+ * \param fc			The function context that operators and functions are resolved in
+ * \return				A program whose single output is the value of the last statement
+ *
+ */
+Program Program::script(const std::string& script, const std::vector<std::string>& outputs, VariableContext& vc,
+		const FunctionContext& fc)
+{
+	ExpressionParser parser(script, vc, fc);
+	ExpressionGraph graph(fc);
+	std::vector<unsigned int> writtenBack;
+
+	for (unsigned int i = 0; i < outputs.size(); i++)
+		writtenBack.push_back(vc.getId(outputs[i]));
+
+	graph.forwardStores(writtenBack);
+
+	unsigned int result = graph.addExpression(parser);
+
+	graph.writeBack();
+	graph.addOutput(result);
+
+	return Program(graph, vc);
+}
+
+void Program::compile(const ExpressionGraph& graph, Precision precision)
+{
+	const FunctionContext& fc = graph.functionContext();
+	std::vector<bool> live = graph.liveNodes();
+	std::vector<unsigned int> registers(graph.size(), UINT_MAX);
+	std::vector<unsigned int> lastUse(graph.size(), 0);
+	std::vector<unsigned int> freeRegisters;
+
+	//A register is released after the last instruction that reads it; outputs and constants are never released
+	for (unsigned int i = 0; i < graph.size(); i++)
+	{
+		lastUse[i] = i;
+
+		if (live[i])
+			for (unsigned int j = 0; j < graph.node(i).arguments.size(); j++)
+				lastUse[graph.node(i).arguments[j]] = i;
+	}
+
+	for (unsigned int i = 0; i < graph.outputs().size(); i++)
+		lastUse[graph.outputs()[i]] = UINT_MAX;
+
+	unsigned int selectId = fc.getFunctionID("if");
+	std::vector<GuardRegion> regions;
+	std::vector<unsigned int> region = assignRegions(graph, live, selectId, regions);
+	std::vector<unsigned int> guardOfRegion(regions.size(), UINT_MAX);
+	std::vector<unsigned int> instructionOf(graph.size(), UINT_MAX);
+	Guard all = { 0, 0, true, 0 };
+
+	_guards.assign(1, all);
+	guardOfRegion[0] = 0;
+
+	//Conditions stay in their registers as long as they guard instructions
+	for (unsigned int i = 0; i < graph.size(); i++)
+		if (live[i] && region[i] != UINT_MAX)
+			for (unsigned int x = region[i]; x != 0; x = regions[x].parent)
+				lastUse[regions[x].condition] = std::max(lastUse[regions[x].condition], i);
+
+	for (unsigned int i = 0; i < graph.size(); i++)
+	{
+		if (!live[i])
+			continue;
+
+		const ExpressionGraph::Node& n = graph.node(i);
+		Instruction ins;
+
+		ins.opcode = OP_CONSTANT;
+		ins.a = 0;
+		ins.b = 0;
+		ins.operand = 0;
+		ins.guard = 0;
+
+		switch (n.type)
+		{
+			case ExpressionGraph::NODE_REFERENCE:
+			case ExpressionGraph::NODE_EXPRESSION:
+				//References are passed by variable ID and sub-expressions as compiled bodies; neither occupies a register
+				continue;
+
+			case ExpressionGraph::NODE_CONSTANT:
+				ins.opcode = OP_CONSTANT;
+				ins.operand = _constants.size();
+				_constants.push_back(n.value);
+				break;
+
+			case ExpressionGraph::NODE_POLYNOMIAL:
+				//The form is fixed here so that every row, batched or not, is rounded the same way
+				ins.opcode = n.coefficients.size() > PROGRAM_ESTRIN_DEGREE ? OP_ESTRIN : OP_POLYNOMIAL;
+				ins.a = registers[n.arguments[0]];
+				ins.b = n.coefficients.size();
+				ins.operand = _constants.size();
+				_constants.insert(_constants.end(), n.coefficients.begin(), n.coefficients.end());
+				break;
+
+			case ExpressionGraph::NODE_LOAD:
+				ins.opcode = OP_LOAD;
+				ins.operand = n.id;
+				ins.b = _loadVariables.size();
+				_loadVariables.push_back(n.id);
+				_loadInputs.push_back(nullptr);
+				break;
+
+			case ExpressionGraph::NODE_INPUT:
+				//Read like a variable without a row binding, but from the caller's storage
+				ins.opcode = OP_LOAD;
+				ins.operand = NULLID;
+				ins.b = _loadVariables.size();
+				_loadVariables.push_back(NULLID);
+				_loadInputs.push_back(graph.inputLocation(n));
+				break;
+
+			case ExpressionGraph::NODE_CALL:
+			{
+				if (!n.isOperator && n.id == selectId)
+				{
+					ins.opcode = OP_SELECT;
+					ins.a = registers[n.arguments[0]];
+					ins.b = registers[n.arguments[1]];
+					ins.operand = registers[n.arguments[2]];
+					break;
+				}
+
+				const NativeFunction& native = n.isOperator ? fc.operatorTable(precision)[n.id - 1]
+						: fc.functionTable(precision)[n.id - 1];
+				Arithmetic kind;
+
+				_effects |= n.effects;
+				_hasSideEffects = _hasSideEffects || n.sideEffects;
+
+				if (n.isOperator && arithmeticKind(native, kind))
+				{
+					ins.opcode = OP_ARITHMETIC;
+					ins.a = registers[n.arguments[0]];
+					ins.b = registers[n.arguments[n.arguments.size() - 1]];
+					ins.operand = kind;
+					break;
+				}
+
+				ins.operand = _functions.size();
+				_functions.push_back(native);
+
+				if (native.kind() == NativeFunction::CALL_UNARY)
+				{
+					ins.opcode = OP_UNARY;
+					ins.a = registers[n.arguments[0]];
+				}
+				else if (native.kind() == NativeFunction::CALL_BINARY)
+				{
+					ins.opcode = OP_BINARY;
+					ins.a = registers[n.arguments[0]];
+					ins.b = registers[n.arguments[1]];
+				}
+				else
+				{
+					ins.opcode = OP_CALL;
+					ins.a = _arguments.size();
+					ins.b = n.arguments.size();
+
+					for (unsigned int j = 0; j < n.arguments.size(); j++)
+					{
+						const ExpressionGraph::Node& arg = graph.node(n.arguments[j]);
+						Operand op;
+
+						op.reference = arg.type == ExpressionGraph::NODE_REFERENCE;
+						op.index = op.reference ? arg.id : registers[n.arguments[j]];
+						op.expression = nullptr;
+
+						if (arg.type == ExpressionGraph::NODE_EXPRESSION)
+						{
+							_subexpressions.push_back(std::make_shared<ProgramSubexpression>(graph.body(arg), _variableContext, precision));
+							op.expression = _subexpressions.back().get();
+							op.index = 0;
+						}
+
+						_arguments.push_back(op);
+					}
+
+					if (_callScratch.size() < n.arguments.size())
+						_callScratch.resize(n.arguments.size());
+				}
+
+				break;
+			}
+		}
+
+		//Arguments read for the last time may share the destination, since every instruction reads row r before writing it
+		for (unsigned int j = 0; j < n.arguments.size(); j++)
+		{
+			unsigned int arg = n.arguments[j];
+
+			if (lastUse[arg] == i && registers[arg] != UINT_MAX && graph.node(arg).type != ExpressionGraph::NODE_CONSTANT &&
+					std::find(n.arguments.begin(), n.arguments.begin() + j, arg) == n.arguments.begin() + j)
+				freeRegisters.push_back(registers[arg]);
+		}
+
+		if (ins.opcode == OP_CONSTANT || freeRegisters.empty())
+			ins.dest = _registerCount++;
+		else
+		{
+			ins.dest = freeRegisters.back();
+			freeRegisters.pop_back();
+		}
+
+		registers[i] = ins.dest;
+
+		if (ins.opcode == OP_CONSTANT)
+			_prologue.push_back(ins);
+		else
+		{
+			//Guards are created outermost first, once their conditions have been compiled
+			std::vector<unsigned int> chain;
+
+			for (unsigned int x = region[i]; guardOfRegion[x] == UINT_MAX; x = regions[x].parent)
+				chain.push_back(x);
+
+			while (!chain.empty())
+			{
+				const GuardRegion& r = regions[chain.back()];
+				Guard g = { registers[r.condition], instructionOf[r.condition], r.whenTrue, guardOfRegion[r.parent] };
+
+				guardOfRegion[chain.back()] = _guards.size();
+				_guards.push_back(g);
+				chain.pop_back();
+			}
+
+			ins.guard = guardOfRegion[region[i]];
+			instructionOf[i] = _body.size();
+			_body.push_back(ins);
+			_hoistable.push_back(n.type == ExpressionGraph::NODE_LOAD || n.pure);
+		}
+
+		//Results nobody reads, such as those of assignments, are dropped straight away
+		if (lastUse[i] == i && ins.opcode != OP_CONSTANT)
+			freeRegisters.push_back(ins.dest);
+	}
+
+	for (unsigned int i = 0; i < graph.outputs().size(); i++)
+		_outputs.push_back(registers[graph.outputs()[i]]);
+}
+
+void Program::prepareLoads(bool useRowBindings)
+{
+	double* const* slots = _variableContext.slots();
+
+	_loadSources.resize(_loadVariables.size());
+
+	for (unsigned int i = 0; i < _loadVariables.size(); i++)
+	{
+		LoadSource& source = _loadSources[i];
+		const double* base = _loadInputs[i];
+
+		source.stride = 0;
+
+		if (base == nullptr && useRowBindings)
+			base = _variableContext.rowBinding(_loadVariables[i], source.stride);
+
+		if (base == nullptr)
+		{
+			//Variables without a row binding hold the same value for every row
+			base = slots[_loadVariables[i] - 1];
+			source.stride = 0;
+		}
+
+		source.base = reinterpret_cast<const char*>(base);
+	}
+}
+
+/** \brief Splits the body into instructions that give the same result for every row of the batch and the rest
+ *
+ * Must follow prepareLoads(true). Hoisted instructions write registers numbered from registerCount()
+ * up, one each, so that their results survive the whole batch; the varying code and the batch
+ * outputs are renamed to read them there.
+ *
+ * \return		The number of registers the batch needs
+ *
+ */
+unsigned int Program::hoistUniforms()
+{
+	//Maps each register to where its current value lives, and whether that value is the same for all rows
+	std::vector<unsigned int> location(_registerCount);
+	std::vector<bool> uniform(_registerCount, false);
+	unsigned int registerCount = _registerCount;
+
+	for (unsigned int r = 0; r < _registerCount; r++)
+		location[r] = r;
+
+	for (unsigned int i = 0; i < _prologue.size(); i++)
+		uniform[_prologue[i].dest] = true;
+
+	_uniformCode.clear();
+	_varyingCode.clear();
+	_varyingArguments.clear();
+	_batchOutputs.clear();
+	_batchGuards = _guards;
+
+	for (unsigned int i = 0; i < _body.size(); i++)
+	{
+		Instruction ins = _body[i];
+		bool isUniform = _hoistable[i] && ins.guard == 0;
+
+		switch (ins.opcode)
+		{
+			case OP_LOAD:
+				isUniform = isUniform && _loadSources[ins.b].stride == 0;
+				break;
+
+			case OP_UNARY:
+			case OP_POLYNOMIAL:
+			case OP_ESTRIN:
+				isUniform = isUniform && uniform[ins.a];
+				ins.a = location[ins.a];
+				break;
+
+			case OP_BINARY:
+			case OP_ARITHMETIC:
+				isUniform = isUniform && uniform[ins.a] && uniform[ins.b];
+				ins.a = location[ins.a];
+				ins.b = location[ins.b];
+				break;
+
+			case OP_SELECT:
+				isUniform = isUniform && uniform[ins.a] && uniform[ins.b] && uniform[ins.operand];
+				ins.a = location[ins.a];
+				ins.b = location[ins.b];
+				ins.operand = location[ins.operand];
+				break;
+
+			case OP_CALL:
+			{
+				unsigned int first = _varyingArguments.size();
+
+				for (unsigned int k = 0; k < ins.b; k++)
+				{
+					Operand op = _arguments[ins.a + k];
+
+					if (!op.reference && op.expression == nullptr)
+					{
+						isUniform = isUniform && uniform[op.index];
+						op.index = location[op.index];
+					}
+
+					_varyingArguments.push_back(op);
+				}
+
+				ins.a = first;
+				break;
+			}
+
+			default: assert(false);
+		}
+
+		uniform[ins.dest] = isUniform;
+
+		if (isUniform)
+		{
+			location[ins.dest] = registerCount;
+			ins.dest = registerCount++;
+			_uniformCode.push_back(ins);
+		}
+		else
+		{
+			location[ins.dest] = ins.dest;
+			_varyingCode.push_back(ins);
+		}
+
+		for (unsigned int g = 1; g < _batchGuards.size(); g++)
+			if (_batchGuards[g].instruction == i)
+				_batchGuards[g].condition = ins.dest;
+	}
+
+	for (unsigned int k = 0; k < _outputs.size(); k++)
+		_batchOutputs.push_back(location[_outputs[k]]);
+
+	return registerCount;
+}
+
+void Program::run(const std::vector<Instruction>& code, const std::vector<Operand>& arguments, const std::vector<Guard>& guards,
+		unsigned int width, std::size_t firstRow, unsigned int rows)
+{
+	_runStamp++;
+
+	for (auto it = code.begin(); it != code.end(); ++it)
+	{
+		if (it->guard == 0)
+		{
+			execute(*it, arguments, width, firstRow, rows, AllRows());
+			continue;
+		}
+
+		const std::vector<unsigned int>& selected = guardRows(guards, it->guard, width, rows);
+
+		if (!selected.empty())
+		{
+			SelectedRows selectedRows = { selected.data() };
+			execute(*it, arguments, width, firstRow, selected.size(), selectedRows);
+		}
+	}
+}
+
+/** \brief Returns the rows of the current block selected by a guard, computing them on first use in a run
+ *
+ * \param guards	The guard table of the code being run
+ * \param guard		The guard, not 0
+ * \param width		The number of rows a register holds
+ * \param rows		The number of rows in the block
+ * \return			The selected rows in increasing order
+ *
+ */
+const std::vector<unsigned int>& Program::guardRows(const std::vector<Guard>& guards, unsigned int guard, unsigned int width,
+		unsigned int rows)
+{
+	if (_guardRows.size() < guards.size())
+	{
+		_guardRows.resize(guards.size());
+		_guardStamps.resize(guards.size(), 0);
+	}
+
+	std::vector<unsigned int>& selected = _guardRows[guard];
+
+	if (_guardStamps[guard] == _runStamp)
+		return selected;
+
+	const Guard& g = guards[guard];
+	const double* condition = _registers.data() + g.condition * width;
+
+	selected.clear();
+
+	if (g.parent == 0)
+	{
+		for (unsigned int r = 0; r < rows; r++)
+			if (passes(condition[r]) == g.whenTrue)
+				selected.push_back(r);
+	}
+	else
+	{
+		const std::vector<unsigned int>& candidates = guardRows(guards, g.parent, width, rows);
+
+		for (unsigned int k = 0; k < candidates.size(); k++)
+			if (passes(condition[candidates[k]]) == g.whenTrue)
+				selected.push_back(candidates[k]);
+	}
+
+	_guardStamps[guard] = _runStamp;
+	return selected;
+}
+
+/** \brief Runs one instruction for some rows of a block
+ *
+ * \param rows		Maps 0 .. count - 1 to the rows of the block to compute
+ *
+ */
+template <typename Rows>
+void Program::execute(const Instruction& ins, const std::vector<Operand>& arguments, unsigned int width, std::size_t firstRow,
+		unsigned int count, Rows rows)
+{
+	double* regs = _registers.data();
+	double* dest = regs + ins.dest * width;
+
+	switch (ins.opcode)
+	{
+		case OP_CONSTANT:
+		{
+			double c = _constants[ins.operand];
+
+			for (unsigned int k = 0; k < count; k++)
+				dest[rows[k]] = c;
+
+			break;
+		}
+
+		case OP_LOAD:
+		{
+			const LoadSource& source = _loadSources[ins.b];
+
+			if (_selection != nullptr)
+			{
+				const std::size_t* selected = _selection + firstRow;
+
+				for (unsigned int k = 0; k < count; k++)
+				{
+					unsigned int r = rows[k];
+					dest[r] = *reinterpret_cast<const double*>(source.base + selected[r] * source.stride);
+				}
+
+				break;
+			}
+
+			const char* p = source.base + firstRow * source.stride;
+
+			for (unsigned int k = 0; k < count; k++)
+			{
+				unsigned int r = rows[k];
+				dest[r] = *reinterpret_cast<const double*>(p + r * source.stride);
+			}
+
+			break;
+		}
+
+		case OP_UNARY:
+		{
+			UnaryFunctionPointer f = _functions[ins.operand].unaryTarget();
+			const double* a = regs + ins.a * width;
+
+			for (unsigned int k = 0; k < count; k++)
+			{
+				unsigned int r = rows[k];
+				dest[r] = f(a[r]);
+			}
+
+			break;
+		}
+
+		case OP_BINARY:
+		{
+			BinaryFunctionPointer f = _functions[ins.operand].binaryTarget();
+			const double* a = regs + ins.a * width;
+			const double* b = regs + ins.b * width;
+
+			for (unsigned int k = 0; k < count; k++)
+			{
+				unsigned int r = rows[k];
+				dest[r] = f(a[r], b[r]);
+			}
+
+			break;
+		}
+
+		case OP_ARITHMETIC:
+			arithmetic(ins.operand, dest, regs + ins.a * width, regs + ins.b * width, count, rows);
+			break;
+
+		case OP_CALL:
+		{
+			const NativeFunction& f = _functions[ins.operand];
+			const Operand* operands = &arguments[ins.a];
+			Value* args = _callScratch.data();
+
+			for (unsigned int k = 0; k < count; k++)
+			{
+				unsigned int r = rows[k];
+
+				for (unsigned int j = 0; j < ins.b; j++)
+					args[j] = operands[j].expression != nullptr ? Value(operands[j].expression)
+							: operands[j].reference ? Value(operands[j].index) : Value(regs[operands[j].index * width + r]);
+
+				dest[r] = f.invoke(args, ins.b, _variableContext).numeric;
+			}
+
+			break;
+		}
+
+		case OP_POLYNOMIAL:
+		{
+			const double* coefficients = &_constants[ins.operand];
+			const double* a = regs + ins.a * width;
+
+			for (unsigned int k = 0; k < count; k++)
+			{
+				unsigned int r = rows[k];
+				dest[r] = horner(coefficients, ins.b, a[r]);
+			}
+
+			break;
+		}
+
+		case OP_ESTRIN:
+		{
+			const double* coefficients = &_constants[ins.operand];
+			const double* a = regs + ins.a * width;
+
+			for (unsigned int k = 0; k < count; k++)
+			{
+				unsigned int r = rows[k];
+				dest[r] = estrin(coefficients, ins.b, a[r]);
+			}
+
+			break;
+		}
+
+		case OP_SELECT:
+		{
+			//Rows of the branch not taken may hold anything, including values left over from other blocks
+			const double* condition = regs + ins.a * width;
+			const double* a = regs + ins.b * width;
+			const double* b = regs + ins.operand * width;
+
+			for (unsigned int k = 0; k < count; k++)
+			{
+				unsigned int r = rows[k];
+				dest[r] = passes(condition[r]) ? a[r] : b[r];
+			}
+
+			break;
+		}
+	}
+}
+
+void Program::runOnce()
+{
+	_registers.resize(_registerCount);
+	prepareLoads(false);
+
+	run(_prologue, _arguments, _guards, 1, 0, 1);
+	run(_body, _arguments, _guards, 1, 0, 1);
+}
+
+/** \brief Evaluates the program once with the current variable values
+ *
+ * \return		The value of the first output, or 0 if the program has none
+ *
+ */
+double Program::evaluate()
+{
+	Exparse::DenormalFlushGuard fpGuard(_flushDenormals);
+
+	runOnce();
+	return _outputs.empty() ? 0.0 : _registers[_outputs[0]];
+}
+
+/** \brief Evaluates the program once with the current variable values
+ *
+ * \param results	Receives one value per output
+ *
+ */
+void Program::evaluate(double* results)
+{
+	Exparse::DenormalFlushGuard fpGuard(_flushDenormals);
+
+	runOnce();
+
+	for (unsigned int k = 0; k < _outputs.size(); k++)
+		results[k] = _registers[_outputs[k]];
+}
+
+/** \brief Evaluates the program for every row of the variables bound with a stride
+ *
+ * Variables bound with VariableContext::bind(name, base, stride) are read from row 0 to
+ * rowCount - 1; every other variable has the same value for all rows. Programs that
+ * assign to variables run one row at a time so that each row sees the writes of the
+ * previous ones, and so do programs passing sub-expressions, which read the variables
+ * of the current row; all others run a block of rows per instruction. Either way the row
+ * selected with VariableContext::setRow() is the same afterwards.
+ *
+ * \param rowCount		The number of rows to evaluate
+ * \param outputColumns	One array of rowCount doubles per output
+ *
+ */
+void Program::evaluateBatch(std::size_t rowCount, double* const* outputColumns)
+{
+	Exparse::DenormalFlushGuard fpGuard(_flushDenormals);
+
+	_selection = nullptr;
+	runBatch(0, rowCount, outputColumns, nullptr);
+}
+
+/** \brief Evaluates the program for some rows of the variables bound with a stride
+ *
+ * Works like evaluateBatch(), except that result k is computed from row rows[k].
+ *
+ * \param rows			The row numbers to evaluate
+ * \param count			The number of row numbers
+ * \param outputColumns	One array of count doubles per output
+ *
+ */
+void Program::evaluateSelection(const std::size_t* rows, std::size_t count, double* const* outputColumns)
+{
+	Exparse::DenormalFlushGuard fpGuard(_flushDenormals);
+
+	_selection = rows;
+	runBatch(0, count, outputColumns, nullptr);
+	_selection = nullptr;
+}
+
+/** \brief Evaluates the program for a range of rows, feeding the results to reduction sinks instead of storing them
+ *
+ * Rows are read like by evaluateBatch(). Each sink consumes the results of its output one
+ * block of up to PROGRAM_BLOCK_SIZE rows at a time, straight from the registers, so no output
+ * column is materialised.
+ *
+ * \param rowCount		The number of rows to evaluate
+ * \param sinks			One sink per output
+ * \param firstRow		The first row to evaluate
+ *
+ */
+void Program::reduceBatch(std::size_t rowCount, ReductionSink* const* sinks, std::size_t firstRow)
+{
+	Exparse::DenormalFlushGuard fpGuard(_flushDenormals);
+
+	_selection = nullptr;
+	runBatch(firstRow, rowCount, nullptr, sinks);
+}
+
+/** \brief Stores or reduces the results of a block
+ *
+ * \param outputs		The registers holding the results
+ * \param width			The number of rows a register holds
+ * \param position		Where the block starts in the output columns
+ * \param firstRow		The row the block starts at
+ * \param rows			The number of rows in the block
+ *
+ */
+void Program::emit(const std::vector<unsigned int>& outputs, unsigned int width, std::size_t position, std::size_t firstRow,
+		unsigned int rows, double* const* outputColumns, ReductionSink* const* sinks)
+{
+	for (unsigned int k = 0; k < outputs.size(); k++)
+	{
+		const double* results = &_registers[static_cast<std::size_t>(outputs[k]) * width];
+
+		if (sinks != nullptr)
+			sinks[k]->consume(results, rows, firstRow);
+		else
+			std::memcpy(outputColumns[k] + position, results, rows * sizeof(double));
+	}
+}
+
+void Program::runBatch(std::size_t firstRow, std::size_t rowCount, double* const* outputColumns, ReductionSink* const* sinks)
+{
+	if (_hasSideEffects || !_subexpressions.empty())
+	{
+		//Results are gathered into blocks so that sinks see the same blocks as in the other mode
+		const unsigned int width = PROGRAM_BLOCK_SIZE;
+		std::vector<double, AlignedAllocator<double> > block(_outputs.size() * width);
+
+		//Rows are selected one at a time with setRow(); the caller's selection is put back afterwards
+		VariableContext::RowGuard rowGuard(_variableContext);
+
+		_registers.resize(_registerCount);
+		run(_prologue, _arguments, _guards, 1, 0, 1);
+
+		for (std::size_t row = 0; row < rowCount; row++)
+		{
+			_variableContext.setRow(_selection != nullptr ? _selection[row] : firstRow + row);
+			prepareLoads(false);
+			run(_body, _arguments, _guards, 1, 0, 1);
+
+			for (unsigned int k = 0; k < _outputs.size(); k++)
+				block[k * width + row % width] = _registers[_outputs[k]];
+
+			if (row % width == width - 1 || row == rowCount - 1)
+			{
+				unsigned int rows = row % width + 1;
+
+				for (unsigned int k = 0; k < _outputs.size(); k++)
+				{
+					if (sinks != nullptr)
+						sinks[k]->consume(&block[k * width], rows, firstRow + row + 1 - rows);
+					else
+						std::memcpy(outputColumns[k] + row + 1 - rows, &block[k * width], rows * sizeof(double));
+				}
+			}
+		}
+
+		return;
+	}
+
+	const unsigned int width = PROGRAM_BLOCK_SIZE;
+
+	prepareLoads(true);
+
+	unsigned int registerCount = hoistUniforms();
+
+	_registers.resize(static_cast<std::size_t>(registerCount) * width);
+	run(_prologue, _arguments, _guards, width, 0, width);
+
+	//Hoisted instructions compute row 0 only, which is then copied to the rest of the block
+	run(_uniformCode, _varyingArguments, _batchGuards, width, 0, 1);
+
+	for (unsigned int i = 0; i < _uniformCode.size(); i++)
+	{
+		double* dest = &_registers[_uniformCode[i].dest * width];
+		std::fill(dest + 1, dest + width, dest[0]);
+	}
+
+	for (std::size_t first = 0; first < rowCount; first += width)
+	{
+		unsigned int rows = static_cast<unsigned int>(std::min<std::size_t>(width, rowCount - first));
+
+		run(_varyingCode, _varyingArguments, _batchGuards, width, firstRow + first, rows);
+		emit(_batchOutputs, width, first, firstRow + first, rows, outputColumns, sinks);
+	}
+}
@@ -0,0 +1,177 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include	<string>
+#include	<vector>
+#include	<cstdint>
+#include	<memory>
+
+#include	"context.h"
+#include	"expression_graph.h"
+#include	"aligned_allocator.h"
+#include	"reduction.h"
+
+#define		PROGRAM_BLOCK_SIZE		128
+#define		PROGRAM_ESTRIN_DEGREE	6		/**< Polynomials of higher degree are compiled to Estrin's form rather than Horner's */
+#define		PROGRAM_BLEND_LIMIT		8		/**< Branches of if() with at most this many operators and no function calls are not masked */
+
+/** Register code lowered from an ExpressionGraph, with one result per graph output.
+ *
+ *  Registers are reused once the node they hold has no readers left. In batch mode a register holds a block of
+ *  PROGRAM_BLOCK_SIZE rows and each instruction runs over the whole block before the next one,
+ *  so every shared subexpression and input column is computed once per row for all outputs.
+ *  The default arithmetic operators run as SIMD kernels over the block rather than through
+ *  function pointers.
+ *  Constants are materialised once per call rather than once per block, and so is every pure
+ *  instruction that only depends on constants and on variables without a row binding: those
+ *  are hoisted out of the row loop and their results broadcast to the whole block.
+ *
+ *  Instructions only needed by one branch of if() are guarded: they run only for the rows of the
+ *  block whose condition selects that branch, and OP_SELECT then picks each row's result. Branches
+ *  that are cheap enough are computed for every row and blended instead. Instructions that are not
+ *  pure always run for every row, so results and side effects match the interpreter, which
+ *  evaluates both branches.
+ *
+ *  A program keeps scratch space for its registers, so it must not be evaluated from several
+ *  threads at once.
+ */
+class Program
+{
+	public:
+		typedef enum Opcode
+		{
+			OP_CONSTANT,		/**< dest = constants[operand] */
+			OP_LOAD,			/**< dest = value of variable operand, or of an input, read through load source b */
+			OP_UNARY,			/**< dest = functions[operand](a) */
+			OP_BINARY,			/**< dest = functions[operand](a, b) */
+			OP_CALL,			/**< dest = functions[operand](arguments[a .. a + b)) */
+			OP_SELECT,			/**< dest = a ? b : operand, where a holds if it passes as a boolean */
+			OP_POLYNOMIAL,		/**< dest = sum of constants[operand + k] * a^k for k < b, by Horner's rule */
+			OP_ESTRIN,			/**< Like OP_POLYNOMIAL, in Estrin's form */
+			OP_ARITHMETIC		/**< dest = a op b for the default operator op selected by operand, or -a when b == a for negation */
+		} Opcode;
+
+		typedef enum Arithmetic
+		{
+			ARITHMETIC_ADD,
+			ARITHMETIC_SUBTRACT,
+			ARITHMETIC_MULTIPLY,
+			ARITHMETIC_DIVIDE,
+			ARITHMETIC_NEGATE
+		} Arithmetic;
+
+		struct Instruction
+		{
+			Opcode opcode;
+			unsigned int dest;
+			unsigned int a;
+			unsigned int b;
+			unsigned int operand;
+			unsigned int guard;		/**< The guard giving the rows the instruction runs for; 0 for all rows */
+		};
+
+		struct Operand
+		{
+			bool reference;			/**< Whether index is a variable ID passed by reference rather than a register */
+			unsigned int index;
+			Subexpression* expression;	/**< A sub-expression passed unevaluated, or null */
+		};
+
+	private:
+		struct LoadSource
+		{
+			const char* base;
+			std::size_t stride;
+		};
+
+		struct Guard
+		{
+			unsigned int condition;		/**< Register holding the condition of the if() */
+			unsigned int instruction;	/**< Body instruction computing the condition */
+			bool whenTrue;				/**< Whether the rows where the condition holds are selected, or the others */
+			unsigned int parent;		/**< Only rows selected by the parent guard are considered */
+		};
+
+		VariableContext& _variableContext;
+		std::vector<Instruction> _prologue;		/**< Runs once per call to evaluate() or evaluateBatch() */
+		std::vector<Instruction> _body;			/**< Runs for every row */
+		std::vector<bool> _hoistable;			/**< Per body instruction: whether it may run once for all rows of a batch */
+		std::vector<double> _constants;
+		std::vector<NativeFunction> _functions;
+		std::vector<Operand> _arguments;
+		std::vector<std::shared_ptr<Subexpression> > _subexpressions;	/**< Compiled bodies of the sub-expressions passed to calls */
+		std::vector<unsigned int> _loadVariables;
+		std::vector<const double*> _loadInputs;	/**< Per load: the caller's storage read by an input node, or null for a variable */
+		std::vector<unsigned int> _outputs;
+		std::vector<Guard> _guards;				/**< _guards[0] selects every row */
+		unsigned int _registerCount;
+		unsigned int _effects;
+		bool _hasSideEffects;
+		bool _flushDenormals;
+
+		std::vector<double, AlignedAllocator<double> > _registers;
+		std::vector<LoadSource> _loadSources;
+		std::vector<Value> _callScratch;
+
+		std::vector<Instruction> _uniformCode;		/**< Body instructions hoisted out of the current batch's row loop */
+		std::vector<Instruction> _varyingCode;		/**< The rest of the body, reading hoisted results from their own registers */
+		std::vector<Operand> _varyingArguments;
+		std::vector<unsigned int> _batchOutputs;
+		const std::size_t* _selection;				/**< Row numbers that batch row r reads, or null to read row r */
+		std::vector<Guard> _batchGuards;
+		std::vector<std::vector<unsigned int> > _guardRows;		/**< Rows of the current block selected by each guard */
+		std::vector<uint64_t> _guardStamps;						/**< The run the rows of each guard were computed for */
+		uint64_t _runStamp;
+
+	public:
+		Program(const ExpressionGraph& graph, VariableContext& vc);
+		Program(const ExpressionGraph& graph, VariableContext& vc, Precision precision);
+
+		static Program fuse(const std::vector<std::string>& expressions, VariableContext& vc, const FunctionContext& fc);
+		static Program script(const std::string& script, const std::vector<std::string>& outputs, VariableContext& vc,
+				const FunctionContext& fc);
+
+		unsigned int outputCount() const { return _outputs.size(); }
+		unsigned int registerCount() const { return _registerCount; }
+		unsigned int instructionCount() const { return _prologue.size() + _body.size(); }
+		bool hasSideEffects() const { return _hasSideEffects; }
+
+		/** \brief Returns the union of the Effect flags of every call the program makes
+		 *
+		 * Without EFFECT_READS_CONTEXT or EFFECT_WRITES_CONTEXT rows are independent, so separate programs may evaluate
+		 * disjoint blocks of rows concurrently; without any flags results may also be cached.
+		 */
+		unsigned int effects() const { return _effects; }
+
+		void setFlushDenormals(bool enable) { _flushDenormals = enable; }
+
+		double evaluate();
+		void evaluate(double* results);
+		void evaluateBatch(std::size_t rowCount, double* const* outputColumns);
+		void evaluateSelection(const std::size_t* rows, std::size_t count, double* const* outputColumns);
+		void reduceBatch(std::size_t rowCount, ReductionSink* const* sinks, std::size_t firstRow = 0);
+
+	private:
+		void compile(const ExpressionGraph& graph, Precision precision);
+		void prepareLoads(bool useRowBindings);
+		void runOnce();
+		void runBatch(std::size_t firstRow, std::size_t rowCount, double* const* outputColumns, ReductionSink* const* sinks);
+		void emit(const std::vector<unsigned int>& outputs, unsigned int width, std::size_t position, std::size_t firstRow,
+				unsigned int rows, double* const* outputColumns, ReductionSink* const* sinks);
+		unsigned int hoistUniforms();
+		void run(const std::vector<Instruction>& code, const std::vector<Operand>& arguments, const std::vector<Guard>& guards,
+				unsigned int width, std::size_t firstRow, unsigned int rows);
+		const std::vector<unsigned int>& guardRows(const std::vector<Guard>& guards, unsigned int guard, unsigned int width,
+				unsigned int rows);
+
+		template <typename Rows>
+		void execute(const Instruction& ins, const std::vector<Operand>& arguments, unsigned int width, std::size_t firstRow,
+				unsigned int count, Rows rows);
+};
+
+#endif
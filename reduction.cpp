@@ -0,0 +1,353 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<cmath>
+#include	<limits>
+#include	<atomic>
+#include	<thread>
+#include	<mutex>
+#include	<exception>
+#include	<stdexcept>
+#include	<algorithm>
+#include	<assert.h>
+
+#include	"reduction.h"
+#include	"program.h"
+
+namespace
+{
+	/** \brief Sums by recursive halving, so each value takes part in about log2(count) additions */
+	double pairwiseSum(const double* values, std::size_t count)
+	{
+		if (count <= REDUCTION_PAIRWISE_BLOCK)
+		{
+			double sum = 0.0;
+
+			for (std::size_t i = 0; i < count; i++)
+				sum += values[i];
+
+			return sum;
+		}
+
+		std::size_t half = count / 2;
+		return pairwiseSum(values, half) + pairwiseSum(values + half, count - half);
+	}
+
+	/** \brief Adds a value to a sum with Neumaier's compensation */
+	inline void compensatedAdd(double& sum, double& compensation, double value)
+	{
+		double t = sum + value;
+
+		if (std::fabs(sum) >= std::fabs(value))
+			compensation += (sum - t) + value;
+		else
+			compensation += (value - t) + sum;
+
+		sum = t;
+	}
+}
+
+Aggregate::Aggregate(Summation summation) :
+	_summation(summation),
+	_count(0),
+	_positiveCount(0),
+	_sum(0.0),
+	_compensation(0.0),
+	_min(std::numeric_limits<double>::infinity()),
+	_max(-std::numeric_limits<double>::infinity())
+{ }
+
+void Aggregate::consume(const double* values, std::size_t count, std::size_t)
+{
+	uint64_t positive = 0;
+	double low = _min;
+	double high = _max;
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		double v = values[i];
+
+		positive += v > 0.0;
+		low = v < low ? v : low;
+		high = v > high ? v : high;
+	}
+
+	_count += count;
+	_positiveCount += positive;
+	_min = low;
+	_max = high;
+
+	switch (_summation)
+	{
+		case SUMMATION_PLAIN:
+			for (std::size_t i = 0; i < count; i++)
+				_sum += values[i];
+
+			break;
+
+		case SUMMATION_KAHAN:
+			for (std::size_t i = 0; i < count; i++)
+				compensatedAdd(_sum, _compensation, values[i]);
+
+			break;
+
+		case SUMMATION_PAIRWISE:
+			if (count > 0)
+				addLevel(pairwiseSum(values, count), count);
+
+			break;
+	}
+}
+
+/** \brief Appends the sum of the next run of rows, combining runs of similar length so the tree stays balanced */
+void Aggregate::addLevel(double sum, uint64_t count)
+{
+	Level level = { sum, count };
+	_levels.push_back(level);
+
+	while (_levels.size() >= 2 && _levels[_levels.size() - 2].count <= _levels.back().count)
+	{
+		Level last = _levels.back();
+		_levels.pop_back();
+
+		_levels.back().sum += last.sum;
+		_levels.back().count += last.count;
+	}
+}
+
+void Aggregate::merge(const ReductionSink& partial)
+{
+	assert(dynamic_cast<const Aggregate*>(&partial) != nullptr);
+	const Aggregate& other = static_cast<const Aggregate&>(partial);
+
+	assert(other._summation == _summation);
+
+	_count += other._count;
+	_positiveCount += other._positiveCount;
+	_min = std::min(_min, other._min);
+	_max = std::max(_max, other._max);
+
+	switch (_summation)
+	{
+		case SUMMATION_PLAIN:
+			_sum += other._sum;
+			break;
+
+		case SUMMATION_KAHAN:
+			compensatedAdd(_sum, _compensation, other._sum);
+			_compensation += other._compensation;
+			break;
+
+		case SUMMATION_PAIRWISE:
+			for (unsigned int i = 0; i < other._levels.size(); i++)
+				addLevel(other._levels[i].sum, other._levels[i].count);
+
+			break;
+	}
+}
+
+std::unique_ptr<ReductionSink> Aggregate::partial() const
+{
+	return std::unique_ptr<ReductionSink>(new Aggregate(_summation));
+}
+
+double Aggregate::sum() const
+{
+	if (_summation == SUMMATION_KAHAN)
+		return _sum + _compensation;
+
+	if (_summation == SUMMATION_PLAIN)
+		return _sum;
+
+	//The smallest runs come last; adding them first loses the least
+	double sum = 0.0;
+
+	for (unsigned int i = _levels.size(); i-- > 0; )
+		sum += _levels[i].sum;
+
+	return sum;
+}
+
+/** \brief Returns the mean of the results, or NaN if there were none */
+double Aggregate::mean() const
+{
+	return _count > 0 ? sum() / _count : std::numeric_limits<double>::quiet_NaN();
+}
+
+/** \brief Returns the smallest result, or NaN if no result was a number */
+double Aggregate::min() const
+{
+	return _min <= _max ? _min : std::numeric_limits<double>::quiet_NaN();
+}
+
+/** \brief Returns the largest result, or NaN if no result was a number */
+double Aggregate::max() const
+{
+	return _min <= _max ? _max : std::numeric_limits<double>::quiet_NaN();
+}
+
+/** \brief Constructor
+ *
+ * \param lower		The lower edge of the first bin
+ * \param upper		The upper edge of the last bin; must be greater than lower
+ * \param binCount	The number of bins; must not be 0
+ *
+ */
+Histogram::Histogram(double lower, double upper, unsigned int binCount) :
+	_lower(lower),
+	_upper(upper),
+	_scale(binCount / (upper - lower)),
+	_bins(binCount, 0),
+	_underflow(0),
+	_overflow(0),
+	_nanCount(0)
+{
+	if (binCount == 0 || !(lower < upper) || !std::isfinite(_scale))
+		throw std::invalid_argument("a histogram needs at least one bin over a finite range");
+}
+
+void Histogram::consume(const double* values, std::size_t count, std::size_t)
+{
+	const unsigned int last = _bins.size() - 1;
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		double v = values[i];
+
+		if (v < _lower)
+			_underflow++;
+		else if (v >= _upper)
+			_overflow++;
+		else if (!std::isnan(v))
+		{
+			//Rounding may put values just below upper one past the last bin
+			unsigned int bin = static_cast<unsigned int>((v - _lower) * _scale);
+			_bins[std::min(bin, last)]++;
+		}
+		else
+			_nanCount++;
+	}
+}
+
+void Histogram::merge(const ReductionSink& partial)
+{
+	assert(dynamic_cast<const Histogram*>(&partial) != nullptr);
+	const Histogram& other = static_cast<const Histogram&>(partial);
+
+	assert(other._bins.size() == _bins.size());
+
+	for (unsigned int i = 0; i < _bins.size(); i++)
+		_bins[i] += other._bins[i];
+
+	_underflow += other._underflow;
+	_overflow += other._overflow;
+	_nanCount += other._nanCount;
+}
+
+std::unique_ptr<ReductionSink> Histogram::partial() const
+{
+	return std::unique_ptr<ReductionSink>(new Histogram(_lower, _upper, _bins.size()));
+}
+
+namespace Exparse
+{
+	/** \brief Reduces the results of a program over many rows on several threads
+	 *
+	 * Rows are split into chunks of REDUCTION_CHUNK_ROWS. Workers claim chunks from a shared
+	 * counter and reduce each into fresh partials with their own copy of the program, and the
+	 * partials are merged into the sinks in chunk order. The results therefore do not depend on
+	 * the number of threads or on how the chunks were scheduled. Programs whose calls read or
+	 * write the variable context run on the calling thread alone.
+	 *
+	 * \param program		The program; rows are read like by Program::evaluateBatch()
+	 * \param rowCount		The number of rows to evaluate
+	 * \param sinks			One sink per output of the program
+	 * \param threadCount	The number of threads to use, or 0 to use one per hardware thread
+	 *
+	 */
+	void reduceParallel(const Program& program, std::size_t rowCount, ReductionSink* const* sinks, unsigned int threadCount)
+	{
+		const unsigned int outputs = program.outputCount();
+		std::size_t chunks = (rowCount + REDUCTION_CHUNK_ROWS - 1) / REDUCTION_CHUNK_ROWS;
+
+		if (outputs == 0 || chunks == 0)
+			return;
+
+		if (threadCount == 0)
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+		if (program.effects() & (EFFECT_READS_CONTEXT | EFFECT_WRITES_CONTEXT))
+			threadCount = 1;
+
+		threadCount = static_cast<unsigned int>(std::min<std::size_t>(threadCount, chunks));
+
+		std::vector<std::vector<std::unique_ptr<ReductionSink> > > partials(chunks);
+		std::atomic<std::size_t> nextChunk(0);
+		std::size_t merged = 0;
+		std::mutex mergeMutex;
+		std::exception_ptr failure;
+
+		auto worker = [&]()
+		{
+			try
+			{
+				Program local(program);
+				std::vector<ReductionSink*> targets(outputs);
+				std::size_t chunk;
+
+				while ((chunk = nextChunk.fetch_add(1, std::memory_order_relaxed)) < chunks)
+				{
+					std::vector<std::unique_ptr<ReductionSink> > parts(outputs);
+					std::size_t first = chunk * REDUCTION_CHUNK_ROWS;
+
+					for (unsigned int k = 0; k < outputs; k++)
+					{
+						parts[k] = sinks[k]->partial();
+						targets[k] = parts[k].get();
+					}
+
+					local.reduceBatch(std::min<std::size_t>(REDUCTION_CHUNK_ROWS, rowCount - first), targets.data(), first);
+
+					//Whoever completes the next chunk in row order merges it, and any finished ones after it
+					std::lock_guard<std::mutex> lock(mergeMutex);
+					partials[chunk].swap(parts);
+
+					while (merged < chunks && !partials[merged].empty())
+					{
+						for (unsigned int k = 0; k < outputs; k++)
+							sinks[k]->merge(*partials[merged][k]);
+
+						partials[merged].clear();
+						merged++;
+					}
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(mergeMutex);
+
+				if (!failure)
+					failure = std::current_exception();
+
+				//Stop the other workers from claiming more work
+				nextChunk.store(chunks);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		threads.reserve(threadCount - 1);
+
+		for (unsigned int i = 1; i < threadCount; i++)
+			threads.push_back(std::thread(worker));
+
+		worker();
+
+		for (auto it = threads.begin(); it != threads.end(); ++it)
+			it->join();
+
+		if (failure)
+			std::rethrow_exception(failure);
+	}
+}
@@ -0,0 +1,132 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef REDUCTION_H
+#define REDUCTION_H
+
+#include	<vector>
+#include	<memory>
+#include	<cstdint>
+#include	<cstddef>
+
+#define		REDUCTION_CHUNK_ROWS		65536	/**< Rows reduced into each partial by Exparse::reduceParallel() */
+#define		REDUCTION_PAIRWISE_BLOCK	8		/**< Values summed in a plain loop at the leaves of pairwise summation */
+
+class Program;
+
+/** Consumes the results of a batch evaluation one block at a time, see Program::reduceBatch().
+ *
+ *  A sink sees each block while it is still in cache and keeps only what it needs, so the
+ *  results of a batch are never stored. To reduce in parallel every worker fills partials,
+ *  empty sinks of the same configuration, which are then merged into the sink in row order.
+ */
+class ReductionSink
+{
+	public:
+		virtual ~ReductionSink() { }
+
+		/** \brief Takes the next block of results
+		 *
+		 * \param values	The results, in row order
+		 * \param count		The number of results
+		 * \param firstRow	The row the first result was computed from
+		 *
+		 */
+		virtual void consume(const double* values, std::size_t count, std::size_t firstRow) = 0;
+
+		/** \brief Folds in a partial that saw the rows following those seen so far
+		 *
+		 * \param partial	A sink returned by partial() on this sink
+		 *
+		 */
+		virtual void merge(const ReductionSink& partial) = 0;
+
+		/** \brief Returns an empty sink with the same configuration */
+		virtual std::unique_ptr<ReductionSink> partial() const = 0;
+};
+
+typedef enum Summation
+{
+	SUMMATION_PLAIN,		/**< A running sum; fastest, with an error growing linearly with the row count */
+	SUMMATION_KAHAN,		/**< A running sum with Neumaier's compensation; the error does not grow with the row count */
+	SUMMATION_PAIRWISE		/**< Blocks summed by halving and block sums combined in a balanced tree; the error grows with its log */
+} Summation;
+
+/** Counts, sums and extremes of the results, as needed for sum, mean, min, max and the number of
+ *  positive results. NaN results are counted and summed but never become the minimum or maximum.
+ */
+class Aggregate : public ReductionSink
+{
+	private:
+		struct Level
+		{
+			double sum;
+			uint64_t count;
+		};
+
+		Summation _summation;
+		uint64_t _count;
+		uint64_t _positiveCount;
+		double _sum;
+		double _compensation;			/**< SUMMATION_KAHAN: the low-order part lost from _sum */
+		double _min;
+		double _max;
+		std::vector<Level> _levels;		/**< SUMMATION_PAIRWISE: sums of runs of rows, larger runs first */
+
+		void addLevel(double sum, uint64_t count);
+
+	public:
+		Aggregate(Summation summation = SUMMATION_KAHAN);
+
+		void consume(const double* values, std::size_t count, std::size_t firstRow);
+		void merge(const ReductionSink& partial);
+		std::unique_ptr<ReductionSink> partial() const;
+
+		Summation summation() const { return _summation; }
+		uint64_t count() const { return _count; }
+		uint64_t positiveCount() const { return _positiveCount; }
+		double sum() const;
+		double mean() const;
+		double min() const;
+		double max() const;
+};
+
+/** Counts the results falling into equally wide bins over [lower, upper).
+ *
+ *  Results below lower, at or above upper, and NaN results are counted separately.
+ */
+class Histogram : public ReductionSink
+{
+	private:
+		double _lower;
+		double _upper;
+		double _scale;					/**< Bins per unit */
+		std::vector<uint64_t> _bins;
+		uint64_t _underflow;
+		uint64_t _overflow;
+		uint64_t _nanCount;
+
+	public:
+		Histogram(double lower, double upper, unsigned int binCount);
+
+		void consume(const double* values, std::size_t count, std::size_t firstRow);
+		void merge(const ReductionSink& partial);
+		std::unique_ptr<ReductionSink> partial() const;
+
+		double lower() const { return _lower; }
+		double upper() const { return _upper; }
+		unsigned int binCount() const { return _bins.size(); }
+		uint64_t bin(unsigned int index) const { return _bins[index]; }
+		uint64_t underflow() const { return _underflow; }
+		uint64_t overflow() const { return _overflow; }
+		uint64_t nanCount() const { return _nanCount; }
+};
+
+namespace Exparse
+{
+	void reduceParallel(const Program& program, std::size_t rowCount, ReductionSink* const* sinks, unsigned int threadCount = 0);
+}
+
+#endif
@@ -0,0 +1,446 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<cmath>
+#include	<limits>
+#include	<deque>
+#include	<stdexcept>
+#include	<unordered_map>
+#include	<algorithm>
+
+#include	"stream_expression.h"
+#include	"expression_parser.h"
+
+namespace
+{
+	const double notANumber = std::numeric_limits<double>::quiet_NaN();
+
+	/** \brief The last n samples, oldest first once the ring is full */
+	class SampleRing
+	{
+		private:
+			std::vector<double> _samples;
+			std::size_t _next;
+			std::size_t _size;
+
+		public:
+			SampleRing(std::size_t capacity) :
+				_samples(capacity),
+				_next(0),
+				_size(0)
+			{ }
+
+			std::size_t capacity() const { return _samples.size(); }
+			bool full() const { return _size == _samples.size(); }
+
+			/** \brief Returns the sample the next push() replaces, which is the oldest once the ring is full */
+			double oldest() const { return _samples[_next]; }
+
+			void push(double sample)
+			{
+				_samples[_next] = sample;
+				_next = _next + 1 == _samples.size() ? 0 : _next + 1;
+				_size = std::min(_size + 1, _samples.size());
+			}
+
+			void clear()
+			{
+				_next = 0;
+				_size = 0;
+			}
+	};
+
+	class Ema : public Window
+	{
+		private:
+			double _weight;
+			double _value;
+
+		public:
+			Ema(double span) :
+				_weight(2.0 / (span + 1.0)),
+				_value(notANumber)
+			{ }
+
+			double push(double sample)
+			{
+				if (std::isnan(sample))
+					return _value;
+
+				_value = std::isnan(_value) ? sample : _value + _weight * (sample - _value);
+				return _value;
+			}
+
+			void reset() { _value = notANumber; }
+	};
+
+	typedef enum Moment
+	{
+		MOMENT_SUM,
+		MOMENT_MEAN,
+		MOMENT_VARIANCE
+	} Moment;
+
+	/** Rolling sum, mean or variance. The sum is kept with Neumaier's compensation and the variance
+	 *  with Welford's updates, run backwards for the sample leaving the window, so neither drifts
+	 *  over long streams the way a plain running sum would.
+	 */
+	class RollingMoment : public Window
+	{
+		private:
+			Moment _moment;
+			SampleRing _ring;
+			std::size_t _count;			/**< Samples in the window that are numbers */
+			std::size_t _nanCount;
+			double _sum;
+			double _compensation;
+			double _mean;
+			double _squares;			/**< Sum of squared differences from the mean */
+
+			void add(double x, double sign)
+			{
+				double t = _sum + sign * x;
+
+				if (std::fabs(_sum) >= std::fabs(x))
+					_compensation += (_sum - t) + sign * x;
+				else
+					_compensation += (sign * x - t) + _sum;
+
+				_sum = t;
+			}
+
+		public:
+			RollingMoment(Moment moment, std::size_t length) :
+				_moment(moment),
+				_ring(length)
+			{
+				reset();
+			}
+
+			double push(double sample)
+			{
+				if (_ring.full())
+				{
+					double old = _ring.oldest();
+
+					if (std::isnan(old))
+						_nanCount--;
+					else if (--_count == 0)
+					{
+						_sum = _compensation = _mean = _squares = 0.0;
+					}
+					else
+					{
+						add(old, -1.0);
+
+						double d = old - _mean;
+						_mean -= d / _count;
+						_squares -= d * (old - _mean);
+					}
+				}
+
+				_ring.push(sample);
+
+				if (std::isnan(sample))
+					_nanCount++;
+				else
+				{
+					add(sample, 1.0);
+
+					double d = sample - _mean;
+					_mean += d / ++_count;
+					_squares += d * (sample - _mean);
+				}
+
+				if (_nanCount > 0)
+					return notANumber;
+
+				switch (_moment)
+				{
+					case MOMENT_SUM:		return _sum + _compensation;
+					case MOMENT_MEAN:		return (_sum + _compensation) / _count;
+					case MOMENT_VARIANCE:	return _count > 1 ? std::max(_squares, 0.0) / (_count - 1) : notANumber;
+				}
+
+				return notANumber;
+			}
+
+			void reset()
+			{
+				_ring.clear();
+				_count = 0;
+				_nanCount = 0;
+				_sum = _compensation = _mean = _squares = 0.0;
+			}
+	};
+
+	/** Rolling minimum or maximum. The deque holds the samples that may still become the extreme,
+	 *  in order of arrival and of value, so the extreme is at the front and every sample is added
+	 *  and removed once: O(1) amortized per row.
+	 */
+	class RollingExtreme : public Window
+	{
+		private:
+			struct Entry
+			{
+				uint64_t row;
+				double value;
+			};
+
+			bool _maximum;
+			uint64_t _length;
+			uint64_t _row;
+			std::deque<Entry> _candidates;
+
+		public:
+			RollingExtreme(bool maximum, std::size_t length) :
+				_maximum(maximum),
+				_length(length),
+				_row(0)
+			{ }
+
+			double push(double sample)
+			{
+				while (!_candidates.empty() && _candidates.front().row + _length <= _row)
+					_candidates.pop_front();
+
+				if (!std::isnan(sample))
+				{
+					//Samples the new one beats can never be the extreme again
+					while (!_candidates.empty() && (_maximum ? _candidates.back().value <= sample : _candidates.back().value >= sample))
+						_candidates.pop_back();
+
+					Entry e = { _row, sample };
+					_candidates.push_back(e);
+				}
+
+				_row++;
+				return _candidates.empty() ? notANumber : _candidates.front().value;
+			}
+
+			void reset()
+			{
+				_row = 0;
+				_candidates.clear();
+			}
+	};
+
+	class Lag : public Window
+	{
+		private:
+			SampleRing _ring;
+			bool _delta;
+
+		public:
+			Lag(std::size_t rows, bool delta) :
+				_ring(rows),
+				_delta(delta)
+			{ }
+
+			double push(double sample)
+			{
+				//A lag of 0 rows is the sample itself
+				if (_ring.capacity() == 0)
+					return sample;
+
+				double lagged = _ring.full() ? _ring.oldest() : notANumber;
+
+				_ring.push(sample);
+				return _delta ? sample - lagged : lagged;
+			}
+
+			void reset() { _ring.clear(); }
+	};
+
+	/** \brief Throws if a sub-expression passed unevaluated, or one nested in it, calls a window function */
+	void checkBody(const ExpressionGraph& body, const std::vector<unsigned int>& windowIds)
+	{
+		for (unsigned int i = 0; i < body.size(); i++)
+		{
+			const ExpressionGraph::Node& n = body.node(i);
+
+			if (n.type == ExpressionGraph::NODE_CALL && !n.isOperator &&
+					std::find(windowIds.begin(), windowIds.end(), n.id) != windowIds.end())
+				throw std::invalid_argument("'" + body.callee(n)->symbol() + "' cannot be called by a sub-expression passed unevaluated");
+
+			if (n.type == ExpressionGraph::NODE_EXPRESSION)
+				checkBody(body.body(n), windowIds);
+		}
+	}
+
+	/** \brief Creates the state of a call to a window function */
+	std::unique_ptr<Window> createWindow(const ExpressionGraph& graph, const ExpressionGraph::Node& n)
+	{
+		const std::string name = graph.callee(n)->symbol();
+
+		if (name == "delta")
+			return std::unique_ptr<Window>(new Lag(1, true));
+
+		const ExpressionGraph::Node& length = graph.node(n.arguments[1]);
+		bool lag = name == "lag";
+
+		if (length.type != ExpressionGraph::NODE_CONSTANT || !(length.value >= (lag ? 0.0 : 1.0)) ||
+				length.value > std::floor(length.value) || length.value > std::numeric_limits<uint32_t>::max())
+			throw std::invalid_argument("the second argument of '" + name + "' must be a constant integer of at least " +
+					(lag ? "0" : "1"));
+
+		std::size_t rows = static_cast<std::size_t>(length.value);
+
+		if (name == "ema")			return std::unique_ptr<Window>(new Ema(length.value));
+		if (name == "rollsum")		return std::unique_ptr<Window>(new RollingMoment(MOMENT_SUM, rows));
+		if (name == "rollmean")		return std::unique_ptr<Window>(new RollingMoment(MOMENT_MEAN, rows));
+		if (name == "rollvar")		return std::unique_ptr<Window>(new RollingMoment(MOMENT_VARIANCE, rows));
+		if (name == "rollmin")		return std::unique_ptr<Window>(new RollingExtreme(false, rows));
+		if (name == "rollmax")		return std::unique_ptr<Window>(new RollingExtreme(true, rows));
+
+		assert(lag);
+		return std::unique_ptr<Window>(new Lag(rows, false));
+	}
+}
+
+/** \brief Constructor
+ *
+ * \param expr	The expression; throws a TokenizerException if it is malformed, and std::invalid_argument
+ *				if it assigns to variables or calls window functions as described above
+ * \param vc	The variable context that variable names are resolved in
+ * \param fc	The function context that operators and functions are resolved in
+ *
+ */
+StreamExpression::StreamExpression(const std::string& expr, VariableContext& vc, const FunctionContext& fc) :
+	_variableContext(vc),
+	_rowCount(0)
+{
+	ExpressionParser parser(expr, vc, fc);
+	ExpressionGraph graph(fc);
+	unsigned int root = graph.addExpression(parser);
+
+	graph.addOutput(root);
+
+	if (graph.effects() & EFFECT_WRITES_CONTEXT)
+		throw std::invalid_argument("streamed expressions cannot assign to variables");
+
+	std::vector<unsigned int> windowIds;
+
+	for (const char* name : { "ema", "rollsum", "rollmean", "rollvar", "rollmin", "rollmax", "lag", "delta" })
+		windowIds.push_back(fc.getFunctionID(name));
+
+	std::vector<bool> live = graph.liveNodes();
+	std::vector<unsigned int> depth(graph.size(), 0);		//The number of nested windows a node reads
+	std::vector<std::vector<unsigned int> > windowNodes;	//The window calls of each level
+	std::unordered_map<unsigned int, unsigned int> windowOf;
+
+	//Arguments come before their users, so a node's depth is final when the sweep reaches it
+	for (unsigned int i = 0; i < graph.size(); i++)
+	{
+		if (!live[i])
+			continue;
+
+		const ExpressionGraph::Node& n = graph.node(i);
+
+		if (n.type == ExpressionGraph::NODE_EXPRESSION)
+			checkBody(graph.body(n), windowIds);
+
+		for (unsigned int j = 0; j < n.arguments.size(); j++)
+			depth[i] = std::max(depth[i], depth[n.arguments[j]]);
+
+		if (n.type != ExpressionGraph::NODE_CALL || n.isOperator || std::find(windowIds.begin(), windowIds.end(), n.id) == windowIds.end())
+			continue;
+
+		//The window's own length is a constant, so only the sample decides the level
+		unsigned int level = depth[n.arguments[0]];
+
+		if (windowNodes.size() <= level)
+			windowNodes.resize(level + 1);
+
+		windowOf[i] = _windows.size();
+		windowNodes[level].push_back(i);
+		_windows.push_back(createWindow(graph, n));
+		depth[i] = level + 1;
+	}
+
+	//Sized once, since programs keep the locations of the values they read
+	_windowValues.assign(_windows.size(), 0.0);
+
+	//Copies nodes into a graph of their own, reading the results of windows as inputs
+	auto copyInto = [&](ExpressionGraph& target, unsigned int node)
+	{
+		std::unordered_map<unsigned int, unsigned int> copies;
+
+		for (auto it = windowOf.begin(); it != windowOf.end(); ++it)
+			copies[it->first] = target.input(&_windowValues[it->second]);
+
+		return target.copy(graph, node, copies);
+	};
+
+	_levels.resize(windowNodes.size());
+
+	for (unsigned int l = 0; l < windowNodes.size(); l++)
+	{
+		ExpressionGraph samples(fc);
+
+		for (unsigned int k = 0; k < windowNodes[l].size(); k++)
+		{
+			unsigned int node = windowNodes[l][k];
+
+			samples.addOutput(copyInto(samples, graph.node(node).arguments[0]));
+			_levels[l].windows.push_back(windowOf[node]);
+		}
+
+		_levels[l].samples.reset(new Program(samples, vc));
+		_samples.resize(std::max(_samples.size(), windowNodes[l].size()));
+	}
+
+	ExpressionGraph result(fc);
+	result.addOutput(copyInto(result, root));
+	_result.reset(new Program(result, vc));
+}
+
+/** \brief Evaluates the expression for the next row, read from the current values of the variables
+ *
+ * \return	The value of the expression
+ *
+ */
+double StreamExpression::push()
+{
+	for (auto level = _levels.begin(); level != _levels.end(); ++level)
+	{
+		level->samples->evaluate(_samples.data());
+
+		for (unsigned int k = 0; k < level->windows.size(); k++)
+		{
+			unsigned int w = level->windows[k];
+			_windowValues[w] = _windows[w]->push(_samples[k]);
+		}
+	}
+
+	_rowCount++;
+	return _result->evaluate();
+}
+
+/** \brief Evaluates the expression for the next rows of the variables bound with a stride
+ *
+ * Rows are selected with VariableContext::setRow(), which is left at the last row.
+ *
+ * \param rowCount	The number of rows
+ * \param results	Receives one value per row
+ *
+ */
+void StreamExpression::push(std::size_t rowCount, double* results)
+{
+	for (std::size_t row = 0; row < rowCount; row++)
+	{
+		_variableContext.setRow(row);
+		results[row] = push();
+	}
+}
+
+/** \brief Forgets every row pushed so far */
+void StreamExpression::reset()
+{
+	for (auto it = _windows.begin(); it != _windows.end(); ++it)
+		(*it)->reset();
+
+	_rowCount = 0;
+}
@@ -0,0 +1,87 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef STREAM_EXPRESSION_H
+#define STREAM_EXPRESSION_H
+
+#include	<string>
+#include	<vector>
+#include	<memory>
+#include	<cstdint>
+#include	<cstddef>
+
+#include	"context.h"
+#include	"program.h"
+
+/** The state of one call to a window function in a StreamExpression */
+class Window
+{
+	public:
+		virtual ~Window() { }
+
+		/** \brief Takes the next sample
+		 *
+		 * \param sample	The value of the function's first argument for the new row
+		 * \return			The function's value over the samples seen so far
+		 *
+		 */
+		virtual double push(double sample) = 0;
+
+		/** \brief Forgets every sample */
+		virtual void reset() = 0;
+};
+
+/** An expression evaluated over a stream of rows, whose window functions remember earlier rows.
+ *
+ *  Each call to a window function keeps its own state, updated in O(1) time per row:
+ *
+ *		ema(x, n)		exponential moving average with weight 2 / (n + 1), starting at the first sample
+ *		rollsum(x, n)	sum of the last n samples
+ *		rollmean(x, n)	mean of the last n samples
+ *		rollvar(x, n)	sample variance of the last n samples; NaN until there are two
+ *		rollmin(x, n)	smallest of the last n samples
+ *		rollmax(x, n)	largest of the last n samples
+ *		lag(x, k)		the sample k rows back; NaN until there is one
+ *		delta(x)		x minus the previous sample; NaN on the first row
+ *
+ *  Windows hold fewer than n samples until n rows have been pushed. n and k must be constant
+ *  integers. A NaN sample leaves an EMA unchanged, is skipped by rollmin() and rollmax(), and makes
+ *  the rolling sum, mean and variance NaN while it is in the window.
+ *
+ *  Every call sees every row, including the calls in branches of if() that the row does not take.
+ *  Calls may be nested, e.g. ema(delta(x), 10). Their arguments are compiled to Programs, one per
+ *  level of nesting, and the results of the calls are kept by the expression and read by the
+ *  rest of it as program inputs, so no variables are created for them. Streamed expressions cannot assign to variables, and sub-expressions passed
+ *  unevaluated, like the body of sum(), cannot call window functions.
+ */
+class StreamExpression
+{
+	private:
+		struct Level
+		{
+			std::unique_ptr<Program> samples;			/**< One output per window of the level */
+			std::vector<unsigned int> windows;
+		};
+
+		VariableContext& _variableContext;
+		std::vector<std::unique_ptr<Window> > _windows;
+		std::vector<double> _windowValues;				/**< The latest value of each window, read by programs as inputs */
+		std::vector<Level> _levels;
+		std::unique_ptr<Program> _result;
+		std::vector<double> _samples;
+		uint64_t _rowCount;
+
+	public:
+		StreamExpression(const std::string& expr, VariableContext& vc, const FunctionContext& fc);
+
+		double push();
+		void push(std::size_t rowCount, double* results);
+		void reset();
+
+		uint64_t rowCount() const { return _rowCount; }
+		unsigned int windowCount() const { return _windows.size(); }
+};
+
+#endif
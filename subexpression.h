@@ -0,0 +1,32 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef SUBEXPRESSION_H
+#define SUBEXPRESSION_H
+
+class VariableContext;
+
+/** A compiled sub-expression passed unevaluated to a HAND_EXPRESSION parameter.
+ *
+ *  The callee evaluates it as often as it likes, typically after changing a variable the body
+ *  reads, e.g. the bound variable of sum(). Bodies are compiled along with the expression that
+ *  contains them, so each evaluation runs compiled code rather than re-reading the expression.
+ *  A body is owned by the code it was compiled into and must not be kept past the call.
+ */
+class Subexpression
+{
+	public:
+		virtual ~Subexpression() { }
+
+		/** \brief Evaluates the body with the current variable values
+		 *
+		 * \param vc	The variable context of the call
+		 * \return		The value of the body
+		 *
+		 */
+		virtual double evaluate(VariableContext& vc) = 0;
+};
+
+#endif
@@ -0,0 +1,175 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<chrono>
+#include	<exception>
+
+#include	"tiered_expression.h"
+#include	"expression_graph.h"
+
+TieringEngine::TieringEngine(unsigned int threshold) :
+	_threshold(threshold),
+	_stopping(false),
+	_promotions(0),
+	_failedPromotions(0),
+	_compileNanoseconds(0)
+{
+	for (unsigned int tier = 0; tier < 2; tier++)
+	{
+		_evaluations[tier] = 0;
+		_nanoseconds[tier] = 0;
+	}
+
+	_worker = std::thread(&TieringEngine::run, this);
+}
+
+TieringEngine::~TieringEngine()
+{
+	{
+		std::lock_guard<std::mutex> lock(_queueMutex);
+		_stopping = true;
+	}
+
+	_queueCondition.notify_one();
+	_worker.join();
+}
+
+/** \brief Returns a snapshot of the statistics
+ *
+ * \return		Counters accumulated since the engine was created
+ *
+ */
+TieringStats TieringEngine::stats()
+{
+	TieringStats s;
+
+	s.interpretedEvaluations = _evaluations[0].load(std::memory_order_relaxed);
+	s.optimizedEvaluations = _evaluations[1].load(std::memory_order_relaxed);
+	s.interpretedNanoseconds = _nanoseconds[0].load(std::memory_order_relaxed);
+	s.optimizedNanoseconds = _nanoseconds[1].load(std::memory_order_relaxed);
+	s.promotions = _promotions.load(std::memory_order_relaxed);
+	s.failedPromotions = _failedPromotions.load(std::memory_order_relaxed);
+	s.compileNanoseconds = _compileNanoseconds.load(std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> lock(_queueMutex);
+	s.pendingPromotions = _queue.size();
+
+	return s;
+}
+
+void TieringEngine::enqueue(const std::shared_ptr<State>& state)
+{
+	{
+		std::lock_guard<std::mutex> lock(_queueMutex);
+		_queue.push_back(state);
+	}
+
+	_queueCondition.notify_one();
+}
+
+void TieringEngine::record(bool optimized, uint64_t evaluations, uint64_t nanoseconds)
+{
+	_evaluations[optimized].fetch_add(evaluations, std::memory_order_relaxed);
+	_nanoseconds[optimized].fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+void TieringEngine::run()
+{
+	while (true)
+	{
+		std::shared_ptr<State> state;
+
+		{
+			std::unique_lock<std::mutex> lock(_queueMutex);
+			_queueCondition.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+
+			if (_stopping)
+				return;
+
+			state = _queue.front();
+			_queue.pop_front();
+		}
+
+		//The expression was destroyed while it waited
+		if (state.use_count() == 1)
+			continue;
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const ExpressionParser& parser = *state->parser;
+
+		try
+		{
+			ExpressionGraph graph(parser.functionContext());
+
+			graph.addOutput(graph.addExpression(parser));
+			state->program.reset(new Program(graph, parser.variableContext(), parser.precision()));
+			state->program->setFlushDenormals(parser.flushDenormals());
+			state->optimized.store(state->program.get(), std::memory_order_release);
+			_promotions.fetch_add(1, std::memory_order_relaxed);
+		}
+		catch (std::exception&)
+		{
+			//The interpreter handles everything the parser accepted, so the expression simply stays there
+			state->program.reset();
+			state->promotable.store(false, std::memory_order_release);
+			_failedPromotions.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+		_compileNanoseconds.fetch_add(elapsed.count(), std::memory_order_relaxed);
+	}
+}
+
+/** \brief Parses an expression for interpretation; throws a TokenizerException if it is malformed
+ *
+ * \param expr		The expression
+ * \param vc		The variable context that variable names are resolved in
+ * \param fc		The function context that operators and functions are resolved in
+ * \param engine	The engine that promotes the expression once it is hot
+ *
+ */
+TieredExpression::TieredExpression(const std::string& expr, VariableContext& vc, const FunctionContext& fc, TieringEngine& engine) :
+	_engine(engine),
+	_state(std::make_shared<TieringEngine::State>())
+{
+	_state->parser.reset(new ExpressionParser(expr, vc, fc));
+	_state->optimized = nullptr;
+	_state->promotable = true;
+	_state->executions = 0;
+	_state->queued = false;
+}
+
+/** \brief Evaluates the expression with whichever tier is currently installed
+ *
+ * \return		The value of the expression
+ *
+ */
+double TieredExpression::evaluate()
+{
+	TieringEngine::State& state = *_state;
+	Program* optimized = state.optimized.load(std::memory_order_acquire);
+	bool sampled = ++state.executions % TIERING_SAMPLE_INTERVAL == 0;
+	std::chrono::steady_clock::time_point start;
+	double result;
+
+	if (!optimized && !state.queued && state.executions >= _engine._threshold)
+	{
+		state.queued = true;
+		_engine.enqueue(_state);
+	}
+
+	if (sampled)
+		start = std::chrono::steady_clock::now();
+
+	result = optimized ? optimized->evaluate() : state.parser->evaluate();
+
+	if (sampled)
+	{
+		std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+		_engine.record(optimized != nullptr, TIERING_SAMPLE_INTERVAL, elapsed.count() * TIERING_SAMPLE_INTERVAL);
+	}
+
+	return result;
+}
@@ -0,0 +1,120 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef TIERED_EXPRESSION_H
+#define TIERED_EXPRESSION_H
+
+#include	<string>
+#include	<deque>
+#include	<memory>
+#include	<atomic>
+#include	<mutex>
+#include	<thread>
+#include	<condition_variable>
+#include	<cstdint>
+
+#include	"expression_parser.h"
+#include	"program.h"
+
+#define	TIERING_DEFAULT_THRESHOLD		1000
+#define	TIERING_SAMPLE_INTERVAL			64
+
+/** Execution statistics of the expressions attached to a TieringEngine.
+ *
+ *  Evaluation counts and times are sampled once every TIERING_SAMPLE_INTERVAL evaluations of each
+ *  expression and scaled up, so they are estimates; promotions, failures and compile time are exact.
+ */
+struct TieringStats
+{
+	uint64_t interpretedEvaluations;
+	uint64_t optimizedEvaluations;
+	uint64_t interpretedNanoseconds;
+	uint64_t optimizedNanoseconds;
+	uint64_t promotions;
+	uint64_t failedPromotions;			/**< Expressions that could not be lowered and stay interpreted */
+	uint64_t compileNanoseconds;		/**< Time the background thread spent building optimized programs */
+	unsigned int pendingPromotions;		/**< Expressions waiting for the background thread */
+};
+
+class TieredExpression;
+
+/** Promotes hot expressions to optimized programs on a background thread.
+ *
+ *  Every TieredExpression starts out evaluated by the ExpressionParser interpreter, which costs
+ *  nothing to set up. Once it has been evaluated threshold times it is queued here, lowered through
+ *  ExpressionGraph into a Program (common subexpressions merged, constants folded, small user
+ *  functions inlined), and the program is swapped in atomically; evaluations in the meantime keep
+ *  using the interpreter. An expression that cannot be lowered, e.g. because a function returns a
+ *  variable reference, is marked as not promotable and keeps using the interpreter for good.
+ *
+ *  Functions must not be registered in the FunctionContext while promotions are pending.
+ */
+class TieringEngine
+{
+	private:
+		struct State
+		{
+			std::unique_ptr<ExpressionParser> parser;
+			std::unique_ptr<Program> program;		/**< Written once by the background thread */
+			std::atomic<Program*> optimized;		/**< Published after program is complete */
+			std::atomic<bool> promotable;			/**< Cleared by the background thread if lowering fails */
+			uint64_t executions;
+			bool queued;
+		};
+
+		unsigned int _threshold;
+		std::deque<std::shared_ptr<State> > _queue;
+		std::mutex _queueMutex;
+		std::condition_variable _queueCondition;
+		bool _stopping;
+
+		std::atomic<uint64_t> _evaluations[2];
+		std::atomic<uint64_t> _nanoseconds[2];
+		std::atomic<uint64_t> _promotions;
+		std::atomic<uint64_t> _failedPromotions;
+		std::atomic<uint64_t> _compileNanoseconds;
+
+		std::thread _worker;
+
+		void enqueue(const std::shared_ptr<State>& state);
+		void record(bool optimized, uint64_t evaluations, uint64_t nanoseconds);
+		void run();
+
+	public:
+		TieringEngine(unsigned int threshold = TIERING_DEFAULT_THRESHOLD);
+		~TieringEngine();
+
+		TieringEngine(const TieringEngine&) = delete;
+		TieringEngine& operator=(const TieringEngine&) = delete;
+
+		unsigned int threshold() const { return _threshold; }
+		TieringStats stats();
+
+	friend class TieredExpression;
+};
+
+/** An expression that starts in the interpreter and is promoted by a TieringEngine once it is hot.
+ *
+ *  Like ExpressionParser it must not be evaluated from several threads at once. The engine must
+ *  outlive it.
+ */
+class TieredExpression
+{
+	private:
+		TieringEngine& _engine;
+		std::shared_ptr<TieringEngine::State> _state;
+
+	public:
+		TieredExpression(const std::string& expr, VariableContext& vc, const FunctionContext& fc, TieringEngine& engine);
+
+		double evaluate();
+
+		bool isOptimized() const { return _state->optimized.load(std::memory_order_acquire) != nullptr; }
+		bool isPromotable() const { return _state->promotable.load(std::memory_order_acquire); }
+		uint64_t executionCount() const { return _state->executions; }
+		const ExpressionParser& expression() const { return *_state->parser; }
+};
+
+#endif
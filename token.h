@@ -95,6 +95,22 @@ class DelimiterToken
 		DelimType type() const { return _type; }
 };
 
+/** Marks the start of a sub-expression passed unevaluated to a HAND_EXPRESSION parameter.
+ *
+ *  It precedes the body's tokens in the postfix string; those are skipped when the
+ *  surrounding expression is evaluated and compiled separately instead.
+ */
+class ExpressionToken
+{
+	private:
+		unsigned int _length;
+
+	public:
+		ExpressionToken(unsigned int length) : _length(length) { }
+		unsigned int length() const { return _length; }
+		unsigned int setLength(unsigned int l) { return _length = l; }
+};
+
 class Token
 {
 	public:
@@ -107,6 +123,7 @@ class Token
 			FUNCTION,
 			PARENTHESIS,
 			DELIMITER,
+			EXPRESSION,
 			END
 		} TokenType;
 
@@ -124,6 +141,7 @@ class Token
 			unsigned char _function[sizeof(FunctionToken)];
 			unsigned char _parenthesis[sizeof(ParenthesisToken)];
 			unsigned char _delimiter[sizeof(DelimiterToken)];
+			unsigned char _expression[sizeof(ExpressionToken)];
 
 			//This double is provided to give the data member an alignment
 			//requirement of 8 bytes.
@@ -180,10 +198,18 @@ class Token
 			new ((void*) &_tokenData) DelimiterToken(token);
 		}
 
-		Token(TokenType ttype)
+		Token(ExpressionToken token, unsigned int tlocation) :
+			_type(EXPRESSION),
+			_location(tlocation)
+		{
+			new ((void*) &_tokenData) ExpressionToken(token);
+		}
+
+		Token(TokenType ttype, unsigned int tlocation = 0) :
+			_type(ttype),
+			_location(tlocation)
 		{
 			assert(ttype == END);
-			_type = ttype;
 		}
 
 		~Token()
@@ -197,6 +223,7 @@ class Token
 				case FUNCTION: 		((FunctionToken*	)&_tokenData)->~FunctionToken();	break;
 				case PARENTHESIS: 	((ParenthesisToken*	)&_tokenData)->~ParenthesisToken();	break;
 				case DELIMITER: 	((DelimiterToken*	)&_tokenData)->~DelimiterToken();	break;
+				case EXPRESSION: 	((ExpressionToken*	)&_tokenData)->~ExpressionToken();	break;
 				case END:			break;
 			}
 		}
@@ -207,6 +234,15 @@ class Token
 		FunctionToken& toFunction() 		{ assert(_type == FUNCTION); 	return *(FunctionToken	 *) &_tokenData; }
 		ParenthesisToken& toParenthesis()   { assert(_type == PARENTHESIS); return *(ParenthesisToken*) &_tokenData; }
 		DelimiterToken& toDelimiter() 		{ assert(_type == DELIMITER); 	return *(DelimiterToken	 *) &_tokenData; }
+		ExpressionToken& toExpression() 	{ assert(_type == EXPRESSION); 	return *(ExpressionToken *) &_tokenData; }
+
+		const NumberToken& toNumber() const 			{ assert(_type == NUMBER);	 	return *(const NumberToken		*) &_tokenData; }
+		const OperatorToken& toOperator() const 		{ assert(_type == OPERATOR); 	return *(const OperatorToken	*) &_tokenData; }
+		const VariableToken& toVariable() const 		{ assert(_type == VARIABLE); 	return *(const VariableToken	*) &_tokenData; }
+		const FunctionToken& toFunction() const 		{ assert(_type == FUNCTION); 	return *(const FunctionToken	*) &_tokenData; }
+		const ParenthesisToken& toParenthesis() const	{ assert(_type == PARENTHESIS); return *(const ParenthesisToken	*) &_tokenData; }
+		const DelimiterToken& toDelimiter() const 		{ assert(_type == DELIMITER); 	return *(const DelimiterToken	*) &_tokenData; }
+		const ExpressionToken& toExpression() const 	{ assert(_type == EXPRESSION); 	return *(const ExpressionToken	*) &_tokenData; }
 
 		TokenType type() const 			{ return _type; }
 		unsigned int location() const 	{ return _location; }
@@ -16,6 +16,7 @@
 #include "context.h"
 #include "variable.h"
 #include "tokenizer_exception.h"
+#include "parse_result.h"
 #include "token.h"
 #include "exputil.h"
 
@@ -29,20 +30,29 @@ class Tokenizer
 		Token lastToken;
 		const FunctionContext& functionContext;
 		VariableContext& variableContext;
+		bool _createsVariables;				/* Whether unknown variable names are added to variableContext */
 		std::queue<Token> _tokenQueue;		/* For implementation of lexer */
 		std::stack<Token> _functionStack;	/* For implementation of lexer */
+		ParseResult _result;				/* First error encountered; errors are recorded rather than thrown */
 
 	public:
-		Tokenizer(std::string expression, const FunctionContext& fc, VariableContext& vc) :
+		Tokenizer(std::string expression, const FunctionContext& fc, VariableContext& vc, bool createVariables = true) :
 			expressionString(expression),
 			location(0),
 			lastToken(),
 			functionContext(fc),
-			variableContext(vc)
+			variableContext(vc),
+			_createsVariables(createVariables)
 		{ }
 
 		~Tokenizer() { }
 
+		/** \brief Returns the first error encountered so far
+		 *
+		 * Once an error has been recorded nextToken() only returns END tokens.
+		 */
+		const ParseResult& result() const { return _result; }
+
 		bool hasNext()
 		{
 			return false;
@@ -58,7 +68,12 @@ class Tokenizer
 				t = nextToken();
 
 				if (t.type() == Token::END)
+				{
+					if (_result.failed())
+						throwParseError(_result);
+
 					break;
+				}
 
 				output << Exparse::util::tokenToString(t, functionContext, variableContext) << " ";
 			} while (1);
@@ -70,6 +85,9 @@ class Tokenizer
 		{
 			Token t;
 
+			if (_result.failed())
+				return Token(Token::END);
+
 			//Check for preprocessed tokens
 			if (_tokenQueue.size() > 0)
 			{
@@ -82,6 +100,15 @@ class Tokenizer
 			{
 				t = parseToken(expressionString, location);
 
+				if (_result.failed())
+					return Token(Token::END);
+
+				if (t.type() == Token::NONE)
+					return fail(ParseResult::unknownToken(t.location()));
+
+				if (t.type() == Token::END && !_functionStack.empty())
+					return fail(ParseResult::unexpectedEnd(location));
+
 				switch (lastToken.type())
 				{
 					case Token::PARENTHESIS:
@@ -93,7 +120,7 @@ class Tokenizer
 							if (t.type() == Token::DELIMITER && consumeDelimiter(t)) break;
 							if (t.type() == Token::OPERATOR && consumeOperator(t, Operator::POS_INFIX | Operator::POS_POSTFIX)) break;
 
-							throw UnexpectedTokenException(t);
+							return fail(ParseResult::unexpectedToken(t));
 						}
 
 						//Fall through if last token is left round parenthesis
@@ -108,7 +135,7 @@ class Tokenizer
 						if (t.type() == Token::VARIABLE) break;
 						if (t.type() == Token::OPERATOR && consumeOperator(t, Operator::POS_PREFIX)) break;
 
-						throw UnexpectedTokenException(t);
+						return fail(ParseResult::unexpectedToken(t));
 
 					case Token::NUMBER:
 					case Token::VARIABLE:
@@ -117,7 +144,7 @@ class Tokenizer
 						if (t.type() == Token::DELIMITER && consumeDelimiter(t)) break;
 						if (t.type() == Token::OPERATOR && consumeOperator(t, Operator::POS_INFIX | Operator::POS_POSTFIX)) break;
 
-						throw UnexpectedTokenException(t);
+						return fail(ParseResult::unexpectedToken(t));
 
 					case Token::OPERATOR:
 					{
@@ -139,19 +166,23 @@ class Tokenizer
 							if (t.type() == Token::OPERATOR && consumeOperator(t, Operator::POS_INFIX | Operator::POS_POSTFIX)) break;
 						}
 
-						throw UnexpectedTokenException(t);
+						return fail(ParseResult::unexpectedToken(t));
 					}
 
 					case Token::FUNCTION:
 						if (t.type() == Token::PARENTHESIS && consumeParenthesis(t, ParenthesisToken::ROUND_LEFT)) break;
 
-						throw UnexpectedTokenException(t);
+						return fail(ParseResult::unexpectedToken(t));
 
+					case Token::EXPRESSION:
 					case Token::END:
 						assert(false);
 						break;
 				}
 
+				if (_result.failed())
+					return Token(Token::END);
+
 				lastToken = t;
 				_tokenQueue.push(t);
 			} while (!_functionStack.empty());
@@ -165,6 +196,14 @@ class Tokenizer
 		}
 
 	private:
+		Token fail(const ParseResult& error)
+		{
+			if (_result.succeeded())
+				_result = error;
+
+			return Token(Token::END);
+		}
+
 		bool isWhitespace(char c)
 		{
 			static std::string whitespace(WHITESPACE_CHARS);
@@ -285,7 +324,7 @@ class Tokenizer
 					while (isDigit(expr[i])) { i++; }
 				}
 				else
-					throw MalformedNumberException(expr.substr(index, i - index), index);
+					return fail(ParseResult::malformedNumber(expr.substr(index, i - index), index));
 			}
 
 			//Extract double from string stream, store in token
@@ -294,7 +333,7 @@ class Tokenizer
 			tokenStream >> numberValue;
 
 			if (!tokenStream)
-				throw MalformedNumberException(expr.substr(index, i - index), index);
+				return fail(ParseResult::malformedNumber(expr.substr(index, i - index), index));
 
 			Token token(NumberToken(numberValue), index);
 			index = i;
@@ -344,15 +383,15 @@ class Tokenizer
 				//Identifier is function
 				unsigned int functionID = functionContext.getFunctionID(tokenString);
 
-				if (!functionID) throw UnknownFunctionException(tokenString, index); //Function not found
+				if (!functionID) return fail(ParseResult::unknownFunction(tokenString, index)); //Function not found
 
 				t = Token(FunctionToken(functionID), index);
 				index = i;
 			}
 			else
 			{
-				//Identifier is variable
-				unsigned int variableID = variableContext.getId(tokenString);
+				//Identifier is variable; without creating variables an unknown name gets NULLID
+				unsigned int variableID = _createsVariables ? variableContext.getId(tokenString) : variableContext.findId(tokenString);
 				t = Token(VariableToken(variableID), index);
 				index = i;
 			}
@@ -381,7 +420,7 @@ class Tokenizer
 
 			//Parse end
 			if (index == expr.length())
-			return Token(Token::END);
+			return Token(Token::END, index);
 
 			t = parseParenthesis(expr, index);
 			if (t.type() != Token::NONE) return t;
@@ -440,14 +479,17 @@ class Tokenizer
 		bool consumeDelimiter(Token& t)
 		{
 			if (t.toDelimiter().type() == DelimiterToken::STATEMENT_DELIM && _functionStack.size() > 0)
-				throw UnexpectedTokenException(t);
+			{
+				fail(ParseResult::unexpectedToken(t));
+				return true;
+			}
 
 			if (t.toDelimiter().type() == DelimiterToken::ARG_DELIM)
 			{
 				if (_functionStack.size() > 0 && _functionStack.top().type() == Token::FUNCTION)
 					_functionStack.top().toFunction().addArgument();
-				else if (_functionStack.size() != 0)
-					throw UnexpectedTokenException(t);
+				else
+					fail(ParseResult::unexpectedToken(t));
 			}
 
 			return true;
@@ -460,8 +502,25 @@ class Tokenizer
 			switch (requiredType)
 			{
 				case ParenthesisToken::ROUND_RIGHT:
+					//An argument can't be left empty, e.g. pow(1,)
+					if (lastToken.type() == Token::DELIMITER && lastToken.toDelimiter().type() == DelimiterToken::ARG_DELIM)
+					{
+						fail(ParseResult::unexpectedToken(t));
+						break;
+					}
+
 					if (_functionStack.size() > 0)
 					{
+						bool emptyGroup = lastToken.type() == Token::PARENTHESIS &&
+								lastToken.toParenthesis().type() == ParenthesisToken::ROUND_LEFT;
+
+						//Only a function call may have empty parentheses, a grouping must enclose an expression
+						if (emptyGroup && _functionStack.top().type() != Token::FUNCTION)
+						{
+							fail(ParseResult::unexpectedToken(t));
+							break;
+						}
+
 						if (_functionStack.top().type() != Token::FUNCTION)
 						{
 							_functionStack.pop();
@@ -470,16 +529,19 @@ class Tokenizer
 
 						Token& funcToken = _functionStack.top();
 
-						if (lastToken.type() != Token::PARENTHESIS ||
-								lastToken.toParenthesis().type() != ParenthesisToken::ROUND_LEFT)
+						if (!emptyGroup)
 							funcToken.toFunction().addArgument();
 
-						if (!validateNumArgs(funcToken)) throw InvalidNumArgumentsException(funcToken, functionContext);
+						if (!validateNumArgs(funcToken))
+						{
+							fail(ParseResult::invalidNumArguments(funcToken, functionContext));
+							break;
+						}
 
 						_functionStack.pop();
 					}
 					else
-						throw UnmatchedParenthesisException(t);
+						fail(ParseResult::unmatchedParenthesis(t));
 					break;
 				case ParenthesisToken::ROUND_LEFT:
 					if (lastToken.type() != Token::FUNCTION)
@@ -494,7 +556,7 @@ class Tokenizer
 		bool consumeOperator(Token& t, int requiredTypes)
 		{
 			const Operator* op = functionContext.lookupOperator(t.toOperator().id());
-			if ((op->position() & requiredTypes) == 0) throw UnexpectedTokenException(t);
+			if ((op->position() & requiredTypes) == 0) fail(ParseResult::unexpectedToken(t));
 			return true;
 		}
 
@@ -13,137 +13,186 @@
 #include	"token.h"
 #include	"context.h"
 #include	"exputil.h"
+#include	"parse_result.h"
 
 class TokenizerException : public std::exception
 {
 	protected:
 		std::string _message;
 		unsigned int _exprLocation;
+		ParseResult::ErrorCode _code;
+		mutable std::string _what;
+
+		TokenizerException(const ParseResult& result) :
+			_message(result.message()),
+			_exprLocation(result.column()),
+			_code(result.code())
+		{ }
 
 	public:
 		virtual ~TokenizerException() throw() { };
 
 		virtual const char* what() const throw()
 		{
-			std::stringstream stream;
-			stream << _message << " at column " << _exprLocation;
-			return stream.str().c_str();
+			if (_what.empty())
+			{
+				std::stringstream stream;
+				stream << _message << " at column " << _exprLocation;
+				_what = stream.str();
+			}
+
+			return _what.c_str();
 		}
+
+		ParseResult::ErrorCode code() const { return _code; }
+		unsigned int column() const { return _exprLocation; }
 };
 
 class UnknownFunctionException : public TokenizerException
 {
 	public:
-		UnknownFunctionException(const std::string& token, unsigned int exprLocation)
-		{
-			_exprLocation = exprLocation;
-			_message = std::string("Unknown function '") + token + std::string("'");
-		}
+		UnknownFunctionException(const std::string& token, unsigned int exprLocation) :
+			TokenizerException(ParseResult::unknownFunction(token, exprLocation))
+		{ }
+
+		UnknownFunctionException(const ParseResult& result) : TokenizerException(result) { }
 };
 
 class UnknownTokenException : public TokenizerException
 {
 	public:
-		UnknownTokenException(unsigned int exprLocation)
-		{
-			_exprLocation = exprLocation;
-			_message = std::string("Unknown token");
-		}
+		UnknownTokenException(unsigned int exprLocation) :
+			TokenizerException(ParseResult::unknownToken(exprLocation))
+		{ }
+
+		UnknownTokenException(const ParseResult& result) : TokenizerException(result) { }
 };
 
 class UnexpectedTokenException : public TokenizerException
 {
 	public:
-		UnexpectedTokenException(const Token& t)
-		{
-			_exprLocation = t.location();
-			_message = std::string("Unexpected ") + Exparse::util::lookupTokenTypeString(t.type()) + std::string(" token");
-		}
+		UnexpectedTokenException(const Token& t) :
+			TokenizerException(ParseResult::unexpectedToken(t))
+		{ }
+
+		UnexpectedTokenException(const ParseResult& result) : TokenizerException(result) { }
 };
 
 class UnexpectedEndException : public TokenizerException
 {
 	public:
-		UnexpectedEndException(unsigned int exprLocation)
-		{
-			_exprLocation = exprLocation;
-			_message = std::string("Unexpected end of statement");
-		}
+		UnexpectedEndException(unsigned int exprLocation) :
+			TokenizerException(ParseResult::unexpectedEnd(exprLocation))
+		{ }
+
+		UnexpectedEndException(const ParseResult& result) : TokenizerException(result) { }
 };
 
 class MalformedNumberException : public TokenizerException
 {
 	public:
-		MalformedNumberException(const std::string& token, unsigned int exprLocation)
-		{
-			_exprLocation = exprLocation;
-			_message = std::string("Malformed number '") + token + std::string("'");
-		}
+		MalformedNumberException(const std::string& token, unsigned int exprLocation) :
+			TokenizerException(ParseResult::malformedNumber(token, exprLocation))
+		{ }
+
+		MalformedNumberException(const ParseResult& result) : TokenizerException(result) { }
 };
 
 class MalformedIdentifierException : public TokenizerException
 {
 	public:
-		MalformedIdentifierException(const std::string& token, unsigned int exprLocation)
-		{
-			_exprLocation = exprLocation;
-			_message = std::string("Malformed identifier '") + token + std::string("'");
-		}
+		MalformedIdentifierException(const std::string& token, unsigned int exprLocation) :
+			TokenizerException(ParseResult::malformedIdentifier(token, exprLocation))
+		{ }
+
+		MalformedIdentifierException(const ParseResult& result) : TokenizerException(result) { }
 };
 
 class UnmatchedParenthesisException : public TokenizerException
 {
 	public:
-		UnmatchedParenthesisException(const Token& t)
-		{
-			_exprLocation = t.location();
-			_message = std::string("Unmatched parenthesis");
-		}
+		UnmatchedParenthesisException(const Token& t) :
+			TokenizerException(ParseResult::unmatchedParenthesis(t))
+		{ }
+
+		UnmatchedParenthesisException(const ParseResult& result) : TokenizerException(result) { }
 };
 
 class InvalidArgumentException : public TokenizerException
 {
 	public:
-		InvalidArgumentException(Token& t, unsigned int argumentIndex, const FunctionContext& fc)
-		{
-			_exprLocation = t.location();
-			std::stringstream s;
-			const Function* func;
+		InvalidArgumentException(Token& t, unsigned int argumentIndex, const FunctionContext& fc) :
+			TokenizerException(ParseResult::invalidArgument(t, argumentIndex, fc))
+		{ }
 
-			switch (t.type())
-			{
-				case Token::OPERATOR: func = fc.lookupOperator(t.toOperator().id()); break;
-				case Token::FUNCTION: func = fc.lookupFunction(t.toFunction().id()); break;
-				default:			  assert(false);
-			}
+		InvalidArgumentException(const ParseResult& result) : TokenizerException(result) { }
+};
 
-			s << "Invalid argument: Expecting variable reference as argument ";
-			s << argumentIndex + 1 << " for function '" << func->symbol() << "'";
+class InvalidNumArgumentsException : public TokenizerException
+{
+	public:
+		InvalidNumArgumentsException(Token& t, const FunctionContext& fc) :
+			TokenizerException(ParseResult::invalidNumArguments(t, fc))
+		{ }
 
-			_message = s.str();
-		}
+		InvalidNumArgumentsException(const ParseResult& result) : TokenizerException(result) { }
 };
 
-class InvalidNumArgumentsException : public TokenizerException
+class MalformedDefinitionException : public TokenizerException
 {
 	public:
-		InvalidNumArgumentsException(Token& t, const FunctionContext& fc)
-		{
-			FunctionToken& ft = t.toFunction();
-			const Function* func = fc.lookupFunction(ft.id());
-			std::stringstream s;
+		MalformedDefinitionException(const ParseResult& result) : TokenizerException(result) { }
+};
 
-			s << "Invalid number of arguments for function '";
-			s << func->symbol() << "' (expecting ";
+class DuplicateFunctionException : public TokenizerException
+{
+	public:
+		DuplicateFunctionException(const ParseResult& result) : TokenizerException(result) { }
+};
 
-			if (func->isVariadic())
-				s << " at least ";
+class RecursiveDefinitionException : public TokenizerException
+{
+	public:
+		RecursiveDefinitionException(const ParseResult& result) : TokenizerException(result) { }
+};
 
-			s << func->arity() << " arguments but got " << ft.arity() << ")";
+class UndefinedVariableException : public TokenizerException
+{
+	public:
+		UndefinedVariableException(const ParseResult& result) : TokenizerException(result) { }
+};
 
-			_exprLocation = t.location();
-			_message = s.str();
-		}
+class AssignmentInDefinitionException : public TokenizerException
+{
+	public:
+		AssignmentInDefinitionException(const ParseResult& result) : TokenizerException(result) { }
 };
 
+/** \brief Throws the exception matching a failed parse result
+ *
+ * \param result	The failed result
+ *
+ */
+inline void throwParseError(const ParseResult& result)
+{
+	switch (result.code())
+	{
+		case ParseResult::UNKNOWN_FUNCTION:			throw UnknownFunctionException(result);
+		case ParseResult::UNKNOWN_TOKEN:			throw UnknownTokenException(result);
+		case ParseResult::UNEXPECTED_TOKEN:			throw UnexpectedTokenException(result);
+		case ParseResult::UNEXPECTED_END:			throw UnexpectedEndException(result);
+		case ParseResult::MALFORMED_NUMBER:			throw MalformedNumberException(result);
+		case ParseResult::MALFORMED_IDENTIFIER:		throw MalformedIdentifierException(result);
+		case ParseResult::UNMATCHED_PARENTHESIS:	throw UnmatchedParenthesisException(result);
+		case ParseResult::INVALID_ARGUMENT:			throw InvalidArgumentException(result);
+		case ParseResult::INVALID_NUM_ARGUMENTS:	throw InvalidNumArgumentsException(result);
+		case ParseResult::MALFORMED_DEFINITION:		throw MalformedDefinitionException(result);
+		case ParseResult::DUPLICATE_FUNCTION:		throw DuplicateFunctionException(result);
+		case ParseResult::RECURSIVE_DEFINITION:		throw RecursiveDefinitionException(result);
+		case ParseResult::UNDEFINED_VARIABLE:		throw UndefinedVariableException(result);
+		case ParseResult::ASSIGNMENT_IN_DEFINITION:	throw AssignmentInDefinitionException(result);
+		default:									assert(false);
+	}
+}
+
 #endif
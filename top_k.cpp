@@ -0,0 +1,244 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<cmath>
+#include	<limits>
+#include	<atomic>
+#include	<thread>
+#include	<mutex>
+#include	<exception>
+#include	<stdexcept>
+#include	<algorithm>
+#include	<assert.h>
+
+#include	"top_k.h"
+#include	"program.h"
+
+namespace
+{
+	/** \brief Returns true if a ranks above b; as a heap comparison it puts the lowest ranked row on top */
+	inline bool ranksAbove(const RankedRow& a, const RankedRow& b)
+	{
+		return a.score > b.score || (!(a.score < b.score) && !(b.score < a.score) && a.row < b.row);
+	}
+}
+
+/** \brief Constructor
+ *
+ * \param k		The number of rows to keep; must not be 0
+ *
+ */
+TopK::TopK(unsigned int k) :
+	_k(k)
+{
+	if (k == 0)
+		throw std::invalid_argument("top-k ranking needs to keep at least one row");
+
+	_heap.reserve(k);
+}
+
+void TopK::consume(const double* values, std::size_t count, std::size_t firstRow)
+{
+	std::size_t i = 0;
+
+	//Until the heap is full every score is kept
+	for ( ; i < count && _heap.size() < _k; i++)
+		offer(firstRow + i, values[i]);
+
+	//After that most rows fail against the lowest kept score, so test it before touching the heap
+	for ( ; i < count; i++)
+	{
+		if (values[i] >= _heap.front().score)
+			offer(firstRow + i, values[i]);
+	}
+}
+
+void TopK::merge(const ReductionSink& partial)
+{
+	assert(dynamic_cast<const TopK*>(&partial) != nullptr);
+	const TopK& other = static_cast<const TopK&>(partial);
+
+	for (unsigned int i = 0; i < other._heap.size(); i++)
+		offer(other._heap[i].row, other._heap[i].score);
+}
+
+std::unique_ptr<ReductionSink> TopK::partial() const
+{
+	return std::unique_ptr<ReductionSink>(new TopK(_k));
+}
+
+/** \brief Ranks a single row, keeping it if it ranks above the lowest of the k rows kept
+ *
+ * \param row		The row
+ * \param score		Its score; NaN scores are ignored
+ *
+ */
+void TopK::offer(std::size_t row, double score)
+{
+	if (std::isnan(score))
+		return;
+
+	RankedRow candidate = { row, score };
+
+	if (_heap.size() < _k)
+	{
+		_heap.push_back(candidate);
+		std::push_heap(_heap.begin(), _heap.end(), ranksAbove);
+	}
+	else if (ranksAbove(candidate, _heap.front()))
+	{
+		std::pop_heap(_heap.begin(), _heap.end(), ranksAbove);
+		_heap.back() = candidate;
+		std::push_heap(_heap.begin(), _heap.end(), ranksAbove);
+	}
+}
+
+/** \brief Returns the score a row needs to reach to be kept
+ *
+ * Rows scoring below it can be skipped. A row scoring exactly the threshold is kept only if it
+ * comes before the lowest ranked row kept.
+ *
+ * \return	The lowest score kept once k rows are kept, and -infinity before that
+ *
+ */
+double TopK::threshold() const
+{
+	return full() ? _heap.front().score : -std::numeric_limits<double>::infinity();
+}
+
+/** \brief Returns the rows kept, highest ranked first */
+std::vector<RankedRow> TopK::rows() const
+{
+	std::vector<RankedRow> sorted(_heap);
+	std::sort(sorted.begin(), sorted.end(), ranksAbove);
+	return sorted;
+}
+
+namespace Exparse
+{
+	/** \brief Ranks the rows of a batch by a score, skipping the rows a cheap upper bound rules out
+	 *
+	 * Workers claim chunks of TOP_K_CHUNK_ROWS rows and keep their own TopK. Once it is full, the
+	 * bound is evaluated for a whole chunk first, and the score only for the rows whose bound
+	 * reaches the worker's threshold; the others cannot rank. The workers' rows are merged into
+	 * the result at the end, which gives the same rows for any number of threads. Programs whose
+	 * calls read or write the variable context run on the calling thread alone.
+	 *
+	 * The bound must never be below the score of the same row, or rows may be missed. Rows with a
+	 * NaN bound are always scored.
+	 *
+	 * \param score			The program ranking the rows, with a single output; rows are read like by Program::evaluateBatch()
+	 * \param bound			A program with a single output that is at least the score of every row
+	 * \param rowCount		The number of rows to rank
+	 * \param result		Receives the rows ranked; it may already hold rows from an earlier batch
+	 * \param threadCount	The number of threads to use, or 0 to use one per hardware thread
+	 * \return				The number of rows whose score was evaluated
+	 *
+	 */
+	std::size_t selectTop(const Program& score, const Program& bound, std::size_t rowCount, TopK& result, unsigned int threadCount)
+	{
+		if (score.outputCount() != 1 || bound.outputCount() != 1)
+			throw std::invalid_argument("a score and its bound must each have a single output");
+
+		std::size_t chunks = (rowCount + TOP_K_CHUNK_ROWS - 1) / TOP_K_CHUNK_ROWS;
+
+		if (chunks == 0)
+			return 0;
+
+		if (threadCount == 0)
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+		if ((score.effects() | bound.effects()) & (EFFECT_READS_CONTEXT | EFFECT_WRITES_CONTEXT))
+			threadCount = 1;
+
+		threadCount = static_cast<unsigned int>(std::min<std::size_t>(threadCount, chunks));
+
+		std::atomic<std::size_t> nextChunk(0);
+		std::atomic<std::size_t> scored(0);
+		std::mutex mergeMutex;
+		std::exception_ptr failure;
+
+		auto worker = [&]()
+		{
+			try
+			{
+				Program localScore(score);
+				Program localBound(bound);
+				TopK heap(result.k());
+				std::vector<std::size_t> rows(TOP_K_CHUNK_ROWS);
+				std::vector<double> values(TOP_K_CHUNK_ROWS);
+				double* column = values.data();
+				std::size_t evaluated = 0;
+				std::size_t chunk;
+
+				while ((chunk = nextChunk.fetch_add(1, std::memory_order_relaxed)) < chunks)
+				{
+					std::size_t first = chunk * TOP_K_CHUNK_ROWS;
+					std::size_t count = std::min<std::size_t>(TOP_K_CHUNK_ROWS, rowCount - first);
+
+					for (std::size_t i = 0; i < count; i++)
+						rows[i] = first + i;
+
+					//Nothing can be ruled out before the heap is full
+					if (heap.full())
+					{
+						localBound.evaluateSelection(rows.data(), count, &column);
+
+						double threshold = heap.threshold();
+						std::size_t kept = 0;
+
+						for (std::size_t i = 0; i < count; i++)
+						{
+							rows[kept] = rows[i];
+							kept += !(values[i] < threshold);
+						}
+
+						count = kept;
+					}
+
+					if (count == 0)
+						continue;
+
+					localScore.evaluateSelection(rows.data(), count, &column);
+					evaluated += count;
+
+					for (std::size_t i = 0; i < count; i++)
+						heap.offer(rows[i], values[i]);
+				}
+
+				scored += evaluated;
+
+				std::lock_guard<std::mutex> lock(mergeMutex);
+				result.merge(heap);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(mergeMutex);
+
+				if (!failure)
+					failure = std::current_exception();
+
+				//Stop the other workers from claiming more work
+				nextChunk.store(chunks);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		threads.reserve(threadCount - 1);
+
+		for (unsigned int i = 1; i < threadCount; i++)
+			threads.push_back(std::thread(worker));
+
+		worker();
+
+		for (auto it = threads.begin(); it != threads.end(); ++it)
+			it->join();
+
+		if (failure)
+			std::rethrow_exception(failure);
+
+		return scored;
+	}
+}
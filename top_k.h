@@ -0,0 +1,60 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef TOP_K_H
+#define TOP_K_H
+
+#include	<vector>
+#include	<memory>
+#include	<cstddef>
+
+#include	"reduction.h"
+
+#define		TOP_K_CHUNK_ROWS		4096	/**< Rows bounded, pruned and scored together by Exparse::selectTop() */
+
+class Program;
+
+/** A row and the score it was ranked by */
+struct RankedRow
+{
+	std::size_t row;
+	double score;
+};
+
+/** Keeps the k rows with the highest results.
+ *
+ *  The rows are kept in a bounded heap with the lowest ranked one on top, so a batch is ranked
+ *  in O(rows * log k) time and O(k) memory without storing its scores. Equal scores are ranked
+ *  by row, lower rows first, and NaN scores are never ranked. Since this order is total, the
+ *  rows kept do not depend on how the batch was split among workers or merged.
+ */
+class TopK : public ReductionSink
+{
+	private:
+		unsigned int _k;
+		std::vector<RankedRow> _heap;
+
+	public:
+		TopK(unsigned int k);
+
+		void consume(const double* values, std::size_t count, std::size_t firstRow);
+		void merge(const ReductionSink& partial);
+		std::unique_ptr<ReductionSink> partial() const;
+
+		void offer(std::size_t row, double score);
+		double threshold() const;
+
+		unsigned int k() const { return _k; }
+		unsigned int size() const { return _heap.size(); }
+		bool full() const { return _heap.size() == _k; }
+		std::vector<RankedRow> rows() const;
+};
+
+namespace Exparse
+{
+	std::size_t selectTop(const Program& score, const Program& bound, std::size_t rowCount, TopK& result, unsigned int threadCount = 0);
+}
+
+#endif
@@ -0,0 +1,384 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#include	<algorithm>
+#include	<cstring>
+#include	<stdexcept>
+
+#include	"user_function.h"
+#include	"expression_parser.h"
+
+namespace
+{
+	/** \brief An operand while walking a postfix string: a bare variable, a sub-expression or any other value */
+	struct ScopeOperand
+	{
+		int variableToken;		/**< The index of the variable token, or -1 */
+		unsigned int first;		/**< The tokens of a sub-expression, empty for other operands */
+		unsigned int last;
+	};
+
+	bool isDefined(const Token& t, const VariableContext& locals, const std::vector<unsigned int>& defined)
+	{
+		unsigned int id = t.toVariable().id();
+
+		return locals.lookupVariable(id)->isConstant() || std::find(defined.begin(), defined.end(), id) != defined.end();
+	}
+
+	/** \brief Finds the first variable used outside the scope that defines it
+	 *
+	 * A variable bound by a function taking sub-expressions, such as k in sum(k, 1, n, k^2), is only
+	 * defined inside the sub-expressions passed to that call.
+	 *
+	 * \param postfix	The postfix string of the body
+	 * \param first		The first token to check
+	 * \param last		One past the last token to check
+	 * \param defined	The variables in scope, starting with the parameters; restored on return
+	 * \return			The index of the offending token, or -1 if every variable is defined
+	 *
+	 */
+	int findUndefinedVariable(const std::vector<Token>& postfix, unsigned int first, unsigned int last,
+			const FunctionContext& fc, const VariableContext& locals, std::vector<unsigned int>& defined)
+	{
+		unsigned int derefId = fc.getFunctionID(std::string("_deref"));
+		std::vector<ScopeOperand> stack;
+
+		for (unsigned int i = first; i <= last; i++)
+		{
+			//Bare variables left over at the end of a statement are read like any other
+			if (i == last || postfix[i].type() == Token::DELIMITER)
+			{
+				for (unsigned int j = 0; j < stack.size(); j++)
+					if (stack[j].variableToken >= 0 && !isDefined(postfix[stack[j].variableToken], locals, defined))
+						return stack[j].variableToken;
+
+				stack.clear();
+				continue;
+			}
+
+			const Token& t = postfix[i];
+			ScopeOperand operand = { -1, 0, 0 };
+
+			switch (t.type())
+			{
+				case Token::VARIABLE:
+					operand.variableToken = i;
+					break;
+
+				case Token::EXPRESSION:
+					operand.first = i + 1;
+					operand.last = i + 1 + t.toExpression().length();
+					i = operand.last - 1;
+					break;
+
+				case Token::FUNCTION:
+				case Token::OPERATOR:
+				{
+					bool isOperator = t.type() == Token::OPERATOR;
+					unsigned int id = isOperator ? t.toOperator().id() : t.toFunction().id();
+					bool isDeref = !isOperator && id == derefId;
+					unsigned int arity = isDeref ? 1 : isOperator ? fc.lookupOperator(id)->arity() : t.toFunction().arity();
+					bool binds = !isOperator && !isDeref && fc.lookupFunction(id)->takesExpressions();
+					std::size_t scopeSize = defined.size();
+
+					assert(stack.size() >= arity);
+					std::vector<ScopeOperand> arguments(stack.end() - arity, stack.end());
+					stack.resize(stack.size() - arity);
+
+					//The bare variables passed along with sub-expressions are the ones those sub-expressions bind
+					for (unsigned int j = 0; j < arguments.size(); j++)
+					{
+						if (arguments[j].variableToken < 0)
+							continue;
+
+						if (binds)
+							defined.push_back(postfix[arguments[j].variableToken].toVariable().id());
+						else if (!isDefined(postfix[arguments[j].variableToken], locals, defined))
+							return arguments[j].variableToken;
+					}
+
+					for (unsigned int j = 0; j < arguments.size(); j++)
+					{
+						if (arguments[j].first == arguments[j].last)
+							continue;
+
+						int undefined = findUndefinedVariable(postfix, arguments[j].first, arguments[j].last, fc, locals, defined);
+						if (undefined >= 0)
+							return undefined;
+					}
+
+					defined.resize(scopeSize);
+					break;
+				}
+
+				default:
+					break;
+			}
+
+			stack.push_back(operand);
+		}
+
+		return -1;
+	}
+
+	bool isWhitespace(char c)
+	{
+		return c != '\0' && std::strchr(WHITESPACE_CHARS, c) != nullptr;
+	}
+
+	bool isIdentifierStart(char c)
+	{
+		return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+	}
+
+	void skipWhitespace(const std::string& str, unsigned int& index)
+	{
+		while (index < str.length() && isWhitespace(str[index]))
+			index++;
+	}
+
+	bool parseName(const std::string& str, unsigned int& index, std::string& name)
+	{
+		unsigned int start = index;
+
+		if (index >= str.length() || !isIdentifierStart(str[index]))
+			return false;
+
+		while (index < str.length() && (isIdentifierStart(str[index]) || (str[index] >= '0' && str[index] <= '9')))
+			index++;
+
+		name = str.substr(start, index - start);
+		return true;
+	}
+
+	/** \brief Splits "name(p1, p2, ...) = body" into its parts
+	 *
+	 * \return		The column of the first error, or -1 if the header is well formed
+	 *
+	 */
+	int parseHeader(const std::string& str, std::string& name, std::vector<std::string>& parameters,
+			std::vector<unsigned int>& columns, unsigned int& bodyStart)
+	{
+		unsigned int i = 0;
+		std::string parameter;
+
+		skipWhitespace(str, i);
+		if (!parseName(str, i, name)) return i;
+
+		skipWhitespace(str, i);
+		if (i >= str.length() || str[i] != '(') return i;
+		i++;
+
+		skipWhitespace(str, i);
+
+		if (i < str.length() && str[i] == ')')
+			i++;
+		else
+		{
+			while (true)
+			{
+				skipWhitespace(str, i);
+				columns.push_back(i);
+				if (!parseName(str, i, parameter)) return i;
+
+				parameters.push_back(parameter);
+
+				skipWhitespace(str, i);
+				if (i >= str.length()) return i;
+				if (str[i++] == ')') break;
+				if (str[i - 1] != ',') return i - 1;
+			}
+		}
+
+		skipWhitespace(str, i);
+
+		//A following '=' would make this a comparison rather than a definition
+		if (i >= str.length() || str[i] != '=' || (i + 1 < str.length() && str[i + 1] == '=')) return i;
+
+		bodyStart = i + 1;
+		return -1;
+	}
+}
+
+UserFunction::UserFunction(const std::string& name, const FunctionContext& fc) :
+	_name(name),
+	_body(fc),
+	_callCount(0),
+	_effects(EFFECT_NONE)
+{
+	for (unsigned int p = PRECISION_FULL; p <= PRECISION_FAST; p++)
+		_tiers[p].owner = this;
+}
+
+/** \brief Checks whether a string has the form of a function definition rather than an expression
+ *
+ * \param str	The string to check
+ * \return 		True if str starts with "name(parameters) ="
+ *
+ */
+bool UserFunction::isDefinition(const std::string& str)
+{
+	std::string name;
+	std::vector<std::string> parameters;
+	std::vector<unsigned int> columns;
+	unsigned int bodyStart;
+
+	return parseHeader(str, name, parameters, columns, bodyStart) < 0;
+}
+
+/** \brief Parses and compiles a definition such as "f(x, y) = x*exp(-y)"
+ *
+ * \param definition	The definition
+ * \param fc			The function context the body's functions are resolved in
+ * \param result		Receives the outcome; error columns refer to the whole definition
+ * \return				The compiled function, or nullptr if the definition is invalid
+ *
+ */
+std::shared_ptr<UserFunction> UserFunction::parse(const std::string& definition, const FunctionContext& fc, ParseResult& result)
+{
+	std::string name;
+	std::vector<std::string> parameters;
+	std::vector<unsigned int> columns;
+	unsigned int bodyStart = 0;
+	int errorColumn = parseHeader(definition, name, parameters, columns, bodyStart);
+
+	result = ParseResult();
+
+	if (errorColumn >= 0)
+	{
+		result = ParseResult::malformedDefinition(errorColumn);
+		return nullptr;
+	}
+
+	if (fc.getFunctionID(name) != NULLID)
+	{
+		result = ParseResult::duplicateFunction(name, definition.find(name));
+		return nullptr;
+	}
+
+	std::shared_ptr<UserFunction> func(new UserFunction(name, fc));
+
+	for (unsigned int i = 0; i < parameters.size(); i++)
+	{
+		unsigned int id = func->_locals.getId(parameters[i]);
+
+		//Parameters may not repeat or shadow constants such as pi
+		if (func->_locals.lookupVariable(id)->isConstant() || func->parameterIndex(id) >= 0)
+		{
+			result = ParseResult::malformedDefinition(columns[i]);
+			return nullptr;
+		}
+
+		func->_parameterIds.push_back(id);
+	}
+
+	ExpressionParser body(definition.substr(bodyStart), func->_locals, fc, result);
+
+	if (result.failed())
+	{
+		if (result.code() == ParseResult::UNKNOWN_FUNCTION && result.subject() == name)
+			result = ParseResult::recursiveDefinition(name, result.column());
+
+		result.offsetColumn(bodyStart);
+		return nullptr;
+	}
+
+	const std::vector<Token>& postfix = body.postfixString();
+	std::vector<unsigned int> defined(func->_parameterIds);
+	bool assigns = false;
+
+	try
+	{
+		func->_body.addOutput(func->_body.addExpression(body));
+	}
+	catch (std::invalid_argument&)
+	{
+		//Only assignments return variable references or take them as arguments
+		assigns = true;
+	}
+
+	int undefined = findUndefinedVariable(postfix, 0, postfix.size(), fc, func->_locals, defined);
+
+	if (undefined >= 0)
+	{
+		const Variable* var = func->_locals.lookupVariable(postfix[undefined].toVariable().id());
+		result = ParseResult::undefinedVariable(var->name(), bodyStart + postfix[undefined].location());
+		return nullptr;
+	}
+
+	if (assigns)
+	{
+		result = ParseResult::assignmentInDefinition(bodyStart);
+		return nullptr;
+	}
+
+	std::vector<bool> live = func->_body.liveNodes();
+
+	for (unsigned int i = 0; i < func->_body.size(); i++)
+	{
+		const ExpressionGraph::Node& n = func->_body.node(i);
+
+		if (!live[i] || n.type != ExpressionGraph::NODE_CALL)
+			continue;
+
+		if (n.sideEffects)
+		{
+			result = ParseResult::assignmentInDefinition(bodyStart);
+			return nullptr;
+		}
+
+		func->_effects |= n.effects;
+		func->_callCount++;
+	}
+
+	for (unsigned int p = PRECISION_FULL; p <= PRECISION_FAST; p++)
+		func->_tiers[p].program.reset(new Program(func->_body, func->_locals, static_cast<Precision>(p)));
+
+	return func;
+}
+
+/** \brief Finds the position of a parameter
+ *
+ * \param variableId	A variable ID in the body
+ * \return				The index of the parameter, or -1 if the variable isn't one
+ *
+ */
+int UserFunction::parameterIndex(unsigned int variableId) const
+{
+	for (unsigned int i = 0; i < _parameterIds.size(); i++)
+		if (_parameterIds[i] == variableId)
+			return i;
+
+	return -1;
+}
+
+/** \brief Returns the value of a constant (such as pi) read by the body */
+double UserFunction::constantValue(unsigned int variableId) const
+{
+	assert(_locals.lookupVariable(variableId)->isConstant());
+	return *_locals.slots()[variableId - 1];
+}
+
+/** \brief Returns a callable that evaluates the body with the given precision
+ *
+ * \param precision		The precision the body's functions are evaluated with
+ * \return				A descriptor whose state is owned by this definition
+ *
+ */
+NativeFunction UserFunction::implementation(Precision precision)
+{
+	return NativeFunction(&callThunk, &_tiers[precision], arity());
+}
+
+double UserFunction::callThunk(void* state, const Value* args)
+{
+	Tier* tier = static_cast<Tier*>(state);
+	UserFunction* func = tier->owner;
+
+	for (unsigned int i = 0; i < func->_parameterIds.size(); i++)
+		func->_locals.value(func->_parameterIds[i]) = args[i].numeric;
+
+	return tier->program->evaluate();
+}
@@ -0,0 +1,74 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef USER_FUNCTION_H
+#define USER_FUNCTION_H
+
+#include	<string>
+#include	<vector>
+#include	<memory>
+
+#include	"context.h"
+#include	"expression_graph.h"
+#include	"program.h"
+#include	"parse_result.h"
+
+#define	USER_FUNCTION_INLINE_LIMIT		16
+
+/** A function written in the expression language, e.g. "f(x, y) = x*exp(-y)".
+ *
+ *  The body may only read its parameters, constants such as pi and the variables bound by sum(),
+ *  prod() and integrate(); it cannot assign to variables or call the function being defined.
+ *  Since definitions cannot be replaced, a body can only call
+ *  functions that existed before it, so recursion (direct or mutual) is limited to a function
+ *  naming itself, which is reported as RECURSIVE_DEFINITION.
+ *
+ *  When called at run time the body is evaluated as a compiled Program. Bodies with at most
+ *  USER_FUNCTION_INLINE_LIMIT calls are instead inlined by ExpressionGraph at each call site, which
+ *  lets constant folding and common subexpression elimination see through them.
+ *
+ *  Calls that aren't inlined are not thread-safe, since the parameters and registers live in the
+ *  definition. Such calls therefore report EFFECT_READS_CONTEXT, which keeps them from being
+ *  folded or shared and makes the parallel drivers evaluate them on a single thread.
+ */
+class UserFunction
+{
+	private:
+		struct Tier
+		{
+			UserFunction* owner;
+			std::unique_ptr<Program> program;
+		};
+
+		std::string _name;
+		VariableContext _locals;
+		std::vector<unsigned int> _parameterIds;	/**< Parameter variables in _locals, in declaration order */
+		ExpressionGraph _body;
+		Tier _tiers[2];
+		unsigned int _callCount;
+		unsigned int _effects;		/**< The union of the Effect flags of the functions the body calls */
+
+		UserFunction(const std::string& name, const FunctionContext& fc);
+
+		static double callThunk(void* state, const Value* args);
+
+	public:
+		static std::shared_ptr<UserFunction> parse(const std::string& definition, const FunctionContext& fc, ParseResult& result);
+		static bool isDefinition(const std::string& str);
+
+		const std::string& name() const { return _name; }
+		unsigned int arity() const { return _parameterIds.size(); }
+		const ExpressionGraph& body() const { return _body; }
+		unsigned int effects() const { return isInlinable() ? _effects : _effects | EFFECT_READS_CONTEXT; }
+		bool isPure() const { return effects() == EFFECT_NONE; }
+		bool isInlinable() const { return _effects == EFFECT_NONE && _callCount <= USER_FUNCTION_INLINE_LIMIT; }
+
+		int parameterIndex(unsigned int variableId) const;
+		double constantValue(unsigned int variableId) const;
+
+		NativeFunction implementation(Precision precision);
+};
+
+#endif
@@ -9,33 +9,27 @@
 #include <string>
 #include <assert.h>
 
+/** Cold per-variable metadata. The values themselves live in a dense array owned by VariableContext. */
 class Variable
 {
 	private:
 		std::string _name;
-		double _value;
 		bool _constant;
 
 	public:
-		Variable(std::string varName, double val = 0.0, bool isConstant = false) :
+		Variable(std::string varName, bool isConstant = false) :
 			_name(varName),
-			_value(val),
 			_constant(isConstant)
 		{ }
 
-		std::string name() const
+		const std::string& name() const
 		{
 			return _name;
 		}
 
-		double value() const
+		bool isConstant() const
 		{
-			return _value;
-		}
-
-		double& getReference()
-		{
-			return _value;
+			return _constant;
 		}
 };
 
@@ -0,0 +1,123 @@
+/****************************************************
+*	Exparse - Math expression evaluator library		*
+* 	Copyright (C) 2013 Jordan Melo				 	*
+****************************************************/
+
+#ifndef VECTOR_KERNELS_H
+#define VECTOR_KERNELS_H
+
+#include	<cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include	<emmintrin.h>
+#define		EXPARSE_HAS_SSE2	1
+#endif
+
+namespace Exparse
+{
+	/** Loops over contiguous arrays of doubles, two lanes at a time where SSE2 is available.
+	 *
+	 *  The element-wise kernels allow dest to be the same array as an operand, but not to overlap
+	 *  it otherwise. With SSE2, reductions keep eight partial sums, which shortens the chain of
+	 *  dependent additions eightfold and makes the rounding error grow with count / 8 rather than count.
+	 */
+	namespace kernels
+	{
+#ifdef EXPARSE_HAS_SSE2
+		#define	EXPARSE_ELEMENTWISE_KERNEL(name, vectorOp, scalarOp)										\
+			inline void name(double* dest, const double* a, const double* b, std::size_t count)				\
+			{																								\
+				std::size_t i = 0;																			\
+																											\
+				for ( ; i + 4 <= count; i += 4)																\
+				{																							\
+					__m128d x0 = vectorOp(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));						\
+					__m128d x1 = vectorOp(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2));				\
+					_mm_storeu_pd(dest + i, x0);															\
+					_mm_storeu_pd(dest + i + 2, x1);														\
+				}																							\
+																											\
+				for ( ; i < count; i++)																		\
+					dest[i] = a[i] scalarOp b[i];															\
+			}
+#else
+		#define	EXPARSE_ELEMENTWISE_KERNEL(name, vectorOp, scalarOp)										\
+			inline void name(double* dest, const double* a, const double* b, std::size_t count)				\
+			{																								\
+				for (std::size_t i = 0; i < count; i++)														\
+					dest[i] = a[i] scalarOp b[i];															\
+			}
+#endif
+
+		EXPARSE_ELEMENTWISE_KERNEL(add, _mm_add_pd, +)
+		EXPARSE_ELEMENTWISE_KERNEL(subtract, _mm_sub_pd, -)
+		EXPARSE_ELEMENTWISE_KERNEL(multiply, _mm_mul_pd, *)
+		EXPARSE_ELEMENTWISE_KERNEL(divide, _mm_div_pd, /)
+
+		#undef	EXPARSE_ELEMENTWISE_KERNEL
+
+		inline void negate(double* dest, const double* a, std::size_t count)
+		{
+			std::size_t i = 0;
+
+#ifdef EXPARSE_HAS_SSE2
+			//Flipping the sign bit negates zeros and NaNs the same way as unary minus
+			const __m128d sign = _mm_set1_pd(-0.0);
+
+			for ( ; i + 2 <= count; i += 2)
+				_mm_storeu_pd(dest + i, _mm_xor_pd(_mm_loadu_pd(a + i), sign));
+#endif
+
+			for ( ; i < count; i++)
+				dest[i] = -a[i];
+		}
+
+		/** \brief Returns the sum of a[i] * b[i], or of a[i] if b is null */
+		inline double dot(const double* a, const double* b, std::size_t count)
+		{
+			std::size_t i = 0;
+			double sum = 0.0;
+
+#ifdef EXPARSE_HAS_SSE2
+			__m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd(), s2 = _mm_setzero_pd(), s3 = _mm_setzero_pd();
+
+			if (b == nullptr)
+			{
+				for ( ; i + 8 <= count; i += 8)
+				{
+					s0 = _mm_add_pd(s0, _mm_loadu_pd(a + i));
+					s1 = _mm_add_pd(s1, _mm_loadu_pd(a + i + 2));
+					s2 = _mm_add_pd(s2, _mm_loadu_pd(a + i + 4));
+					s3 = _mm_add_pd(s3, _mm_loadu_pd(a + i + 6));
+				}
+			}
+			else
+			{
+				for ( ; i + 8 <= count; i += 8)
+				{
+					s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+					s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+					s2 = _mm_add_pd(s2, _mm_mul_pd(_mm_loadu_pd(a + i + 4), _mm_loadu_pd(b + i + 4)));
+					s3 = _mm_add_pd(s3, _mm_mul_pd(_mm_loadu_pd(a + i + 6), _mm_loadu_pd(b + i + 6)));
+				}
+			}
+
+			double lanes[2];
+			_mm_storeu_pd(lanes, _mm_add_pd(_mm_add_pd(s0, s1), _mm_add_pd(s2, s3)));
+			sum = lanes[0] + lanes[1];
+#endif
+
+			for ( ; i < count; i++)
+				sum += b == nullptr ? a[i] : a[i] * b[i];
+
+			return sum;
+		}
+
+		inline double sum(const double* a, std::size_t count)
+		{
+			return dot(a, nullptr, count);
+		}
+	}
+}
+
+#endif